@@ -0,0 +1,381 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "area_index.h"
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char AREA_INDEX_MAGIC[8] = {'V', 'W', 'A', 'R', 'E', 'A', 'S', 0};
+static const uint32_t AREA_INDEX_VERSION = 1;
+
+static_assert(sizeof(AreaVertex) == 3 * sizeof(double),
+              "AreaVertex must be packed");
+static_assert(sizeof(AreaIndexHeader) % 8 == 0,
+              "sections following the header must stay 8-byte aligned");
+
+MappedFile::MappedFile()
+    : m_data(NULL)
+    , m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* path)
+{
+    close();
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    m_size = static_cast<size_t>(file_stat.st_size);
+    if (m_size > 0)
+    {
+        void* data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            ::close(fd);
+            m_size = 0;
+            return false;
+        }
+        m_data = static_cast<const char*>(data);
+    }
+    // the mapping stays valid once the descriptor is closed
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+    m_data = NULL;
+    m_size = 0;
+}
+
+bool offsets_valid(const uint64_t* offsets, uint64_t count, uint64_t end,
+                   uint64_t min_step)
+{
+    if (offsets[0] != 0 || offsets[count] != end)
+    {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        if (offsets[i+1] < offsets[i] || offsets[i+1] - offsets[i] < min_step)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+AreaIndexWriter::AreaIndexWriter()
+    : m_file(NULL)
+    , m_fids()
+    , m_feature_offsets()
+    , m_polygon_offsets()
+    , m_ring_offsets()
+    , m_ring_buffer()
+    , m_failed(false)
+{
+}
+
+AreaIndexWriter::~AreaIndexWriter()
+{
+    close();
+}
+
+bool AreaIndexWriter::open(const char* path)
+{
+    assert(m_file == NULL);
+    m_file = fopen(path, "wb");
+    if (m_file == NULL)
+    {
+        std::cerr << "Cannot create index: " << path << std::endl;
+        return false;
+    }
+    // the header is rewritten with the final counts by close()
+    AreaIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    m_failed = fwrite(&header, sizeof(header), 1, m_file) != 1;
+    m_fids.clear();
+    m_feature_offsets.assign(1, 0);
+    m_polygon_offsets.assign(1, 0);
+    m_ring_offsets.assign(1, 0);
+    return !m_failed;
+}
+
+bool AreaIndexWriter::add_ring(const Linestring& ring,
+                               const EffectiveAreas& areas)
+{
+    m_ring_buffer.resize(ring.size());
+    for (size_t i = 0; i < ring.size(); ++i)
+    {
+        m_ring_buffer[i].X = ring[i].X;
+        m_ring_buffer[i].Y = ring[i].Y;
+        m_ring_buffer[i].area = 0.0;
+    }
+    // vertices dropped by a pre-filter keep a null area
+    for (size_t i = 0; i < areas.size(); ++i)
+    {
+        m_ring_buffer[areas.source_index(i)].area = areas.areas[i];
+    }
+    if (!ring.empty())
+    {
+        m_ring_buffer.front().area = std::numeric_limits<double>::infinity();
+        m_ring_buffer.back().area = std::numeric_limits<double>::infinity();
+        if (fwrite(&m_ring_buffer[0], sizeof(AreaVertex), ring.size(),
+                   m_file) != ring.size())
+        {
+            return false;
+        }
+    }
+    m_ring_offsets.push_back(m_ring_offsets.back() + ring.size());
+    return true;
+}
+
+bool AreaIndexWriter::add_feature(int64_t fid, const MultiPolygon& shape,
+                                  const EffectiveAreas* ring_areas)
+{
+    assert(m_file);
+    for (size_t i = 0; i < shape.size() && !m_failed; ++i)
+    {
+        const Polygon& poly = shape[i];
+        m_failed = !add_ring(poly.exterior_ring, *ring_areas++);
+        for (size_t j = 0; j < poly.interior_rings.size() && !m_failed; ++j)
+        {
+            m_failed = !add_ring(poly.interior_rings[j], *ring_areas++);
+        }
+        m_polygon_offsets.push_back(m_ring_offsets.size() - 1);
+    }
+    m_fids.push_back(fid);
+    m_feature_offsets.push_back(m_polygon_offsets.size() - 1);
+    if (m_failed)
+    {
+        std::cerr << "Cannot write index feature " << fid << std::endl;
+    }
+    return !m_failed;
+}
+
+template <typename T>
+static bool write_section(FILE* file, const std::vector<T>& values,
+                          uint64_t* offset)
+{
+    *offset = static_cast<uint64_t>(ftello(file));
+    return values.empty()
+           || fwrite(&values[0], sizeof(T), values.size(), file)
+              == values.size();
+}
+
+bool AreaIndexWriter::close()
+{
+    if (m_file == NULL)
+    {
+        return !m_failed;
+    }
+    AreaIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AREA_INDEX_MAGIC, sizeof(header.magic));
+    header.version = AREA_INDEX_VERSION;
+    header.header_size = sizeof(header);
+    header.feature_count = m_fids.size();
+    header.polygon_count = m_polygon_offsets.size() - 1;
+    header.ring_count = m_ring_offsets.size() - 1;
+    header.vertex_count = m_ring_offsets.back();
+    header.vertices_offset = sizeof(header);
+    bool res = !m_failed
+        && write_section(m_file, m_fids, &header.fids_offset)
+        && write_section(m_file, m_feature_offsets,
+                         &header.feature_offsets_offset)
+        && write_section(m_file, m_polygon_offsets,
+                         &header.polygon_offsets_offset)
+        && write_section(m_file, m_ring_offsets,
+                         &header.ring_offsets_offset)
+        && fseeko(m_file, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, m_file) == 1;
+    res = (fclose(m_file) == 0) && res;
+    m_file = NULL;
+    m_failed = !res;
+    return res;
+}
+
+AreaIndex::AreaIndex()
+    : m_file()
+    , m_header(NULL)
+    , m_vertices(NULL)
+    , m_fids(NULL)
+    , m_feature_offsets(NULL)
+    , m_polygon_offsets(NULL)
+    , m_ring_offsets(NULL)
+{
+}
+
+// Whether 'count' elements of 'element_size' bytes at 'offset' fit in the
+// file.
+static bool section_fits(uint64_t offset, uint64_t count,
+                         size_t element_size, size_t file_size)
+{
+    return offset % 8 == 0 && offset <= file_size
+        && count <= (file_size - offset) / element_size;
+}
+
+bool AreaIndex::open(const char* path)
+{
+    m_header = NULL;
+    if (!m_file.open(path))
+    {
+        std::cerr << "Cannot map index " << path << ": " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    const size_t file_size = m_file.size();
+    const AreaIndexHeader* header =
+        reinterpret_cast<const AreaIndexHeader*>(m_file.data());
+    if (file_size < sizeof(AreaIndexHeader)
+        || memcmp(header->magic, AREA_INDEX_MAGIC, sizeof(header->magic)) != 0)
+    {
+        std::cerr << "Not an area index: " << path << std::endl;
+        return false;
+    }
+    if (header->version != AREA_INDEX_VERSION
+        || header->header_size != sizeof(AreaIndexHeader))
+    {
+        std::cerr << "Unsupported area index version " << header->version
+                  << ": " << path << std::endl;
+        return false;
+    }
+    // each offset array holds count + 1 entries, which must not wrap
+    if (header->feature_count >= file_size
+        || header->polygon_count >= file_size
+        || header->ring_count >= file_size
+        || !section_fits(header->vertices_offset, header->vertex_count,
+                      sizeof(AreaVertex), file_size)
+        || !section_fits(header->fids_offset, header->feature_count,
+                         sizeof(int64_t), file_size)
+        || !section_fits(header->feature_offsets_offset,
+                         header->feature_count + 1, sizeof(uint64_t),
+                         file_size)
+        || !section_fits(header->polygon_offsets_offset,
+                         header->polygon_count + 1, sizeof(uint64_t),
+                         file_size)
+        || !section_fits(header->ring_offsets_offset, header->ring_count + 1,
+                         sizeof(uint64_t), file_size))
+    {
+        std::cerr << "Truncated area index: " << path << std::endl;
+        return false;
+    }
+
+    const char* data = m_file.data();
+    m_vertices = reinterpret_cast<const AreaVertex*>(
+            data + header->vertices_offset);
+    m_fids = reinterpret_cast<const int64_t*>(data + header->fids_offset);
+    m_feature_offsets = reinterpret_cast<const uint64_t*>(
+            data + header->feature_offsets_offset);
+    m_polygon_offsets = reinterpret_cast<const uint64_t*>(
+            data + header->polygon_offsets_offset);
+    m_ring_offsets = reinterpret_cast<const uint64_t*>(
+            data + header->ring_offsets_offset);
+    // offsets are trusted from here on: every polygon needs an exterior
+    // ring
+    if (!offsets_valid(m_feature_offsets, header->feature_count,
+                       header->polygon_count, 0)
+        || !offsets_valid(m_polygon_offsets, header->polygon_count,
+                          header->ring_count, 1)
+        || !offsets_valid(m_ring_offsets, header->ring_count,
+                          header->vertex_count, 0))
+    {
+        std::cerr << "Corrupt area index: " << path << std::endl;
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+void AreaIndex::source_shape(size_t feature, MultiPolygon* res) const
+{
+    assert(feature < feature_count());
+    const uint64_t first_polygon = m_feature_offsets[feature];
+    const uint64_t end_polygon = m_feature_offsets[feature + 1];
+    res->resize(end_polygon - first_polygon);
+    for (uint64_t i = first_polygon; i < end_polygon; ++i)
+    {
+        Polygon& poly = (*res)[i - first_polygon];
+        const uint64_t first_ring = m_polygon_offsets[i];
+        const uint64_t end_ring = m_polygon_offsets[i + 1];
+        poly.interior_rings.resize(end_ring - first_ring - 1);
+        for (uint64_t ring = first_ring; ring < end_ring; ++ring)
+        {
+            Linestring& line = ring == first_ring
+                ? poly.exterior_ring
+                : poly.interior_rings[ring - first_ring - 1];
+            line.clear();
+            for (uint64_t v = m_ring_offsets[ring];
+                 v < m_ring_offsets[ring + 1]; ++v)
+            {
+                line.push_back(Point(m_vertices[v].X, m_vertices[v].Y));
+            }
+        }
+    }
+}
+
+void AreaIndex::filter_ring(size_t ring, double area_threshold,
+                            Linestring* res) const
+{
+    res->clear();
+    for (uint64_t v = m_ring_offsets[ring]; v < m_ring_offsets[ring + 1];
+         ++v)
+    {
+        const AreaVertex& vertex = m_vertices[v];
+        if (vertex.area > area_threshold)
+        {
+            res->push_back(Point(vertex.X, vertex.Y));
+        }
+    }
+    if (res->size() < 4)
+    {
+        res->clear();
+    }
+}
+
+void AreaIndex::simplify(size_t feature, double area_threshold,
+                         MultiPolygon* res) const
+{
+    assert(feature < feature_count());
+    const uint64_t first_polygon = m_feature_offsets[feature];
+    const uint64_t end_polygon = m_feature_offsets[feature + 1];
+    res->resize(end_polygon - first_polygon);
+    for (uint64_t i = first_polygon; i < end_polygon; ++i)
+    {
+        Polygon& poly = (*res)[i - first_polygon];
+        const uint64_t first_ring = m_polygon_offsets[i];
+        const uint64_t end_ring = m_polygon_offsets[i + 1];
+        poly.interior_rings.resize(end_ring - first_ring - 1);
+        filter_ring(first_ring, area_threshold, &poly.exterior_ring);
+        for (uint64_t ring = first_ring + 1; ring < end_ring; ++ring)
+        {
+            filter_ring(ring, area_threshold,
+                        &poly.interior_rings[ring - first_ring - 1]);
+        }
+    }
+}
@@ -0,0 +1,165 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef AREA_INDEX_H
+#define AREA_INDEX_H
+
+#include <cstdio>
+#include <vector>
+#include <stdint.h>
+#include "geo_types.h"
+#include "visvalingam_algorithm.h"
+
+// Effective-area index: a sidecar file holding every vertex of a layer
+// together with its effective area, so that any area threshold can later
+// be served by a linear filter over a memory-mapped file, without parsing
+// the source or running the elimination loop again.
+//
+// Layout, native byte order, every section 8-byte aligned:
+//   AreaIndexHeader
+//   AreaVertex[vertex_count]         ring after ring
+//   int64_t[feature_count]           source feature ids
+//   uint64_t[feature_count + 1]      first polygon of each feature
+//   uint64_t[polygon_count + 1]      first ring of each polygon
+//   uint64_t[ring_count + 1]         first vertex of each ring
+// Ring 0 of a polygon is its exterior ring.
+
+// Ring endpoints are stored with an infinite area: they are always kept.
+struct AreaVertex
+{
+    double X;
+    double Y;
+    double area;
+};
+
+struct AreaIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t feature_count;
+    uint64_t polygon_count;
+    uint64_t ring_count;
+    uint64_t vertex_count;
+    // byte offsets from the start of the file
+    uint64_t vertices_offset;
+    uint64_t fids_offset;
+    uint64_t feature_offsets_offset;
+    uint64_t polygon_offsets_offset;
+    uint64_t ring_offsets_offset;
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Returns false, with errno set, if the file cannot be mapped.
+    bool open(const char* path);
+    void close();
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    MappedFile(const MappedFile& other);
+    MappedFile& operator=(const MappedFile& other);
+
+    const char* m_data;
+    size_t m_size;
+};
+
+// Whether the 'count' + 1 'offsets' go from 0 to 'end', each at least
+// 'min_step' past the one before: the readers below index their sections
+// with them, e.g.: polygon offsets need a step of 1, for an exterior ring.
+bool offsets_valid(const uint64_t* offsets, uint64_t count, uint64_t end,
+                   uint64_t min_step);
+
+// Streams features to a new index file. Vertices are written as they come;
+// only the offset arrays are kept in memory until close().
+class AreaIndexWriter
+{
+public:
+    AreaIndexWriter();
+    ~AreaIndexWriter();
+
+    bool open(const char* path);
+
+    // 'ring_areas' holds the effective areas of the feature's rings, in
+    // polygon then ring order.
+    bool add_feature(int64_t fid, const MultiPolygon& shape,
+                     const EffectiveAreas* ring_areas);
+
+    // Writes the offset arrays and the header. Returns false on I/O error.
+    bool close();
+
+private:
+    AreaIndexWriter(const AreaIndexWriter& other);
+    AreaIndexWriter& operator=(const AreaIndexWriter& other);
+
+    bool add_ring(const Linestring& ring, const EffectiveAreas& areas);
+
+    FILE* m_file;
+    std::vector<int64_t> m_fids;
+    std::vector<uint64_t> m_feature_offsets;
+    std::vector<uint64_t> m_polygon_offsets;
+    std::vector<uint64_t> m_ring_offsets;
+    std::vector<AreaVertex> m_ring_buffer;
+    bool m_failed;
+};
+
+// Memory-mapped index file.
+class AreaIndex
+{
+public:
+    AreaIndex();
+
+    // Maps and validates the file; reports problems on stderr.
+    bool open(const char* path);
+
+    size_t feature_count() const
+    {
+        return m_header ? m_header->feature_count : 0;
+    }
+
+    int64_t feature_fid(size_t feature) const
+    {
+        return m_fids[feature];
+    }
+
+    // Full resolution shape of a feature.
+    void source_shape(size_t feature, MultiPolygon* res) const;
+
+    // Keeps the vertices whose effective area is above 'area_threshold',
+    // dropping rings left with less than 4 points, as
+    // Visvalingam_Algorithm::simplify() does.
+    void simplify(size_t feature, double area_threshold,
+                  MultiPolygon* res) const;
+
+private:
+    AreaIndex(const AreaIndex& other);
+    AreaIndex& operator=(const AreaIndex& other);
+
+    void filter_ring(size_t ring, double area_threshold,
+                     Linestring* res) const;
+
+    MappedFile m_file;
+    const AreaIndexHeader* m_header;
+    const AreaVertex* m_vertices;
+    const int64_t* m_fids;
+    const uint64_t* m_feature_offsets;
+    const uint64_t* m_polygon_offsets;
+    const uint64_t* m_ring_offsets;
+};
+
+#endif // AREA_INDEX_H
@@ -0,0 +1,549 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+//
+// Timings of the simplification stages on deterministic synthetic inputs,
+// built by `make bench`. For each input and size, prints the time per input
+// vertex (best of a few runs), the heap allocations of one run and the peak
+// resident set size of the process so far.
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/resource.h>
+#include <ogrsf_frmts.h>
+#include "visvalingam_algorithm.h"
+#include "geo_types.h"
+#include "heap.hpp"
+#include "radix_heap.hpp"
+#include "thread_pool.h"
+
+// Every allocation of the process goes through here to be counted.
+static std::atomic<size_t> g_allocation_count(0);
+
+void* operator new(size_t size)
+{
+    ++g_allocation_count;
+    void* res = malloc(size ? size : 1);
+    if (!res)
+    {
+        throw std::bad_alloc();
+    }
+    return res;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// Synthetic inputs. All of them are seeded so every run sees the same
+// coordinates.
+struct BenchInput
+{
+    BenchInput() : vertex_count(0) {}
+
+    std::string name;
+    std::vector<Linestring> lines;
+    size_t vertex_count;
+};
+
+// Koch snowflake with each bump pointing in or out at random, refined until
+// it has 'vertex_count' vertices: a closed, self-similar coastline. Sides
+// are in meters so the finest bumps stay well above NEARLY_ZERO.
+static void make_koch_coastline(size_t vertex_count, Linestring* res)
+{
+    std::mt19937 rng(1);
+    const double side = 1e7;
+    Linestring ring;
+    ring.push_back(Point(0.0, 0.0));
+    ring.push_back(Point(0.5 * side, sqrt(0.75) * side));
+    ring.push_back(Point(side, 0.0));
+    ring.push_back(Point(0.0, 0.0));
+    while (ring.size() < vertex_count)
+    {
+        // each refined segment gains 3 vertices; the last pass only refines
+        // enough of them to reach vertex_count.
+        Linestring next;
+        next.reserve(std::min(vertex_count, ring.size() * 4));
+        next.push_back(ring[0]);
+        for (size_t i = 1; i < ring.size(); ++i)
+        {
+            const Point& a = ring[i-1];
+            const Point& b = ring[i];
+            if (next.size() + (ring.size() - i) + 3 <= vertex_count)
+            {
+                const Point d = vector_sub(b, a);
+                const double sign = (rng() & 1) ? 1.0 : -1.0;
+                const double h = sign * sqrt(0.75) / 3.0;
+                next.push_back(Point(a.X + d.X / 3.0, a.Y + d.Y / 3.0));
+                next.push_back(Point(a.X + d.X / 2.0 - d.Y * h,
+                                     a.Y + d.Y / 2.0 + d.X * h));
+                next.push_back(Point(a.X + d.X * 2.0 / 3.0,
+                                     a.Y + d.Y * 2.0 / 3.0));
+            }
+            next.push_back(b);
+        }
+        if (next.size() == ring.size())
+        {
+            break;
+        }
+        ring.swap(next);
+    }
+    res->swap(ring);
+}
+
+// Gaussian steps: no structure for the simplification to exploit.
+static void make_random_walk(size_t vertex_count, Linestring* res)
+{
+    std::mt19937 rng(2);
+    std::normal_distribution<double> step(0.0, 1.0);
+    res->resize(vertex_count);
+    Point p(0.0, 0.0);
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        (*res)[i] = p;
+        p.X += step(rng);
+        p.Y += step(rng);
+    }
+}
+
+// Vehicle track sampled at a fixed rate: a slowly turning heading, small
+// position noise and stops repeating the same fix.
+static void make_gps_track(size_t vertex_count, Linestring* res)
+{
+    std::mt19937 rng(3);
+    std::normal_distribution<double> turn(0.0, 0.02);
+    std::normal_distribution<double> noise(0.0, 0.05);
+    std::uniform_int_distribution<int> event(0, 999);
+    res->resize(vertex_count);
+    double x = 0.0;
+    double y = 0.0;
+    double heading = 0.0;
+    size_t stopped = 0;
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        if (stopped > 0)
+        {
+            --stopped;
+        }
+        else
+        {
+            if (event(rng) == 0)
+            {
+                stopped = 30;
+            }
+            heading += turn(rng);
+            x += cos(heading);
+            y += sin(heading);
+        }
+        (*res)[i] = Point(x + noise(rng), y + noise(rng));
+    }
+}
+
+// Small closed rings, as in building footprints or parcels.
+static void make_tiny_rings(size_t vertex_count, std::vector<Linestring>* res)
+{
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> jitter(-0.1, 0.1);
+    const size_t ring_size = 7;
+    res->resize(std::max<size_t>(vertex_count / ring_size, 1));
+    for (size_t i = 0; i < res->size(); ++i)
+    {
+        Linestring& ring = (*res)[i];
+        ring.resize(ring_size);
+        const double cx = static_cast<double>(i % 1000) * 3.0;
+        const double cy = static_cast<double>(i / 1000) * 3.0;
+        for (size_t j = 0; j + 1 < ring_size; ++j)
+        {
+            const double angle = 2.0 * M_PI * j / (ring_size - 1);
+            ring[j] = Point(cx + cos(angle) + jitter(rng),
+                            cy + sin(angle) + jitter(rng));
+        }
+        ring[ring_size - 1] = ring[0];
+    }
+}
+
+static void make_input(const std::string& name, size_t vertex_count,
+                       BenchInput* res)
+{
+    res->name = name;
+    res->lines.clear();
+    if (name == "tiny-rings")
+    {
+        make_tiny_rings(vertex_count, &res->lines);
+    }
+    else
+    {
+        res->lines.resize(1);
+        if (name == "koch")
+        {
+            make_koch_coastline(vertex_count, &res->lines[0]);
+        }
+        else if (name == "random-walk")
+        {
+            make_random_walk(vertex_count, &res->lines[0]);
+        }
+        else
+        {
+            make_gps_track(vertex_count, &res->lines[0]);
+        }
+    }
+    res->vertex_count = 0;
+    for (size_t i = 0; i < res->lines.size(); ++i)
+    {
+        res->vertex_count += res->lines[i].size();
+    }
+}
+
+// Area threshold keeping about a tenth of the interior vertices.
+static double pick_threshold(const BenchInput& input)
+{
+    std::vector<double> candidate_areas;
+    SimplifyWorkspace workspace;
+    for (size_t i = 0; i < input.lines.size(); ++i)
+    {
+        workspace.compute_effective_areas(input.lines[i]);
+        Visvalingam_Algorithm::append_candidate_areas(
+                workspace.effective_areas(), &candidate_areas);
+    }
+    return select_area_cutoff(&candidate_areas,
+                              candidate_areas.size() / 10).area;
+}
+
+static size_t peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss);
+}
+
+// Runs 'stage' until about 'min_vertices' vertices went through it (at least
+// twice) and prints its best time. 'stage' must not keep state between runs.
+static void measure(const BenchInput& input, const char* stage_name,
+                    size_t min_vertices, const std::function<void()>& stage)
+{
+    const size_t repeat_count = std::max<size_t>(
+            2, min_vertices / std::max<size_t>(input.vertex_count, 1));
+    double best_ns = std::numeric_limits<double>::max();
+    size_t allocation_count = 0;
+    for (size_t i = 0; i < repeat_count; ++i)
+    {
+        const size_t allocations_before = g_allocation_count;
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        stage();
+        const std::chrono::steady_clock::time_point end =
+            std::chrono::steady_clock::now();
+        allocation_count = g_allocation_count - allocations_before;
+        best_ns = std::min<double>(best_ns,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    end - start).count());
+    }
+    printf("%-12s %10zu  %-18s %10.2f %12zu %12zu\n",
+           input.name.c_str(), input.vertex_count, stage_name,
+           best_ns / input.vertex_count, allocation_count, peak_rss_kb());
+    fflush(stdout);
+}
+
+// Binary heap comparing vertices through their area in a separate array,
+// as the elimination loop did before KeyedHeap. Kept as a baseline.
+struct IndirectAreaCompare
+{
+    explicit IndirectAreaCompare(const std::vector<double>* areas)
+        : m_areas(areas)
+    {
+    }
+
+    bool operator()(NodeIndex lhs, NodeIndex rhs) const
+    {
+        const double lhs_area = (*m_areas)[lhs];
+        const double rhs_area = (*m_areas)[rhs];
+        if (lhs_area != rhs_area)
+        {
+            return lhs_area < rhs_area;
+        }
+        return lhs < rhs;
+    }
+
+    const std::vector<double>* m_areas;
+};
+
+// The heaps under comparison behind one interface.
+struct IndirectHeapAdapter
+{
+    IndirectHeapAdapter() : areas(), heap(0, IndirectAreaCompare(&areas)) {}
+
+    void reset(size_t size)
+    {
+        areas.resize(size);
+        heap.reset(size);
+    }
+
+    void insert(NodeIndex node, double area)
+    {
+        areas[node] = area;
+        heap.insert(node);
+    }
+
+    void update(NodeIndex node, double area)
+    {
+        areas[node] = area;
+        heap.reheap(node);
+    }
+
+    std::vector<double> areas;
+    Heap<NodeIndex, IndirectAreaCompare,
+         DenseHeapIndex<NodeIndex, NodeIndex> > heap;
+};
+
+template <size_t Arity>
+struct KeyedHeapAdapter
+{
+    KeyedHeapAdapter() : heap(0) {}
+
+    void reset(size_t size)
+    {
+        heap.reset(size);
+    }
+
+    void insert(NodeIndex node, double area)
+    {
+        heap.insert(node, area);
+    }
+
+    void update(NodeIndex node, double area)
+    {
+        heap.update(node, area);
+    }
+
+    KeyedHeap<double, NodeIndex, Arity> heap;
+};
+
+struct RadixHeapAdapter
+{
+    RadixHeapAdapter() : heap(0) {}
+
+    void reset(size_t size)
+    {
+        heap.reset(size);
+    }
+
+    void insert(NodeIndex node, double area)
+    {
+        heap.insert(node, area);
+    }
+
+    void update(NodeIndex node, double area)
+    {
+        heap.update(node, area);
+    }
+
+    RadixHeap<NodeIndex> heap;
+};
+
+// Runs the elimination loop's heap traffic over each line: every interior
+// vertex goes in with its triangle area, then comes out smallest first
+// while its two neighbours are updated with their new triangle's area.
+template <typename HeapAdapter>
+static void measure_heap(const BenchInput& input, const char* stage_name,
+                         size_t min_vertices, HeapAdapter* heap)
+{
+    std::vector<NodeIndex> prev_vertex;
+    std::vector<NodeIndex> next_vertex;
+    const std::vector<Linestring>& lines = input.lines;
+    measure(input, stage_name, min_vertices,
+            [heap, &prev_vertex, &next_vertex, &lines]()
+    {
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            const Linestring& line = lines[i];
+            const NodeIndex count = static_cast<NodeIndex>(line.size());
+            heap->reset(count);
+            prev_vertex.resize(count);
+            next_vertex.resize(count);
+            for (NodeIndex j = 1; j + 1 < count; ++j)
+            {
+                prev_vertex[j] = j - 1;
+                next_vertex[j] = j + 1;
+                heap->insert(j, effective_area(j, j - 1, j + 1, line));
+            }
+            while (!heap->heap.empty())
+            {
+                const NodeIndex curr = heap->heap.pop();
+                const NodeIndex prev = prev_vertex[curr];
+                const NodeIndex next = next_vertex[curr];
+                if (heap->heap.contains(prev))
+                {
+                    next_vertex[prev] = next;
+                    heap->update(prev, effective_area(prev, prev_vertex[prev],
+                                                      next, line));
+                }
+                if (heap->heap.contains(next))
+                {
+                    prev_vertex[next] = prev;
+                    heap->update(next, effective_area(next, prev,
+                                                      next_vertex[next],
+                                                      line));
+                }
+            }
+        }
+    });
+}
+
+static void run_benchmarks(const BenchInput& input, size_t min_vertices)
+{
+    const double threshold = pick_threshold(input);
+    const std::vector<Linestring>& lines = input.lines;
+
+    measure(input, "areas", min_vertices, [&lines]()
+    {
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            Visvalingam_Algorithm vis_algo(lines[i]);
+        }
+    });
+    SimplifyOptions radix_options;
+    radix_options.queue = VERTEX_QUEUE_RADIX;
+    measure(input, "areas-radix", min_vertices, [&lines, &radix_options]()
+    {
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            Visvalingam_Algorithm vis_algo(lines[i], radix_options);
+        }
+    });
+
+    // one line at a time over every core: lines shorter than two chunks
+    // run as one, see compute_chunked_effective_areas()
+    ThreadPool pool(std::thread::hardware_concurrency());
+    std::vector<SimplifyWorkspace> workspaces(pool.size());
+    measure(input, "areas-chunked", min_vertices,
+            [&lines, &pool, &workspaces]()
+    {
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            Visvalingam_Algorithm vis_algo(lines[i], &pool, &workspaces);
+        }
+    });
+
+    std::vector<Visvalingam_Algorithm*> algos(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        algos[i] = new Visvalingam_Algorithm(lines[i]);
+    }
+    measure(input, "simplify", min_vertices, [&algos, threshold]()
+    {
+        for (size_t i = 0; i < algos.size(); ++i)
+        {
+            Linestring res;
+            algos[i]->simplify(threshold, &res);
+        }
+    });
+    for (size_t i = 0; i < algos.size(); ++i)
+    {
+        delete algos[i];
+    }
+    algos.clear();
+
+    SimplifyWorkspace workspace;
+    Linestring workspace_res;
+    measure(input, "workspace-simplify", min_vertices,
+            [&lines, &workspace, &workspace_res, threshold]()
+    {
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            workspace_res.clear();
+            Visvalingam_Algorithm::simplify(lines[i], threshold,
+                                            &workspace_res, &workspace);
+        }
+    });
+
+    // the heap alone, under the elimination loop's traffic
+    IndirectHeapAdapter indirect_heap;
+    measure_heap(input, "heap-binary-indirect", min_vertices, &indirect_heap);
+    KeyedHeapAdapter<2> binary_heap;
+    measure_heap(input, "heap-keyed-2", min_vertices, &binary_heap);
+    KeyedHeapAdapter<4> quaternary_heap;
+    measure_heap(input, "heap-keyed-4", min_vertices, &quaternary_heap);
+    KeyedHeapAdapter<8> octonary_heap;
+    measure_heap(input, "heap-keyed-8", min_vertices, &octonary_heap);
+    RadixHeapAdapter radix_heap;
+    measure_heap(input, "heap-radix", min_vertices, &radix_heap);
+
+    // OGR conversions, each line as a polygon exterior ring
+    MultiPolygon shape(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        shape[i].exterior_ring = lines[i];
+    }
+    measure(input, "to-ogr", min_vertices, [&shape]()
+    {
+        OGRMultiPolygon ogr_shape;
+        to_ogr_shape(shape, &ogr_shape);
+    });
+    OGRMultiPolygon ogr_shape;
+    to_ogr_shape(shape, &ogr_shape);
+    measure(input, "from-ogr", min_vertices, [&ogr_shape]()
+    {
+        MultiPolygon res;
+        from_ogr_shape(ogr_shape, &res);
+    });
+}
+
+int main(int argc, char **argv)
+{
+    // 1e8 vertices take several GB per input: opt in with --max-vertices.
+    size_t max_vertices = 1000000;
+    size_t min_vertices = 10000000;
+    const char* only_input = NULL;
+    for (int i=1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--max-vertices") == 0 && (i+1) < argc)
+        {
+            ++i;
+            max_vertices = static_cast<size_t>(atof(argv[i]));
+        }
+        else if (strcmp(argv[i], "--min-vertices") == 0 && (i+1) < argc)
+        {
+            // vertices to run through each stage before keeping its timing
+            ++i;
+            min_vertices = static_cast<size_t>(atof(argv[i]));
+        }
+        else if (strcmp(argv[i], "--input") == 0 && (i+1) < argc)
+        {
+            ++i;
+            only_input = argv[i];
+        }
+    }
+
+    const char* input_names[] = {"koch", "random-walk", "gps", "tiny-rings"};
+    printf("%-12s %10s  %-18s %10s %12s %12s\n", "input", "vertices", "stage",
+           "ns/vertex", "allocations", "peak_rss_kb");
+    for (size_t i = 0; i < sizeof(input_names)/sizeof(input_names[0]); ++i)
+    {
+        if (only_input && strcmp(only_input, input_names[i]) != 0)
+        {
+            continue;
+        }
+        for (size_t vertex_count = 100; vertex_count <= max_vertices;
+             vertex_count *= 10)
+        {
+            BenchInput input;
+            make_input(input_names[i], vertex_count, &input);
+            run_benchmarks(input, min_vertices);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cassert>
+
+// FIFO handing items from producer to consumer threads. push() blocks while
+// 'capacity' items are waiting, so a fast producer is held back to the pace
+// of its consumers instead of piling items up in memory.
+//
+// Once the producer calls close(), pop() drains what is left and then
+// returns false. A consumer that gives up calls cancel() instead: push()
+// then returns false, without queueing, so that the producer stops, and
+// pop() still drains what is left, for its owner to free.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_items()
+        , m_capacity(capacity)
+        , m_closed(false)
+        , m_cancelled(false)
+        , m_mutex()
+        , m_not_full()
+        , m_not_empty()
+    {
+        assert(capacity > 0);
+    }
+
+    // Returns false, leaving 'item' to the caller, once cancelled.
+    bool push(const T& item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            assert(!m_closed);
+            while (m_items.size() >= m_capacity && !m_cancelled)
+            {
+                m_not_full.wait(lock);
+            }
+            if (m_cancelled)
+            {
+                return false;
+            }
+            m_items.push_back(item);
+        }
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and empty.
+    bool pop(T* item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_items.empty() && !m_closed && !m_cancelled)
+            {
+                m_not_empty.wait(lock);
+            }
+            if (m_items.empty())
+            {
+                return false;
+            }
+            *item = m_items.front();
+            m_items.pop_front();
+        }
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_empty.notify_all();
+    }
+
+    void cancel()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cancelled = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+    bool cancelled() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_cancelled;
+    }
+
+private:
+    BoundedQueue(const BoundedQueue& other);
+    BoundedQueue& operator=(const BoundedQueue& other);
+
+    std::deque<T> m_items;
+    const size_t m_capacity;
+    bool m_closed;
+    bool m_cancelled;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+};
+
+#endif // BOUNDED_QUEUE_HPP
@@ -0,0 +1,482 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "chunked_areas.h"
+#include <cassert>
+#include <limits>
+#include <algorithm>
+#include "coordinate_view.hpp"
+#include "thread_pool.h"
+
+// A vertex's neighbour on one side, from one time to another: times being
+// effective areas, as the elimination loop takes vertices in their order.
+struct Neighbour
+{
+    NodeIndex vertex;
+    double from;
+    double to;
+    // area it was eliminated with, at 'to'; -max if it was not then
+    double key;
+    // still between the vertex and its seam neighbour, in a gap
+    bool in_gap;
+};
+
+static const double NO_KEY = -std::numeric_limits<double>::max();
+
+// Largest area of a gap still being eliminated at 'area', 0 once it is done.
+static double pending_area(double gap_area, double area)
+{
+    return gap_area > area ? gap_area : 0.0;
+}
+
+// A line once each chunk went through its own elimination loop, with its
+// ends pinned. The seam pass runs the loop again over the chunk boundaries
+// and the vertices they were ever neighbours of: in between, each gap is
+// left to its chunk and stands in as its largest effective area, which has
+// to go before the vertices on either side.
+//
+// That only holds while these would not have gone first. Where the seam
+// pass finds one that would, the gap is split into the vertices its own
+// ends were ever neighbours of, and the pass runs again.
+class ChunkedLine
+{
+public:
+    ChunkedLine(const InterleavedView<double>& input,
+                const std::vector<NodeIndex>& chunk_firsts,
+                const std::vector<ChunkState>& chunks)
+        : m_input(input)
+        , m_chunk_firsts(chunk_firsts)
+        , m_chunks(chunks)
+        , m_vertices(1, 0)
+        , m_gap_areas()
+        , m_conflicts()
+    {
+        for (size_t i = 0; i + 1 < chunk_firsts.size(); ++i)
+        {
+            split_gap(chunk_firsts[i], chunk_firsts[i+1], &m_vertices,
+                      &m_gap_areas);
+            m_vertices.push_back(chunk_firsts[i+1]);
+        }
+    }
+
+    // Runs seam passes until one holds, storing the seam vertices'
+    // effective areas into 'areas'.
+    void eliminate(double* areas)
+    {
+        std::vector<NodeIndex> vertices;
+        std::vector<double> gap_areas;
+        while (!eliminate_seams(areas))
+        {
+            vertices.assign(1, 0);
+            gap_areas.clear();
+            for (size_t i = 0; i + 1 < m_vertices.size(); ++i)
+            {
+                if (m_conflicts[i])
+                {
+                    split_gap(m_vertices[i], m_vertices[i+1], &vertices,
+                              &gap_areas);
+                }
+                else
+                {
+                    gap_areas.push_back(m_gap_areas[i]);
+                }
+                vertices.push_back(m_vertices[i+1]);
+            }
+            m_vertices.swap(vertices);
+            m_gap_areas.swap(gap_areas);
+        }
+    }
+
+private:
+    ChunkedLine(const ChunkedLine& other);
+    ChunkedLine& operator=(const ChunkedLine& other);
+
+    // chunk holding the vertices right after 'v'
+    size_t chunk_after(NodeIndex v) const
+    {
+        return std::upper_bound(m_chunk_firsts.begin(), m_chunk_firsts.end(),
+                                v) - m_chunk_firsts.begin() - 1;
+    }
+
+    void split_gap(NodeIndex first, NodeIndex last,
+                   std::vector<NodeIndex>* vertices,
+                   std::vector<double>* gap_areas) const;
+    void side_neighbours(NodeIndex v, NodeIndex seam_neighbour,
+                         bool gap_pending, double since, double until,
+                         double until_key,
+                         std::vector<Neighbour>* res) const;
+    bool eliminate_seams(double* areas);
+
+    const InterleavedView<double>& m_input;
+    const std::vector<NodeIndex>& m_chunk_firsts;
+    const std::vector<ChunkState>& m_chunks;
+    std::vector<NodeIndex> m_vertices;
+    // m_gap_areas[i]: largest effective area between m_vertices[i] and the
+    // next, 0 if none
+    std::vector<double> m_gap_areas;
+    // set where the last seam pass did not hold
+    std::vector<char> m_conflicts;
+};
+
+// Appends to 'vertices' those between 'first' and 'last' that were ever
+// neighbours of either in their chunk, in order, and to 'gap_areas' the
+// largest effective area before each of them and after the last.
+void ChunkedLine::split_gap(NodeIndex first, NodeIndex last,
+                            std::vector<NodeIndex>* vertices,
+                            std::vector<double>* gap_areas) const
+{
+    const size_t chunk = chunk_after(first);
+    const NodeIndex offset = m_chunk_firsts[chunk];
+    const double* areas = m_chunks[chunk].areas;
+    const NodeIndex* prev_vertex = m_chunks[chunk].prev_vertices;
+    const NodeIndex* next_vertex = m_chunks[chunk].next_vertices;
+    first -= offset;
+    last -= offset;
+    // up to the first neighbour never eliminated: only a vertex that starts
+    // degenerate has an area of 0
+    const size_t begin = vertices->size();
+    for (NodeIndex v = first + 1; v < last; v = next_vertex[v])
+    {
+        vertices->push_back(v);
+        if (areas[v] == 0.0)
+        {
+            break;
+        }
+    }
+    for (NodeIndex v = last - 1; v > first; v = prev_vertex[v])
+    {
+        vertices->push_back(v);
+        if (areas[v] == 0.0)
+        {
+            break;
+        }
+    }
+    std::sort(vertices->begin() + begin, vertices->end());
+    vertices->erase(std::unique(vertices->begin() + begin, vertices->end()),
+                    vertices->end());
+
+    size_t next = begin;
+    double gap_area = 0.0;
+    for (NodeIndex v = first + 1; v < last; ++v)
+    {
+        if (next < vertices->size() && (*vertices)[next] == v)
+        {
+            gap_areas->push_back(gap_area);
+            gap_area = 0.0;
+            (*vertices)[next++] += offset;
+            continue;
+        }
+        gap_area = std::max(gap_area, areas[v]);
+    }
+    gap_areas->push_back(gap_area);
+}
+
+// Neighbours vertex 'v' has on the side of 'seam_neighbour' from 'since'
+// until 'until', when a vertex went with 'until_key' or NO_KEY. While the
+// gap in between is pending, those are first the gap's vertices it had in
+// their chunk, each until its effective area.
+void ChunkedLine::side_neighbours(NodeIndex v, NodeIndex seam_neighbour,
+                                  bool gap_pending, double since,
+                                  double until, double until_key,
+                                  std::vector<Neighbour>* res) const
+{
+    res->clear();
+    double from = since;
+    if (gap_pending)
+    {
+        const bool left = seam_neighbour < v;
+        const size_t chunk = chunk_after(left ? seam_neighbour : v);
+        const NodeIndex offset = m_chunk_firsts[chunk];
+        const double* areas = m_chunks[chunk].areas;
+        const NodeIndex* prev_vertex = m_chunks[chunk].prev_vertices;
+        const NodeIndex* next_vertex = m_chunks[chunk].next_vertices;
+        // each neighbour, once eliminated, hands over to its own
+        NodeIndex u = left ? v - 1 : v + 1;
+        while ((left ? u > seam_neighbour : u < seam_neighbour)
+               && from <= until)
+        {
+            const NodeIndex local = u - offset;
+            const double to = areas[local];
+            if (to >= from)
+            {
+                Neighbour neighbour = { u, from, to, NO_KEY, true };
+                if (to <= until)
+                {
+                    neighbour.key = effective_area(
+                            u, prev_vertex[local] + offset,
+                            next_vertex[local] + offset, m_input);
+                }
+                else
+                {
+                    neighbour.to = until;
+                }
+                res->push_back(neighbour);
+                from = to;
+            }
+            u = (left ? prev_vertex[local] : next_vertex[local]) + offset;
+        }
+    }
+    if (from <= until)
+    {
+        const Neighbour neighbour = { seam_neighbour, from, until, until_key,
+                                      false };
+        res->push_back(neighbour);
+    }
+}
+
+// Same loop as SimplifyWorkspace::eliminate(), over the seam vertices only,
+// each with an area of at least that of the gaps still pending on either
+// side. Returns whether no vertex would have gone while one of those was,
+// flagging such gaps in m_conflicts otherwise.
+bool ChunkedLine::eliminate_seams(double* areas)
+{
+    const std::vector<NodeIndex>& vertices = m_vertices;
+    std::vector<double> gap_areas = m_gap_areas;
+    const NodeIndex count = static_cast<NodeIndex>(vertices.size());
+    std::vector<NodeIndex> prev_vertex(count);
+    std::vector<NodeIndex> next_vertex(count);
+    std::vector<double> triangle_areas(count, 0.0);
+    // when each vertex got its current seam neighbours
+    std::vector<double> since(count, -std::numeric_limits<double>::max());
+    std::vector<double> seam_areas(count, 0.0);
+    m_conflicts.assign(count - 1, 0);
+    bool holds = true;
+    VertexHeap min_heap(count);
+    for (NodeIndex i=1; i+1 < count; ++i)
+    {
+        prev_vertex[i] = i-1;
+        next_vertex[i] = i+1;
+        const NodeIndex v = vertices[i];
+        if (effective_area(v, v-1, v+1, m_input) > NEARLY_ZERO)
+        {
+            triangle_areas[i] = effective_area(v, vertices[i-1],
+                                               vertices[i+1], m_input);
+            seam_areas[i] = std::max(triangle_areas[i],
+                                     std::max(gap_areas[i-1], gap_areas[i]));
+            min_heap.push_unordered(i, seam_areas[i]);
+        }
+        else
+        {
+            areas[v] = 0.0;
+        }
+    }
+    min_heap.heapify();
+
+    // Whether vertex i, from since[i] until 'until', would have gone with a
+    // gap next to it still pending: as soon as its area with the neighbours
+    // it then had is below the level elimination rose to before one of them
+    // went or, if it did not rise, the area that one went with.
+    std::vector<Neighbour> left;
+    std::vector<Neighbour> right;
+    auto check_gaps = [&](NodeIndex i, double until, double until_key)
+    {
+        const NodeIndex prev = prev_vertex[i];
+        const NodeIndex next = next_vertex[i];
+        const NodeIndex v = vertices[i];
+        const bool left_pending = vertices[prev] + 1 < v
+            && gap_areas[prev] >= since[i];
+        const bool right_pending = v + 1 < vertices[next]
+            && gap_areas[i] >= since[i];
+        if (!left_pending && !right_pending)
+        {
+            return;
+        }
+        side_neighbours(v, vertices[prev], left_pending, since[i], until,
+                        until_key, &left);
+        side_neighbours(v, vertices[next], right_pending, since[i], until,
+                        until_key, &right);
+        for (size_t l = 0; l < left.size(); ++l)
+        {
+            for (size_t r = 0; r < right.size(); ++r)
+            {
+                if (!left[l].in_gap && !right[r].in_gap)
+                {
+                    continue;
+                }
+                const double from = std::max(left[l].from, right[r].from);
+                const double to = std::min(left[l].to, right[r].to);
+                if (from > to)
+                {
+                    continue;
+                }
+                double level = to;
+                if (from == to)
+                {
+                    level = NO_KEY;
+                    if (left[l].to == to && left[l].key != NO_KEY)
+                    {
+                        level = left[l].key;
+                    }
+                    if (right[r].to == to && right[r].key != NO_KEY)
+                    {
+                        level = level == NO_KEY
+                            ? right[r].key : std::min(level, right[r].key);
+                    }
+                }
+                if (effective_area(v, left[l].vertex, right[r].vertex,
+                                   m_input) <= level)
+                {
+                    m_conflicts[prev] |= left[l].in_gap;
+                    m_conflicts[i] |= right[r].in_gap;
+                    holds = false;
+                }
+            }
+        }
+    };
+
+    double min_area = -std::numeric_limits<double>::max();
+    while (!min_heap.empty())
+    {
+        const NodeIndex curr = min_heap.top();
+        min_area = std::max(min_area, seam_areas[curr]);
+        const NodeIndex prev = prev_vertex[curr];
+        const NodeIndex next = next_vertex[curr];
+        if (seam_areas[curr] > triangle_areas[curr])
+        {
+            // a gap next to it is done first: from then on, its ends go by
+            // their own areas
+            const NodeIndex ends[] = { prev, curr, next };
+            for (size_t j = 0; j < 3; ++j)
+            {
+                if (min_heap.contains(ends[j]))
+                {
+                    check_gaps(ends[j], min_area, NO_KEY);
+                }
+            }
+            for (size_t j = 0; j < 2; ++j)
+            {
+                if (gap_areas[ends[j]] <= min_area)
+                {
+                    gap_areas[ends[j]] = 0.0;
+                }
+            }
+            for (size_t j = 0; j < 3; ++j)
+            {
+                const NodeIndex end = ends[j];
+                if (min_heap.contains(end))
+                {
+                    since[end] = min_area;
+                    seam_areas[end] = std::max(
+                            triangle_areas[end],
+                            std::max(pending_area(gap_areas[prev_vertex[end]],
+                                                  min_area),
+                                     pending_area(gap_areas[end], min_area)));
+                    min_heap.update(end, seam_areas[end]);
+                }
+            }
+            continue;
+        }
+        min_heap.pop();
+        check_gaps(curr, std::numeric_limits<double>::infinity(), NO_KEY);
+
+        // nothing left between prev and next
+        gap_areas[prev] = 0.0;
+        if (min_heap.contains(prev))
+        {
+            check_gaps(prev, min_area, triangle_areas[curr]);
+            since[prev] = min_area;
+            next_vertex[prev] = next;
+            triangle_areas[prev] = effective_area(
+                    vertices[prev], vertices[prev_vertex[prev]],
+                    vertices[next], m_input);
+            seam_areas[prev] = std::max(
+                    triangle_areas[prev],
+                    pending_area(gap_areas[prev_vertex[prev]], min_area));
+            min_heap.update(prev, seam_areas[prev]);
+        }
+        if (min_heap.contains(next))
+        {
+            check_gaps(next, min_area, triangle_areas[curr]);
+            since[next] = min_area;
+            prev_vertex[next] = prev;
+            triangle_areas[next] = effective_area(
+                    vertices[next], vertices[prev],
+                    vertices[next_vertex[next]], m_input);
+            seam_areas[next] = std::max(
+                    triangle_areas[next],
+                    pending_area(gap_areas[next], min_area));
+            min_heap.update(next, seam_areas[next]);
+        }
+        areas[vertices[curr]] = min_area;
+    }
+    return holds;
+}
+
+void eliminate_chunk_seams(const InterleavedView<double>& input,
+                           const std::vector<NodeIndex>& chunk_firsts,
+                           const std::vector<ChunkState>& chunks,
+                           double* areas)
+{
+    assert(chunks.size() + 1 == chunk_firsts.size());
+    ChunkedLine chunked_line(input, chunk_firsts, chunks);
+    chunked_line.eliminate(areas);
+}
+
+void compute_chunked_effective_areas(
+        const Linestring& input, ThreadPool* pool,
+        std::vector<SimplifyWorkspace>* workspaces,
+        const SimplifyOptions& options, EffectiveAreas* res)
+{
+    assert(options.collinear_tolerance < 0);
+    assert(!options.prevent_intersections);
+    assert(workspaces->size() >= pool->size());
+    SimplifyOptions chunk_options = options;
+    chunk_options.max_area_threshold =
+        std::numeric_limits<double>::infinity();
+
+    const size_t vertex_count = input.size();
+    const size_t chunk_count = std::min(pool->size(),
+                                        vertex_count / MIN_CHUNK_VERTEX_COUNT);
+    res->source_indices.clear();
+    if (chunk_count < 2)
+    {
+        SimplifyWorkspace& workspace = (*workspaces)[0];
+        workspace.compute_effective_areas(input, chunk_options);
+        res->areas = workspace.effective_areas().areas;
+        return;
+    }
+
+    res->areas.assign(vertex_count, 0.0);
+    std::vector<NodeIndex> chunk_firsts(chunk_count + 1);
+    for (size_t i = 0; i <= chunk_count; ++i)
+    {
+        chunk_firsts[i] = static_cast<NodeIndex>(
+                (vertex_count - 1) * i / chunk_count);
+    }
+    // each chunk keeps its own workspace, for the seam pass to read
+    const Linestring* line = &input;
+    const SimplifyOptions* line_options = &chunk_options;
+    const std::vector<NodeIndex>* firsts = &chunk_firsts;
+    std::vector<double>* areas = &res->areas;
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        pool->submit([line, line_options, workspaces, firsts, areas,
+                      i](size_t)
+        {
+            const NodeIndex first = (*firsts)[i];
+            const NodeIndex count = (*firsts)[i+1] - first + 1;
+            assert(count > SMALL_RING_SIZE);
+            SimplifyWorkspace& workspace = (*workspaces)[i];
+            workspace.compute_effective_areas(
+                    InterleavedView<double>(&(*line)[first].X, count),
+                    *line_options);
+            const std::vector<double>& chunk_areas =
+                workspace.effective_areas().areas;
+            std::copy(chunk_areas.begin() + 1, chunk_areas.end() - 1,
+                      areas->begin() + first + 1);
+        });
+    }
+    pool->wait();
+
+    std::vector<ChunkState> chunks(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        const SimplifyWorkspace& workspace = (*workspaces)[i];
+        chunks[i].areas = &workspace.effective_areas().areas[0];
+        chunks[i].prev_vertices = &workspace.prev_vertices()[0];
+        chunks[i].next_vertices = &workspace.next_vertices()[0];
+    }
+    eliminate_chunk_seams(InterleavedView<double>(&input[0].X, vertex_count),
+                          chunk_firsts, chunks, &res->areas[0]);
+}
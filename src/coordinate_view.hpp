@@ -0,0 +1,87 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef COORDINATE_VIEW_HPP
+#define COORDINATE_VIEW_HPP
+
+#include <cstddef>
+#include "geo_types.h"
+
+// Read-only views over coordinates held in caller-owned buffers. They model
+// the same point sequence interface as Linestring (size() and operator[])
+// so the simplification templates accept either without copying.
+//
+// Strides are counted in elements of T, e.g.: 2 for packed XY, 3 for XYZ.
+// T is typically double or float; points are widened to double on read.
+
+// X and Y next to each other: x0 y0 [..] x1 y1 [..] ...
+template <typename T>
+class InterleavedView
+{
+public:
+    InterleavedView(const T* xy, size_t size, size_t stride = 2)
+        : m_xy(xy)
+        , m_size(size)
+        , m_stride(stride)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    Point operator[](size_t i) const
+    {
+        const T* p = m_xy + i * m_stride;
+        return Point(p[0], p[1]);
+    }
+
+    const T* data() const
+    {
+        return m_xy;
+    }
+
+    size_t stride() const
+    {
+        return m_stride;
+    }
+
+private:
+    const T* m_xy;
+    size_t m_size;
+    size_t m_stride;
+};
+
+// X and Y in two separate arrays sharing the same stride.
+template <typename T>
+class SeparateView
+{
+public:
+    SeparateView(const T* x, const T* y, size_t size, size_t stride = 1)
+        : m_x(x)
+        , m_y(y)
+        , m_size(size)
+        , m_stride(stride)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    Point operator[](size_t i) const
+    {
+        return Point(m_x[i * m_stride], m_y[i * m_stride]);
+    }
+
+private:
+    const T* m_x;
+    const T* m_y;
+    size_t m_size;
+    size_t m_stride;
+};
+
+#endif // COORDINATE_VIEW_HPP
@@ -0,0 +1,157 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "feature_writer.h"
+#include <cassert>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+#include <gdal_priv.h>
+#include <ogrsf_frmts.h>
+
+// Short names accepted on the command line, mapped to OGR driver names.
+static const char* driver_name(const char* format)
+{
+    if (strcmp(format, "Shapefile") == 0)
+    {
+        return "ESRI Shapefile";
+    }
+    return format;
+}
+
+// Simplified polygons come out as multipolygons whenever they are left with
+// zero or several parts, and Shapefile layers declare polygons while
+// holding multipolygons: polygon layers are written as 2D multipolygon
+// ones, which FlatGeobuf and GPKG check each feature against.
+static OGRwkbGeometryType output_geometry_type(OGRwkbGeometryType source_type)
+{
+    const OGRwkbGeometryType flat_type = wkbFlatten(source_type);
+    if (flat_type == wkbPolygon || flat_type == wkbMultiPolygon)
+    {
+        return wkbMultiPolygon;
+    }
+    return source_type;
+}
+
+FeatureWriter::FeatureWriter()
+    : m_dataset(NULL)
+    , m_layers()
+    , m_in_transaction(false)
+{
+}
+
+FeatureWriter::~FeatureWriter()
+{
+    close();
+}
+
+bool FeatureWriter::open(const char* path, const char* format)
+{
+    assert(m_dataset == NULL);
+    GDALAllRegister();
+    GDALDriver* driver =
+        GetGDALDriverManager()->GetDriverByName(driver_name(format));
+    if (driver == NULL)
+    {
+        std::cerr << "Unknown output format: " << format << std::endl;
+        return false;
+    }
+    m_dataset = driver->Create(path, 0, 0, 0, GDT_Unknown, NULL);
+    if (m_dataset == NULL)
+    {
+        std::cerr << "Cannot create output: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FeatureWriter::begin_layer(OGRLayer* source_layer, size_t level_count)
+{
+    assert(m_dataset);
+    OGRFeatureDefn* source_defn = source_layer->GetLayerDefn();
+    m_layers.assign(level_count, NULL);
+    for (size_t level = 0; level < level_count; ++level)
+    {
+        std::ostringstream name;
+        name << source_layer->GetName();
+        if (level_count > 1)
+        {
+            name << "_" << level;
+        }
+        OGRLayer* layer = m_dataset->CreateLayer(
+                name.str().c_str(), source_layer->GetSpatialRef(),
+                output_geometry_type(source_layer->GetGeomType()), NULL);
+        if (layer == NULL)
+        {
+            std::cerr << "Cannot create output layer: " << name.str()
+                      << std::endl;
+            return false;
+        }
+        for (int i = 0; i < source_defn->GetFieldCount(); ++i)
+        {
+            if (layer->CreateField(source_defn->GetFieldDefn(i)) != OGRERR_NONE)
+            {
+                std::cerr << "Cannot create field: "
+                          << source_defn->GetFieldDefn(i)->GetNameRef()
+                          << std::endl;
+                return false;
+            }
+        }
+        m_layers[level] = layer;
+    }
+    return true;
+}
+
+void FeatureWriter::begin_batch()
+{
+    assert(!m_in_transaction);
+    m_in_transaction = m_dataset->StartTransaction() == OGRERR_NONE;
+}
+
+bool FeatureWriter::end_batch()
+{
+    if (!m_in_transaction)
+    {
+        return true;
+    }
+    m_in_transaction = false;
+    if (m_dataset->CommitTransaction() != OGRERR_NONE)
+    {
+        std::cerr << "Cannot commit output features" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FeatureWriter::write(OGRFeature* source, size_t level,
+                          OGRGeometry* geometry)
+{
+    assert(level < m_layers.size());
+    OGRLayer* layer = m_layers[level];
+    if (layer->GetGeomType() == wkbMultiPolygon)
+    {
+        geometry = OGRGeometryFactory::forceToMultiPolygon(geometry);
+    }
+    OGRFeature* feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+    feature->SetFrom(source, TRUE);
+    feature->SetGeometryDirectly(geometry);
+    const bool res = layer->CreateFeature(feature) == OGRERR_NONE;
+    OGRFeature::DestroyFeature(feature);
+    if (!res)
+    {
+        std::cerr << "Cannot write feature " << source->GetFID() << std::endl;
+    }
+    return res;
+}
+
+void FeatureWriter::close()
+{
+    if (m_dataset)
+    {
+        end_batch();
+        GDALClose(m_dataset);
+        m_dataset = NULL;
+        m_layers.clear();
+    }
+}
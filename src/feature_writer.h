@@ -0,0 +1,54 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef FEATURE_WRITER_H
+#define FEATURE_WRITER_H
+
+#include <string>
+#include <vector>
+
+class GDALDataset;
+class OGRLayer;
+class OGRFeature;
+class OGRGeometry;
+
+// Writes simplified features to a new OGR dataset: one output layer per
+// input layer and level of detail, with the input layer's fields. Errors
+// are reported on stderr and make the methods return false.
+class FeatureWriter
+{
+public:
+    FeatureWriter();
+    ~FeatureWriter();
+
+    // 'format' is GPKG, Shapefile, FlatGeobuf or GeoJSON, or any other
+    // OGR driver name.
+    bool open(const char* path, const char* format);
+
+    // Starts the output layers of 'source_layer', named after it, with a
+    // "_<level>" suffix when there are several levels. Polygon layers are
+    // created as multipolygon layers.
+    bool begin_layer(OGRLayer* source_layer, size_t level_count);
+
+    // Batches writes into one transaction where the driver supports them.
+    void begin_batch();
+    bool end_batch();
+
+    // Writes 'source''s attributes with 'geometry', which is taken over;
+    // polygons are promoted to multipolygons on multipolygon layers.
+    bool write(OGRFeature* source, size_t level, OGRGeometry* geometry);
+
+    // Flushes and closes the dataset; also done on destruction.
+    void close();
+
+private:
+    FeatureWriter(const FeatureWriter& other);
+    FeatureWriter& operator=(const FeatureWriter& other);
+
+    GDALDataset* m_dataset;
+    std::vector<OGRLayer*> m_layers;
+    bool m_in_transaction;
+};
+
+#endif // FEATURE_WRITER_H
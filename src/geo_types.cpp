@@ -13,16 +13,21 @@ void from_ogr_shape(const OGRPoint& ogr_shape, Point* res)
     res->Y = ogr_shape.getY();
 }
 
+// Point and OGRRawPoint are both a pair of doubles, which lets linestrings
+// move their coordinates in and out of OGR with a single bulk copy.
+static_assert(sizeof(Point) == sizeof(OGRRawPoint),
+              "Point must be layout compatible with OGRRawPoint");
+
 void from_ogr_shape(const OGRLineString& ogr_shape, Linestring* res)
 {
-    size_t num_points = ogr_shape.getNumPoints();
-    for (size_t i = 0; i < num_points; ++i)
+    const size_t num_points = ogr_shape.getNumPoints();
+    if (num_points == 0)
     {
-        OGRPoint ogr_point;
-        ogr_shape.getPoint(i, &ogr_point);
-        res->push_back(Point());
-        from_ogr_shape(ogr_point, &res->back());
+        return;
     }
+    const size_t offset = res->size();
+    res->resize(offset + num_points);
+    ogr_shape.getPoints(reinterpret_cast<OGRRawPoint*>(&(*res)[offset]));
 }
 
 void from_ogr_shape(const OGRPolygon& ogr_shape, Polygon* res)
@@ -32,25 +37,27 @@ void from_ogr_shape(const OGRPolygon& ogr_shape, Polygon* res)
     from_ogr_shape(*ogr_exterior, &res->exterior_ring);
     
     size_t interior_count = ogr_shape.getNumInteriorRings();
+    const size_t offset = res->interior_rings.size();
+    res->interior_rings.resize(offset + interior_count);
     for (size_t i = 0; i < interior_count; ++i)
     {
         const OGRLinearRing* ogr_interior = ogr_shape.getInteriorRing(i);
         assert(ogr_interior);
-        res->interior_rings.push_back(Linestring());
-        from_ogr_shape(*ogr_interior, &res->interior_rings.back());
+        from_ogr_shape(*ogr_interior, &res->interior_rings[offset + i]);
     }
 }
 
 void from_ogr_shape(const OGRMultiPolygon& ogr_shape, MultiPolygon* res)
 {
     size_t num_geom = ogr_shape.getNumGeometries();
+    const size_t offset = res->size();
+    res->resize(offset + num_geom);
     for (size_t i = 0; i < num_geom; ++i)
     {
         const OGRGeometry* ogr_geom = ogr_shape.getGeometryRef(i);
         assert (ogr_geom->getGeometryType() == wkbPolygon);
         const OGRPolygon& ogr_polygon = *(OGRPolygon*)ogr_geom;
-        res->push_back(Polygon());
-        from_ogr_shape(ogr_polygon, &res->back());
+        from_ogr_shape(ogr_polygon, &(*res)[offset + i]);
     }
 }
 
@@ -62,33 +69,37 @@ void to_ogr_shape(const Point& shape, OGRPoint* ogr_shape)
 
 void to_ogr_shape(const Linestring& shape, OGRLinearRing* ogr_shape)
 {
-    for (VertexIndex i = 0; i < shape.size(); ++i)
+    if (!shape.empty())
     {
-        OGRPoint pt;
-        to_ogr_shape(shape[i], &pt);
-        ogr_shape->addPoint(&pt);
+        ogr_shape->setPoints(static_cast<int>(shape.size()),
+                             reinterpret_cast<const OGRRawPoint*>(&shape[0]));
     }
     ogr_shape->closeRings();
 }
 
+// rings and polygons are handed over to their parent instead of being
+// copied into it.
+void to_ogr_shape(const Polygon& shape, OGRPolygon* ogr_shape)
+{
+    OGRLinearRing* ext_ring = new OGRLinearRing();
+    to_ogr_shape(shape.exterior_ring, ext_ring);
+    ogr_shape->addRingDirectly(ext_ring);
+
+    for (size_t i = 0; i < shape.interior_rings.size(); ++i)
+    {
+        OGRLinearRing* int_ring = new OGRLinearRing();
+        to_ogr_shape(shape.interior_rings[i], int_ring);
+        ogr_shape->addRingDirectly(int_ring);
+    }
+}
+
 void to_ogr_shape(const MultiPolygon& shape, OGRMultiPolygon* ogr_shape)
 {
     for (size_t i = 0; i < shape.size(); ++i)
     {
-        const Polygon& poly = shape[i];
-        OGRLinearRing ext_ring;
-        to_ogr_shape(poly.exterior_ring, &ext_ring);
-        OGRPolygon ogr_polygon;
-        ogr_polygon.addRing(&ext_ring);
-
-        for (size_t j = 0; j < poly.interior_rings.size(); ++j)
-        {
-            OGRLinearRing int_ring;
-            to_ogr_shape(poly.interior_rings[j], &int_ring);
-            ogr_polygon.addRing(&int_ring);
-        }
-
-        ogr_shape->addGeometry(&ogr_polygon);
+        OGRPolygon* ogr_polygon = new OGRPolygon();
+        to_ogr_shape(shape[i], ogr_polygon);
+        ogr_shape->addGeometryDirectly(ogr_polygon);
     }
     ogr_shape->closeRings();
 }
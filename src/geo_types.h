@@ -43,6 +43,7 @@ void from_ogr_shape(const OGRMultiPolygon& ogr_shape, MultiPolygon* res);
 
 void to_ogr_shape(const Point& shape, OGRPoint* ogr_shape);
 void to_ogr_shape(const Linestring& shape, OGRLinearRing* ogr_shape);
+void to_ogr_shape(const Polygon& shape, OGRPolygon* ogr_shape);
 void to_ogr_shape(const MultiPolygon& shape, OGRMultiPolygon* ogr_shape);
 
 // returns cross product between two vectors: v1 ^ v2 in right handed coordinate
@@ -0,0 +1,349 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "geometry_cache.h"
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+static const char GEOMETRY_CACHE_MAGIC[8] = {'V', 'W', 'G', 'E', 'O', 'M', 0, 0};
+static const uint32_t GEOMETRY_CACHE_VERSION = 1;
+
+static_assert(sizeof(GeometryCacheHeader) % 8 == 0,
+              "sections following the header must stay 8-byte aligned");
+
+GeometryCacheWriter::GeometryCacheWriter()
+    : m_file(NULL)
+    , m_fids()
+    , m_feature_offsets()
+    , m_polygon_offsets()
+    , m_ring_offsets()
+    , m_polygon_flags()
+    , m_columns()
+    , m_column_ends()
+    , m_ring_buffer()
+    , m_failed(false)
+{
+}
+
+GeometryCacheWriter::~GeometryCacheWriter()
+{
+    close();
+}
+
+bool GeometryCacheWriter::open(const char* path,
+                               const std::vector<std::string>& field_names)
+{
+    assert(m_file == NULL);
+    m_file = fopen(path, "wb");
+    if (m_file == NULL)
+    {
+        std::cerr << "Cannot create geometry cache: " << path << std::endl;
+        return false;
+    }
+    // the header is rewritten with the final counts by close()
+    GeometryCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    m_failed = fwrite(&header, sizeof(header), 1, m_file) != 1;
+    m_fids.clear();
+    m_feature_offsets.assign(1, 0);
+    m_polygon_offsets.assign(1, 0);
+    m_ring_offsets.assign(1, 0);
+    m_polygon_flags.clear();
+    m_columns = field_names;
+    m_column_ends.resize(field_names.size());
+    for (size_t i = 0; i < field_names.size(); ++i)
+    {
+        m_column_ends[i].assign(1, field_names[i].size());
+    }
+    return !m_failed;
+}
+
+bool GeometryCacheWriter::add_ring(const Linestring& ring)
+{
+    m_ring_buffer.resize(2 * ring.size());
+    for (size_t i = 0; i < ring.size(); ++i)
+    {
+        m_ring_buffer[2 * i] = ring[i].X;
+        m_ring_buffer[2 * i + 1] = ring[i].Y;
+    }
+    if (!m_ring_buffer.empty()
+        && fwrite(&m_ring_buffer[0], sizeof(double), m_ring_buffer.size(),
+                  m_file) != m_ring_buffer.size())
+    {
+        return false;
+    }
+    m_ring_offsets.push_back(m_ring_offsets.back() + ring.size());
+    return true;
+}
+
+bool GeometryCacheWriter::add_feature(
+        int64_t fid, const MultiPolygon& shape, bool polygon,
+        const std::vector<std::string>& field_values)
+{
+    assert(m_file);
+    assert(field_values.size() == m_columns.size());
+    for (size_t i = 0; i < shape.size() && !m_failed; ++i)
+    {
+        const Polygon& poly = shape[i];
+        m_failed = !add_ring(poly.exterior_ring);
+        for (size_t j = 0; j < poly.interior_rings.size() && !m_failed; ++j)
+        {
+            m_failed = !add_ring(poly.interior_rings[j]);
+        }
+        m_polygon_offsets.push_back(m_ring_offsets.size() - 1);
+    }
+    m_fids.push_back(fid);
+    m_feature_offsets.push_back(m_polygon_offsets.size() - 1);
+    m_polygon_flags.push_back(polygon ? 1 : 0);
+    for (size_t i = 0; i < m_columns.size(); ++i)
+    {
+        m_columns[i] += field_values[i];
+        m_column_ends[i].push_back(m_columns[i].size());
+    }
+    if (m_failed)
+    {
+        std::cerr << "Cannot write geometry cache feature " << fid
+                  << std::endl;
+    }
+    return !m_failed;
+}
+
+template <typename T>
+static bool write_section(FILE* file, const T* values, size_t count,
+                          uint64_t* offset)
+{
+    *offset = static_cast<uint64_t>(ftello(file));
+    return count == 0 || fwrite(values, sizeof(T), count, file) == count;
+}
+
+template <typename T>
+static bool write_section(FILE* file, const std::vector<T>& values,
+                          uint64_t* offset)
+{
+    return write_section(file, values.empty() ? NULL : &values[0],
+                         values.size(), offset);
+}
+
+bool GeometryCacheWriter::close()
+{
+    if (m_file == NULL)
+    {
+        return !m_failed;
+    }
+    // string offsets across all columns, the strings following each other
+    std::vector<uint64_t> string_offsets(1, 0);
+    for (size_t i = 0; i < m_columns.size(); ++i)
+    {
+        const uint64_t column_offset = string_offsets.back();
+        for (size_t j = 0; j < m_column_ends[i].size(); ++j)
+        {
+            string_offsets.push_back(column_offset + m_column_ends[i][j]);
+        }
+    }
+
+    GeometryCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GEOMETRY_CACHE_MAGIC, sizeof(header.magic));
+    header.version = GEOMETRY_CACHE_VERSION;
+    header.header_size = sizeof(header);
+    header.feature_count = m_fids.size();
+    header.polygon_count = m_polygon_offsets.size() - 1;
+    header.ring_count = m_ring_offsets.size() - 1;
+    header.vertex_count = m_ring_offsets.back();
+    header.field_count = m_columns.size();
+    header.string_bytes = string_offsets.back();
+    header.coordinates_offset = sizeof(header);
+    bool res = !m_failed
+        && write_section(m_file, m_fids, &header.fids_offset)
+        && write_section(m_file, m_feature_offsets,
+                         &header.feature_offsets_offset)
+        && write_section(m_file, m_polygon_offsets,
+                         &header.polygon_offsets_offset)
+        && write_section(m_file, m_ring_offsets,
+                         &header.ring_offsets_offset)
+        && write_section(m_file, string_offsets,
+                         &header.string_offsets_offset)
+        && write_section(m_file, m_polygon_flags,
+                         &header.polygon_flags_offset);
+    header.strings_offset = static_cast<uint64_t>(ftello(m_file));
+    for (size_t i = 0; i < m_columns.size() && res; ++i)
+    {
+        uint64_t column_offset = 0;
+        res = write_section(m_file, m_columns[i].data(), m_columns[i].size(),
+                            &column_offset);
+    }
+    res = res
+        && fseeko(m_file, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, m_file) == 1;
+    res = (fclose(m_file) == 0) && res;
+    m_file = NULL;
+    m_failed = !res;
+    m_columns.clear();
+    m_column_ends.clear();
+    return res;
+}
+
+GeometryCache::GeometryCache()
+    : m_file()
+    , m_header(NULL)
+    , m_coordinates(NULL)
+    , m_fids(NULL)
+    , m_feature_offsets(NULL)
+    , m_polygon_offsets(NULL)
+    , m_ring_offsets(NULL)
+    , m_string_offsets(NULL)
+    , m_polygon_flags(NULL)
+    , m_strings(NULL)
+{
+}
+
+// Whether 'count' elements of 'element_size' bytes at 'offset' fit in the
+// file, aligned on their size.
+static bool section_fits(uint64_t offset, uint64_t count,
+                         size_t element_size, size_t file_size)
+{
+    return offset % element_size == 0 && offset <= file_size
+        && count <= (file_size - offset) / element_size;
+}
+
+bool GeometryCache::open(const char* path)
+{
+    m_header = NULL;
+    if (!m_file.open(path))
+    {
+        std::cerr << "Cannot map geometry cache " << path << ": "
+                  << strerror(errno) << std::endl;
+        return false;
+    }
+    const size_t file_size = m_file.size();
+    const GeometryCacheHeader* header =
+        reinterpret_cast<const GeometryCacheHeader*>(m_file.data());
+    if (file_size < sizeof(GeometryCacheHeader)
+        || memcmp(header->magic, GEOMETRY_CACHE_MAGIC,
+                  sizeof(header->magic)) != 0)
+    {
+        std::cerr << "Not a geometry cache: " << path << std::endl;
+        return false;
+    }
+    if (header->version != GEOMETRY_CACHE_VERSION
+        || header->header_size != sizeof(GeometryCacheHeader))
+    {
+        std::cerr << "Unsupported geometry cache version " << header->version
+                  << ": " << path << std::endl;
+        return false;
+    }
+    const uint64_t string_count =
+        header->field_count * (header->feature_count + 1);
+    // each offset array holds count + 1 entries, which must not wrap
+    if (header->feature_count >= file_size
+        || header->polygon_count >= file_size
+        || header->ring_count >= file_size
+        || string_count >= file_size
+        || !section_fits(header->coordinates_offset, header->vertex_count,
+                      2 * sizeof(double), file_size)
+        || !section_fits(header->fids_offset, header->feature_count,
+                         sizeof(int64_t), file_size)
+        || !section_fits(header->feature_offsets_offset,
+                         header->feature_count + 1, sizeof(uint64_t),
+                         file_size)
+        || !section_fits(header->polygon_offsets_offset,
+                         header->polygon_count + 1, sizeof(uint64_t),
+                         file_size)
+        || !section_fits(header->ring_offsets_offset, header->ring_count + 1,
+                         sizeof(uint64_t), file_size)
+        || (header->field_count > 0
+            && string_count / header->field_count
+               != header->feature_count + 1)
+        || !section_fits(header->string_offsets_offset, string_count + 1,
+                         sizeof(uint64_t), file_size)
+        || !section_fits(header->polygon_flags_offset, header->feature_count,
+                         sizeof(uint8_t), file_size)
+        || !section_fits(header->strings_offset, header->string_bytes,
+                         sizeof(char), file_size))
+    {
+        std::cerr << "Truncated geometry cache: " << path << std::endl;
+        return false;
+    }
+
+    const char* data = m_file.data();
+    m_coordinates = reinterpret_cast<const double*>(
+            data + header->coordinates_offset);
+    m_fids = reinterpret_cast<const int64_t*>(data + header->fids_offset);
+    m_feature_offsets = reinterpret_cast<const uint64_t*>(
+            data + header->feature_offsets_offset);
+    m_polygon_offsets = reinterpret_cast<const uint64_t*>(
+            data + header->polygon_offsets_offset);
+    m_ring_offsets = reinterpret_cast<const uint64_t*>(
+            data + header->ring_offsets_offset);
+    m_string_offsets = reinterpret_cast<const uint64_t*>(
+            data + header->string_offsets_offset);
+    m_polygon_flags = reinterpret_cast<const uint8_t*>(
+            data + header->polygon_flags_offset);
+    m_strings = data + header->strings_offset;
+    // offsets are trusted from here on, see offsets_valid()
+    if (!offsets_valid(m_feature_offsets, header->feature_count,
+                       header->polygon_count, 0)
+        || !offsets_valid(m_polygon_offsets, header->polygon_count,
+                          header->ring_count, 1)
+        || !offsets_valid(m_ring_offsets, header->ring_count,
+                          header->vertex_count, 0)
+        || !offsets_valid(m_string_offsets, string_count,
+                          header->string_bytes, 0))
+    {
+        std::cerr << "Corrupt geometry cache: " << path << std::endl;
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+void GeometryCache::source_shape(size_t feature, MultiPolygon* res) const
+{
+    assert(feature < feature_count());
+    const size_t first = first_polygon(feature);
+    const size_t end = first_polygon(feature + 1);
+    res->resize(end - first);
+    for (size_t i = first; i < end; ++i)
+    {
+        Polygon& poly = (*res)[i - first];
+        const size_t begin_ring = first_ring(i);
+        const size_t end_ring = first_ring(i + 1);
+        poly.interior_rings.resize(end_ring - begin_ring - 1);
+        for (size_t r = begin_ring; r < end_ring; ++r)
+        {
+            Linestring& line = r == begin_ring
+                ? poly.exterior_ring
+                : poly.interior_rings[r - begin_ring - 1];
+            const InterleavedView<double> view = ring(r);
+            line.clear();
+            for (size_t v = 0; v < view.size(); ++v)
+            {
+                line.push_back(view[v]);
+            }
+        }
+    }
+}
+
+std::string GeometryCache::string_at(uint64_t index) const
+{
+    const uint64_t begin = m_string_offsets[index];
+    const uint64_t end = m_string_offsets[index + 1];
+    assert(begin <= end && end <= m_header->string_bytes);
+    return std::string(m_strings + begin, end - begin);
+}
+
+std::string GeometryCache::field_name(size_t field) const
+{
+    assert(field < field_count());
+    return string_at(field * (m_header->feature_count + 1));
+}
+
+std::string GeometryCache::field_value(size_t field, size_t feature) const
+{
+    assert(field < field_count());
+    assert(feature < feature_count());
+    return string_at(field * (m_header->feature_count + 1) + 1 + feature);
+}
@@ -0,0 +1,179 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "geo_types.h"
+#include "coordinate_view.hpp"
+#include "area_index.h"
+
+// Geometry cache: a layer's polygons and attributes converted once out of
+// OGR into flat columns. Opening it is a single mmap; its rings are views
+// over the mapped coordinates that the simplifier reads in place.
+//
+// Layout, native byte order, every section but the last two 8-byte aligned:
+//   GeometryCacheHeader
+//   double[2 * vertex_count]         X Y pairs, ring after ring
+//   int64_t[feature_count]           source feature ids
+//   uint64_t[feature_count + 1]      first polygon of each feature
+//   uint64_t[polygon_count + 1]      first ring of each polygon
+//   uint64_t[ring_count + 1]         first vertex of each ring
+//   uint64_t[string_count + 1]       first byte of each string
+//   uint8_t[feature_count]           1 if the source was a single polygon
+//   char[string_bytes]               strings, not null terminated
+// Ring 0 of a polygon is its exterior ring. Attributes are stored as text,
+// one column per field: string_count is field_count * (feature_count + 1),
+// column f being its name at string f * (feature_count + 1) followed by
+// its value for every feature.
+
+struct GeometryCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t feature_count;
+    uint64_t polygon_count;
+    uint64_t ring_count;
+    uint64_t vertex_count;
+    uint64_t field_count;
+    uint64_t string_bytes;
+    // byte offsets from the start of the file
+    uint64_t coordinates_offset;
+    uint64_t fids_offset;
+    uint64_t feature_offsets_offset;
+    uint64_t polygon_offsets_offset;
+    uint64_t ring_offsets_offset;
+    uint64_t string_offsets_offset;
+    uint64_t polygon_flags_offset;
+    uint64_t strings_offset;
+};
+
+// Streams features to a new cache file. Coordinates are written as they
+// come; offsets and attribute columns are kept in memory until close().
+class GeometryCacheWriter
+{
+public:
+    GeometryCacheWriter();
+    ~GeometryCacheWriter();
+
+    bool open(const char* path, const std::vector<std::string>& field_names);
+
+    // 'field_values' has one value per field given to open().
+    bool add_feature(int64_t fid, const MultiPolygon& shape, bool polygon,
+                     const std::vector<std::string>& field_values);
+
+    // Writes the offset arrays, the attributes and the header. Returns false
+    // on I/O error.
+    bool close();
+
+private:
+    GeometryCacheWriter(const GeometryCacheWriter& other);
+    GeometryCacheWriter& operator=(const GeometryCacheWriter& other);
+
+    bool add_ring(const Linestring& ring);
+
+    FILE* m_file;
+    std::vector<int64_t> m_fids;
+    std::vector<uint64_t> m_feature_offsets;
+    std::vector<uint64_t> m_polygon_offsets;
+    std::vector<uint64_t> m_ring_offsets;
+    std::vector<uint8_t> m_polygon_flags;
+    // one per field: its name then its values, and where each one ends
+    std::vector<std::string> m_columns;
+    std::vector<std::vector<uint64_t> > m_column_ends;
+    std::vector<double> m_ring_buffer;
+    bool m_failed;
+};
+
+// Memory-mapped cache file.
+class GeometryCache
+{
+public:
+    GeometryCache();
+
+    // Maps and validates the file; reports problems on stderr.
+    bool open(const char* path);
+
+    size_t feature_count() const
+    {
+        return m_header ? m_header->feature_count : 0;
+    }
+
+    size_t vertex_count() const
+    {
+        return m_header ? m_header->vertex_count : 0;
+    }
+
+    int64_t feature_fid(size_t feature) const
+    {
+        return m_fids[feature];
+    }
+
+    // Whether the source geometry was a Polygon rather than a MultiPolygon.
+    bool feature_is_polygon(size_t feature) const
+    {
+        return m_polygon_flags[feature] != 0;
+    }
+
+    // Polygons [first_polygon(f), first_polygon(f+1)) make up feature f,
+    // and likewise for the rings of a polygon and the vertices of a ring.
+    size_t first_polygon(size_t feature) const
+    {
+        return m_feature_offsets[feature];
+    }
+
+    size_t first_ring(size_t polygon) const
+    {
+        return m_polygon_offsets[polygon];
+    }
+
+    size_t first_vertex(size_t ring) const
+    {
+        return m_ring_offsets[ring];
+    }
+
+    // Zero-copy view over the ring's coordinates, valid while the cache
+    // stays open.
+    InterleavedView<double> ring(size_t ring) const
+    {
+        const uint64_t first = m_ring_offsets[ring];
+        return InterleavedView<double>(m_coordinates + 2 * first,
+                                       m_ring_offsets[ring + 1] - first);
+    }
+
+    // Copy of a feature's shape.
+    void source_shape(size_t feature, MultiPolygon* res) const;
+
+    size_t field_count() const
+    {
+        return m_header ? m_header->field_count : 0;
+    }
+
+    std::string field_name(size_t field) const;
+    std::string field_value(size_t field, size_t feature) const;
+
+private:
+    GeometryCache(const GeometryCache& other);
+    GeometryCache& operator=(const GeometryCache& other);
+
+    std::string string_at(uint64_t index) const;
+
+    MappedFile m_file;
+    const GeometryCacheHeader* m_header;
+    const double* m_coordinates;
+    const int64_t* m_fids;
+    const uint64_t* m_feature_offsets;
+    const uint64_t* m_polygon_offsets;
+    const uint64_t* m_ring_offsets;
+    const uint64_t* m_string_offsets;
+    const uint8_t* m_polygon_flags;
+    const char* m_strings;
+};
+
+#endif // GEOMETRY_CACHE_H
@@ -9,7 +9,9 @@
 #include <algorithm>
 #include <functional>
 #include <unordered_map>
+#include <vector>
 #include <iostream>
+#include <stdint.h>
 
 #define CHECK_HEAP_CONSISTENCY 0
 
@@ -19,28 +21,170 @@
 //    non-standard: remove(elem) anywhere in heap, 
 //                  or alternatively, re-heapify a single element.
 //
-// This implementation uses a reheap() function and maintains a map to quickly
-// lookup a heap index given an element T.
+// This implementation uses a reheap() function and an IndexPolicy to quickly
+// lookup a heap index given an element T. The policy decides where that
+// position is stored:
+//    MapHeapIndex:       hash map, works for any hashable T (default).
+//    DenseHeapIndex:     array keyed by T, for integral T in [0, fixed_size).
+//    IntrusiveHeapIndex: 'heap_index' member of the pointed-to element.
+// The last two make reheap() pure array arithmetic.
 //
-template <typename T, typename Comparator = std::less<T> >
-class Heap
+template <typename T>
+class MapHeapIndex
 {
 public:
     typedef std::unordered_map<T, size_t> NodeToHeapIndexMap;
 
-    Heap(size_t fixed_size)
+    explicit MapHeapIndex(size_t /*fixed_size*/)
+    :
+    m_node_to_heap()
+    {
+    }
+
+    void reset(size_t /*fixed_size*/)
+    {
+        m_node_to_heap.clear();
+    }
+
+    void set(T node, size_t n)
+    {
+        m_node_to_heap[node] = n;
+    }
+
+    void clear(T node)
+    {
+        size_t del_count = m_node_to_heap.erase(node);
+        assert(del_count == 1);
+        (void)del_count;
+    }
+
+    size_t get(T node) const
+    {
+        typename NodeToHeapIndexMap::const_iterator it = m_node_to_heap.find(node);
+        assert (it != m_node_to_heap.end());
+        return it->second;
+    }
+
+    bool contains(T node) const
+    {
+        return m_node_to_heap.count(node) != 0;
+    }
+
+private:
+    NodeToHeapIndexMap m_node_to_heap;
+};
+
+// IndexType bounds the heap size; a 32-bit type halves the footprint of the
+// position array when T is itself a 32-bit index.
+template <typename T, typename IndexType = size_t>
+class DenseHeapIndex
+{
+public:
+    explicit DenseHeapIndex(size_t fixed_size)
     :
-    m_data(new T[fixed_size]),
+    m_node_to_heap(fixed_size, INVALID_INDEX)
+    {
+        assert(fixed_size <= INVALID_INDEX);
+    }
+
+    void reset(size_t fixed_size)
+    {
+        assert(fixed_size <= INVALID_INDEX);
+        m_node_to_heap.assign(fixed_size, INVALID_INDEX);
+    }
+
+    void set(T node, size_t n)
+    {
+        assert(static_cast<size_t>(node) < m_node_to_heap.size());
+        m_node_to_heap[node] = static_cast<IndexType>(n);
+    }
+
+    void clear(T node)
+    {
+        assert(m_node_to_heap[node] != INVALID_INDEX);
+        m_node_to_heap[node] = INVALID_INDEX;
+    }
+
+    size_t get(T node) const
+    {
+        assert(contains(node));
+        return m_node_to_heap[node];
+    }
+
+    bool contains(T node) const
+    {
+        assert(static_cast<size_t>(node) < m_node_to_heap.size());
+        return m_node_to_heap[node] != INVALID_INDEX;
+    }
+
+private:
+    static const IndexType INVALID_INDEX = static_cast<IndexType>(~IndexType(0));
+
+    std::vector<IndexType> m_node_to_heap;
+};
+
+template <typename T, typename IndexType>
+const IndexType DenseHeapIndex<T, IndexType>::INVALID_INDEX;
+
+// T must be a pointer to a type with a 'size_t heap_index' member.
+template <typename T>
+class IntrusiveHeapIndex
+{
+public:
+    explicit IntrusiveHeapIndex(size_t /*fixed_size*/)
+    {
+    }
+
+    void reset(size_t /*fixed_size*/)
+    {
+    }
+
+    void set(T node, size_t n)
+    {
+        node->heap_index = n;
+    }
+
+    void clear(T /*node*/)
+    {
+    }
+
+    size_t get(T node) const
+    {
+        return node->heap_index;
+    }
+};
+
+// Arity is the number of children per node: 2 for a binary heap. Wider
+// heaps are shallower, so sifting an element down costs fewer levels, each
+// comparing Arity children that sit next to each other in memory.
+template <typename T, typename Comparator = std::less<T>,
+          typename IndexPolicy = MapHeapIndex<T>, size_t Arity = 2>
+class Heap
+{
+public:
+    Heap(size_t fixed_size, const Comparator& comp = Comparator())
+    :
+    m_data(fixed_size),
     m_capacity(fixed_size),
     m_size(0),
-    m_comp(Comparator()),
-    m_node_to_heap()
+    m_comp(comp),
+    m_node_to_heap(fixed_size)
     {
     }
 
-    ~Heap()
+    /** reset empties the heap and makes room for fixed_size elements.
+     *  Storage only ever grows, so a heap reused for inputs of similar size
+     *  stops allocating.
+     */
+    void reset(size_t fixed_size)
     {
-        delete[] m_data;
+        if (m_data.size() < fixed_size)
+        {
+            m_data.resize(fixed_size);
+        }
+        m_capacity = fixed_size;
+        m_size = 0;
+        m_node_to_heap.reset(fixed_size);
     }
 
     void insert(T node)
@@ -89,6 +233,38 @@ public:
         return m_size == 0;
     }
 
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /** at_heap_index gives access to the elements in heap order (i.e.: not
+     *  sorted), 0 <= n < size().
+     */
+    const T& at_heap_index(size_t n) const
+    {
+        assert(n < m_size);
+        return m_data[n];
+    }
+
+    /** clear removes every element at once. */
+    void clear()
+    {
+        for (size_t i = 0; i < m_size; ++i)
+        {
+            clear_heap_index(m_data[i]);
+        }
+        m_size = 0;
+    }
+
+    /** contains tells whether node is currently in the heap. Only available
+     *  with index policies that can answer it (Map and Dense).
+     */
+    bool contains(T node) const
+    {
+        return m_node_to_heap.contains(node);
+    }
+
     /** reheap re-enforces the heap property for a node that was modified
      *  externally. Logarithmic performance for a node anywhere in the tree.
      */
@@ -111,11 +287,13 @@ private:
         NODE_TYPE_INVALID = ~0
     };
 
+    static_assert(Arity >= 2, "a heap node needs at least two children");
+
     size_t parent(size_t n) const
     {
         if (n != NODE_TYPE_ROOT)
         {
-            return (n-1)/2;
+            return (n-1)/Arity;
         }
         else
         {
@@ -123,9 +301,9 @@ private:
         }
     }
 
-    size_t left_child(size_t n) const
+    size_t first_child(size_t n) const
     {
-        return 2*n + 1;
+        return Arity*n + 1;
     }
 
     size_t bubble_up(size_t n)
@@ -146,16 +324,18 @@ private:
         return n;
     }
 
-    size_t small_elem(size_t n, size_t a, size_t b) const
+    // smallest of node n and its children
+    size_t small_elem(size_t n) const
     {
         size_t smallest = n;
-        if (a < m_size && m_comp(m_data[a], m_data[smallest]))
-        {
-            smallest = a;
-        }
-        if (b < m_size && m_comp(m_data[b], m_data[smallest]))
+        const size_t first = first_child(n);
+        const size_t end = std::min(first + Arity, m_size);
+        for (size_t child = first; child < end; ++child)
         {
-            smallest = b;
+            if (m_comp(m_data[child], m_data[smallest]))
+            {
+                smallest = child;
+            }
         }
         return smallest;
     }
@@ -164,9 +344,7 @@ private:
     {
         while (true)
         {
-            size_t left = left_child(n);
-            size_t right = 1+left;
-            size_t smallest = small_elem(n, left, right);
+            size_t smallest = small_elem(n);
             if (smallest != n)
             {
                 std::swap(m_data[smallest], m_data[n]);
@@ -184,20 +362,18 @@ private:
     
     void set_heap_index(T node, size_t n)
     {
-        m_node_to_heap[node] = n;
+        m_node_to_heap.set(node, n);
     }
 
     void clear_heap_index(T node)
     {
-        size_t del_count = m_node_to_heap.erase(node);
-        assert(del_count == 1);
+        m_node_to_heap.clear(node);
     }
 
     size_t get_heap_index(T node) const
     {
-        typename NodeToHeapIndexMap::const_iterator it = m_node_to_heap.find(node);
-        assert (it != m_node_to_heap.end());
-        size_t heap_idx = it->second;
+        size_t heap_idx = m_node_to_heap.get(node);
+        assert (heap_idx < m_size);
         assert (m_data[heap_idx] == node);
         return heap_idx;
     }
@@ -205,7 +381,6 @@ private:
 #if CHECK_HEAP_CONSISTENCY
     void validate_heap_state() const
     {
-        assert(m_node_to_heap.size() == m_size);
         for (size_t i = 0; i < m_size; ++i)
         {
             // ensure we cached the node properly
@@ -232,19 +407,292 @@ private:
         std::cout << std::endl;
 
         std::cout << "node to heap state: " << std::endl;
-        typename NodeToHeapIndexMap::const_iterator it;
-        for (it = m_node_to_heap.begin(); it != m_node_to_heap.end(); ++it)
+        for (size_t i = 0; i < m_size; ++i)
         {
-            std::cout << it->first << " -> " << it->second << std::endl; 
+            std::cout << m_data[i] << " -> " << m_node_to_heap.get(m_data[i])
+                      << std::endl;
         }
     }
 
 private:
-    T*  m_data;
+    std::vector<T> m_data;
     size_t m_capacity;
     size_t m_size;
     const Comparator m_comp;
-    NodeToHeapIndexMap m_node_to_heap;
+    IndexPolicy m_node_to_heap;
+};
+
+// Min-heap of dense node indices in [0, fixed_size), each one stored next
+// to its key. Comparisons read the keys straight out of the heap array
+// instead of looking each node up elsewhere, as a Comparator over T must.
+// Ties are broken on the node index, so the pop order only depends on the
+// keys, whatever the arity. update() changes the key of a node anywhere in
+// the heap.
+//
+// Heap position p lives at m_data[p]. m_data is offset into the storage so
+// that the Arity children of any node start on a multiple of Arity entries
+// from a cache line boundary: with 16-byte entries, the four children of a
+// node in a 4-ary heap are exactly one cache line.
+template <typename Key, typename Node, size_t Arity = 4>
+class KeyedHeap
+{
+public:
+    explicit KeyedHeap(size_t fixed_size)
+    :
+    m_storage(),
+    m_data(NULL),
+    m_capacity(0),
+    m_size(0),
+    m_node_to_heap(0)
+    {
+        reset(fixed_size);
+    }
+
+    /** reset empties the heap and makes room for fixed_size elements.
+     *  Storage only ever grows, as with Heap::reset().
+     */
+    void reset(size_t fixed_size)
+    {
+        const size_t storage_size =
+            fixed_size + Arity - 1 + CACHE_LINE_SIZE / sizeof(Entry);
+        // nothing to allocate for an empty heap
+        if (fixed_size > 0 && m_storage.size() < storage_size)
+        {
+            m_storage.resize(storage_size);
+            size_t offset = 0;
+            while (offset < CACHE_LINE_SIZE / sizeof(Entry)
+                   && reinterpret_cast<uintptr_t>(&m_storage[offset])
+                      % CACHE_LINE_SIZE != 0)
+            {
+                ++offset;
+            }
+            // the root fills the slot before the first group of children
+            m_data = &m_storage[offset + Arity - 1];
+        }
+        m_capacity = fixed_size;
+        m_size = 0;
+        m_node_to_heap.reset(fixed_size);
+    }
+
+    void insert(Node node, Key key)
+    {
+        assert(m_size < m_capacity);
+        const Entry entry = { key, node };
+        sift_up(m_size++, entry);
+    }
+
+    /** push_unordered appends node without restoring the heap property:
+     *  call heapify() once done, before any other operation.
+     */
+    void push_unordered(Node node, Key key)
+    {
+        assert(m_size < m_capacity);
+        const Entry entry = { key, node };
+        m_data[m_size] = entry;
+        m_node_to_heap.set(node, m_size);
+        ++m_size;
+    }
+
+    /** heapify orders the whole heap bottom-up (Floyd): O(n) instead of
+     *  the O(n log n) of as many insert() calls.
+     */
+    void heapify()
+    {
+        if (m_size < 2)
+        {
+            return;
+        }
+        for (size_t n = (m_size - 2) / Arity + 1; n-- > 0; )
+        {
+            // sift_down() overwrites the hole: pass it a copy
+            const Entry entry = m_data[n];
+            sift_down(n, entry);
+        }
+    }
+
+    Node top() const
+    {
+        assert(!empty());
+        return m_data[0].node;
+    }
+
+    Key top_key() const
+    {
+        assert(!empty());
+        return m_data[0].key;
+    }
+
+    Node pop()
+    {
+        const Node res = top();
+        m_node_to_heap.clear(res);
+        m_size--;
+        if (!empty())
+        {
+            sift_down(0, m_data[m_size]);
+        }
+        return res;
+    }
+
+    /** update gives node a new key and restores the heap property. */
+    void update(Node node, Key key)
+    {
+        const size_t n = m_node_to_heap.get(node);
+        assert(n < m_size && m_data[n].node == node);
+        const Entry entry = { key, node };
+        place(n, entry);
+    }
+
+    /** remove takes node out of the heap, wherever it is. */
+    void remove(Node node)
+    {
+        const size_t n = m_node_to_heap.get(node);
+        assert(n < m_size && m_data[n].node == node);
+        m_node_to_heap.clear(node);
+        m_size--;
+        if (n != m_size)
+        {
+            // the bottom element fills the hole
+            const Entry last = m_data[m_size];
+            place(n, last);
+        }
+    }
+
+    bool contains(Node node) const
+    {
+        return m_node_to_heap.contains(node);
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /** at_heap_index gives the nodes in heap order, 0 <= n < size(). */
+    Node at_heap_index(size_t n) const
+    {
+        assert(n < m_size);
+        return m_data[n].node;
+    }
+
+    /** for_each_node calls f(node) on every node, in heap order. */
+    template <typename Function>
+    void for_each_node(Function f) const
+    {
+        for (size_t i = 0; i < m_size; ++i)
+        {
+            f(m_data[i].node);
+        }
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < m_size; ++i)
+        {
+            m_node_to_heap.clear(m_data[i].node);
+        }
+        m_size = 0;
+    }
+
+private:
+    KeyedHeap(const KeyedHeap& other);
+    KeyedHeap& operator=(const KeyedHeap& other);
+
+    static_assert(Arity >= 2, "a heap node needs at least two children");
+
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    struct Entry
+    {
+        Key key;
+        Node node;
+    };
+
+    static bool less(const Entry& lhs, const Entry& rhs)
+    {
+        if (lhs.key != rhs.key)
+        {
+            return lhs.key < rhs.key;
+        }
+        return lhs.node < rhs.node;
+    }
+
+    // Stores 'entry' in the hole at n, or wherever above or below it the
+    // heap property puts it.
+    void place(size_t n, const Entry& entry)
+    {
+        if (n != 0 && less(entry, m_data[(n-1)/Arity]))
+        {
+            sift_up(n, entry);
+        }
+        else
+        {
+            sift_down(n, entry);
+        }
+    }
+
+    // Moves the hole at n up to where 'entry' belongs and stores it there.
+    void sift_up(size_t n, const Entry& entry)
+    {
+        while (n != 0)
+        {
+            const size_t parent = (n-1)/Arity;
+            if (!less(entry, m_data[parent]))
+            {
+                break;
+            }
+            m_data[n] = m_data[parent];
+            m_node_to_heap.set(m_data[n].node, n);
+            n = parent;
+        }
+        m_data[n] = entry;
+        m_node_to_heap.set(entry.node, n);
+    }
+
+    // Moves the hole at n down to where 'entry' belongs and stores it there.
+    void sift_down(size_t n, const Entry& entry)
+    {
+        while (true)
+        {
+            const size_t first = Arity*n + 1;
+            if (first >= m_size)
+            {
+                break;
+            }
+            const size_t end = std::min(first + Arity, m_size);
+            size_t smallest = first;
+            for (size_t child = first + 1; child < end; ++child)
+            {
+                if (less(m_data[child], m_data[smallest]))
+                {
+                    smallest = child;
+                }
+            }
+            if (!less(m_data[smallest], entry))
+            {
+                break;
+            }
+            m_data[n] = m_data[smallest];
+            m_node_to_heap.set(m_data[n].node, n);
+            n = smallest;
+        }
+        m_data[n] = entry;
+        m_node_to_heap.set(entry.node, n);
+    }
+
+    std::vector<Entry> m_storage;
+    Entry* m_data;
+    size_t m_capacity;
+    size_t m_size;
+    DenseHeapIndex<Node, Node> m_node_to_heap;
 };
 
+template <typename Key, typename Node, size_t Arity>
+const size_t KeyedHeap<Key, Node, Arity>::CACHE_LINE_SIZE;
+
 #endif // HEAP_HPP
@@ -0,0 +1,632 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "incremental_simplifier.h"
+#include <cassert>
+#include <limits>
+#include <algorithm>
+
+static const NodeIndex NO_VERTEX = std::numeric_limits<NodeIndex>::max();
+
+// Whether (lhs_area, lhs) goes before (rhs_area, rhs) in VertexHeap.
+static bool goes_before(double lhs_area, NodeIndex lhs,
+                        double rhs_area, NodeIndex rhs)
+{
+    return lhs_area < rhs_area || (lhs_area == rhs_area && lhs < rhs);
+}
+
+// Index of vertex 'v' once a vertex was inserted at, or erased from,
+// 'index'. Endpoints stay endpoints.
+static NodeIndex shifted_vertex(NodeIndex v, NodeIndex old_count,
+                                NodeIndex index, bool inserted)
+{
+    if (v == 0)
+    {
+        return 0;
+    }
+    if (v + 1 == old_count)
+    {
+        return inserted ? old_count : old_count - 2;
+    }
+    if (inserted)
+    {
+        return v >= index ? v + 1 : v;
+    }
+    assert(v != index);
+    return v > index ? v - 1 : v;
+}
+
+// Renumbers the links to vertices past an inserted or erased one.
+static void shift_links(std::vector<NodeIndex>* links, NodeIndex index,
+                        bool inserted)
+{
+    std::vector<NodeIndex>& values = *links;
+    if (inserted)
+    {
+        values.insert(values.begin() + index, NO_VERTEX);
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (values[i] != NO_VERTEX && values[i] >= index)
+            {
+                ++values[i];
+            }
+        }
+    }
+    else
+    {
+        values.erase(values.begin() + index);
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (values[i] != NO_VERTEX && values[i] > index)
+            {
+                --values[i];
+            }
+        }
+    }
+}
+
+IncrementalSimplifier::IncrementalSimplifier(const Linestring& input)
+    : m_line(input)
+    , m_effective_areas()
+    , m_prev_vertex()
+    , m_next_vertex()
+    , m_left_child()
+    , m_right_child()
+    , m_replayed_count(0)
+    , m_heap(0)
+    , m_span_areas()
+    , m_span_prev()
+    , m_span_next()
+    , m_span_left_child()
+    , m_span_right_child()
+    , m_first_outer()
+    , m_last_outer()
+{
+    rebuild();
+}
+
+void IncrementalSimplifier::insert_vertex(VertexIndex index,
+                                          const Point& point)
+{
+    const NodeIndex old_count = static_cast<NodeIndex>(m_line.size());
+    assert(index <= old_count);
+    assert(old_count + 1 < NO_VERTEX);
+    m_line.insert(m_line.begin() + index, point);
+    if (old_count < 3)
+    {
+        rebuild();
+        return;
+    }
+
+    // the new vertex goes between index - 1 and index, which were
+    // neighbours from the start
+    Span span;
+    if (index == 0)
+    {
+        span = fixed_span(0, fixed_after(0));
+    }
+    else if (index == old_count)
+    {
+        span = fixed_span(fixed_before(old_count - 1), old_count - 1);
+    }
+    else
+    {
+        span = adjacent_span(index - 1, index);
+    }
+    shift_vertices(span, old_count, index, true);
+    update(span);
+}
+
+void IncrementalSimplifier::move_vertex(VertexIndex index,
+                                        const Point& point)
+{
+    const NodeIndex count = static_cast<NodeIndex>(m_line.size());
+    assert(index < count);
+    m_line[index] = point;
+    if (count < 3)
+    {
+        rebuild();
+        return;
+    }
+    update(edit_span(index));
+}
+
+void IncrementalSimplifier::erase_vertex(VertexIndex index)
+{
+    const NodeIndex old_count = static_cast<NodeIndex>(m_line.size());
+    assert(index < old_count);
+    m_line.erase(m_line.begin() + index);
+    if (old_count < 3)
+    {
+        rebuild();
+        return;
+    }
+    Span span = edit_span(index);
+    shift_vertices(span, old_count, index, false);
+    update(span);
+}
+
+void IncrementalSimplifier::simplify(double area_threshold,
+                                     Linestring* res) const
+{
+    size_t ties_left = 0;
+    Visvalingam_Algorithm::simplify(m_line, m_effective_areas,
+                                    AreaCutoff(area_threshold, 0),
+                                    &ties_left, res);
+}
+
+bool IncrementalSimplifier::eliminated(NodeIndex v) const
+{
+    return m_prev_vertex[v] != NO_VERTEX;
+}
+
+// The one of 'first' and 'last', neighbours at some point, eliminated while
+// they still were, NO_VERTEX if neither ever is.
+NodeIndex IncrementalSimplifier::parent(NodeIndex first,
+                                        NodeIndex last) const
+{
+    if (eliminated(first) && m_next_vertex[first] == last)
+    {
+        return first;
+    }
+    if (eliminated(last) && m_prev_vertex[last] == first)
+    {
+        return last;
+    }
+    return NO_VERTEX;
+}
+
+// Nearest vertex never eliminated before 'v': the parent of the vertex last
+// eliminated in the part of the line between two of them has neither.
+NodeIndex IncrementalSimplifier::fixed_before(NodeIndex v) const
+{
+    assert(v > 0);
+    NodeIndex u = v - 1;
+    while (eliminated(u))
+    {
+        const NodeIndex up = parent(m_prev_vertex[u], m_next_vertex[u]);
+        if (up == NO_VERTEX)
+        {
+            return m_prev_vertex[u];
+        }
+        u = up;
+    }
+    return u;
+}
+
+NodeIndex IncrementalSimplifier::fixed_after(NodeIndex v) const
+{
+    assert(v + 1 < m_prev_vertex.size());
+    NodeIndex u = v + 1;
+    while (eliminated(u))
+    {
+        const NodeIndex up = parent(m_prev_vertex[u], m_next_vertex[u]);
+        if (up == NO_VERTEX)
+        {
+            return m_next_vertex[u];
+        }
+        u = up;
+    }
+    return u;
+}
+
+IncrementalSimplifier::Span
+IncrementalSimplifier::fixed_span(NodeIndex first, NodeIndex last) const
+{
+    Span res;
+    res.first = first;
+    res.last = last;
+    res.old_area = -std::numeric_limits<double>::infinity();
+    return res;
+}
+
+IncrementalSimplifier::Span
+IncrementalSimplifier::adjacent_span(NodeIndex first, NodeIndex last) const
+{
+    Span res = fixed_span(first, last);
+    const NodeIndex up = parent(first, last);
+    NodeIndex root = NO_VERTEX;
+    if (up == first)
+    {
+        root = m_right_child[first];
+    }
+    else if (up == last)
+    {
+        root = m_left_child[last];
+    }
+    if (root != NO_VERTEX)
+    {
+        res.old_area = m_effective_areas.areas[root];
+    }
+    return res;
+}
+
+// Smallest span whose replay covers an edit of 'v' in place: its triangle
+// and its neighbours' ones change.
+IncrementalSimplifier::Span
+IncrementalSimplifier::edit_span(NodeIndex v) const
+{
+    const NodeIndex count = static_cast<NodeIndex>(m_prev_vertex.size());
+    // an endpoint's neighbour would see it move: only a fixed vertex can
+    // end the span on that side
+    if (v == 0)
+    {
+        return fixed_span(0, fixed_after(1));
+    }
+    if (v + 1 == count)
+    {
+        return fixed_span(fixed_before(count - 2), count - 1);
+    }
+    if (!eliminated(v))
+    {
+        return fixed_span(fixed_before(v), fixed_after(v));
+    }
+    Span res = fixed_span(m_prev_vertex[v], m_next_vertex[v]);
+    res.old_area = m_effective_areas.areas[v];
+    return res;
+}
+
+// Whether 'v' is never eliminated from the line as edited: endpoints and
+// vertices starting with a degenerate triangle.
+bool IncrementalSimplifier::is_fixed(NodeIndex v) const
+{
+    return v == 0 || v + 1 == m_line.size()
+        || !(effective_area(v, v - 1, v + 1, m_line) > NEARLY_ZERO);
+}
+
+void IncrementalSimplifier::rebuild()
+{
+    const NodeIndex count = static_cast<NodeIndex>(m_line.size());
+    assert(count < NO_VERTEX);
+    m_effective_areas.areas.assign(count, 0.0);
+    m_prev_vertex.assign(count, NO_VERTEX);
+    m_next_vertex.assign(count, NO_VERTEX);
+    m_left_child.assign(count, NO_VERTEX);
+    m_right_child.assign(count, NO_VERTEX);
+    m_replayed_count = 0;
+    if (count > 2)
+    {
+        const bool replayed = replay(fixed_span(0, count - 1));
+        assert(replayed);
+        (void)replayed;
+    }
+}
+
+// Makes room for an inserted vertex, or drops an erased one, and renumbers
+// 'span' and the links accordingly. The vertices within the span are left
+// stale: the replay overwrites them.
+void IncrementalSimplifier::shift_vertices(Span& span, NodeIndex old_count,
+                                           NodeIndex index, bool inserted)
+{
+    span.first = shifted_vertex(span.first, old_count, index, inserted);
+    span.last = shifted_vertex(span.last, old_count, index, inserted);
+    std::vector<double>& areas = m_effective_areas.areas;
+    if (inserted)
+    {
+        areas.insert(areas.begin() + index, 0.0);
+    }
+    else
+    {
+        areas.erase(areas.begin() + index);
+    }
+    shift_links(&m_prev_vertex, index, inserted);
+    shift_links(&m_next_vertex, index, inserted);
+    shift_links(&m_left_child, index, inserted);
+    shift_links(&m_right_child, index, inserted);
+
+    // a new endpoint was part of the span
+    const NodeIndex endpoints[] = {0, static_cast<NodeIndex>(areas.size() - 1)};
+    for (size_t i = 0; i < 2; ++i)
+    {
+        const NodeIndex v = endpoints[i];
+        areas[v] = 0.0;
+        m_prev_vertex[v] = NO_VERTEX;
+        m_next_vertex[v] = NO_VERTEX;
+        m_left_child[v] = NO_VERTEX;
+        m_right_child[v] = NO_VERTEX;
+    }
+}
+
+// Replays 'span', growing it until the result holds, then updates the
+// effective areas of the vertices eliminated around it.
+void IncrementalSimplifier::update(Span span)
+{
+    m_replayed_count = 0;
+    for (;;)
+    {
+        // An end that became fixed, or stopped being, changes how the line
+        // splits into independent parts: replay those around it.
+        const bool first_changed =
+            is_fixed(span.first) == eliminated(span.first);
+        const bool last_changed =
+            is_fixed(span.last) == eliminated(span.last);
+        if (first_changed || last_changed)
+        {
+            if (first_changed || eliminated(span.first))
+            {
+                span.first = fixed_before(span.first);
+            }
+            if (last_changed || eliminated(span.last))
+            {
+                span.last = fixed_after(span.last);
+            }
+            span = fixed_span(span.first, span.last);
+            continue;
+        }
+        if (replay(span))
+        {
+            return;
+        }
+        // fixed ends always replay: the parent exists
+        const NodeIndex up = parent(span.first, span.last);
+        assert(up != NO_VERTEX);
+        span = fixed_span(m_prev_vertex[up], m_next_vertex[up]);
+        span.old_area = m_effective_areas.areas[up];
+    }
+}
+
+// The neighbours 'v' has on its left (or right) side, outside of any span
+// it ends, from the start until it is eliminated.
+void IncrementalSimplifier::outer_neighbours(
+        NodeIndex v, bool left, std::vector<NodeIndex>* res) const
+{
+    res->clear();
+    const std::vector<NodeIndex>& links = left ? m_prev_vertex : m_next_vertex;
+    NodeIndex u = left ? v - 1 : v + 1;
+    res->push_back(u);
+    while (u != links[v])
+    {
+        u = links[u];
+        res->push_back(u);
+    }
+}
+
+// Smallest area 'v' can have with 'inner' as its neighbour on one side and
+// any of 'outer' on the other.
+double IncrementalSimplifier::min_outer_area(
+        NodeIndex v, const std::vector<NodeIndex>& outer,
+        NodeIndex inner) const
+{
+    double res = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < outer.size(); ++i)
+    {
+        res = std::min(res, outer[i] < v
+                            ? effective_area(v, outer[i], inner, m_line)
+                            : effective_area(v, inner, outer[i], m_line));
+    }
+    return res;
+}
+
+// Whether 'v', with 'inner' as its neighbour on one side from time 'from'
+// until 'to', stays in the line meanwhile whichever of 'outer' it has on
+// the other. Times are effective areas: a vertex is eliminated at its own,
+// once every vertex with a smaller one is, and anything eliminated by then
+// has a triangle no larger. Outer neighbours come and go in order, at
+// their effective areas; the last stays until v is eliminated.
+bool IncrementalSimplifier::stays_until(
+        NodeIndex v, const std::vector<NodeIndex>& outer, NodeIndex inner,
+        double from, double to) const
+{
+    const std::vector<double>& areas = m_effective_areas.areas;
+    for (size_t i = 0; i < outer.size(); ++i)
+    {
+        if (i > 0 && areas[outer[i - 1]] > to)
+        {
+            break;
+        }
+        const double until = i + 1 < outer.size()
+                             ? areas[outer[i]]
+                             : std::numeric_limits<double>::infinity();
+        if (until < from)
+        {
+            continue;
+        }
+        const double area = outer[i] < v
+                            ? effective_area(v, outer[i], inner, m_line)
+                            : effective_area(v, inner, outer[i], m_line);
+        if (!(area > std::min(until, to)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs the elimination loop over the vertices between span.first and
+// span.last and, if the rest of the line is unaffected, stores the result.
+//
+// With both ends fixed, the span is independent from the rest of the line.
+// Otherwise the rest of the line only sees the span through the areas of
+// its ends, and sees the same as before the edit when:
+//   - every vertex of the span is eliminated: the ends become neighbours,
+//   - no end could go first meanwhile, with the neighbours it has outside
+//     by then,
+//   - none after 'up', the end eliminated first, went before the edit: all
+//     are done by then, and up has the area it had,
+//   - the span does not empty any sooner, or the ends, once neighbours,
+//     could not go before it did before the edit, at span.old_area.
+bool IncrementalSimplifier::replay(const Span& span)
+{
+    const NodeIndex first = span.first;
+    const NodeIndex last = span.last;
+    assert(first < last);
+    const NodeIndex count = last - first + 1;
+    m_replayed_count += count - 2;
+    const bool first_fixed = !eliminated(first);
+    const bool last_fixed = !eliminated(last);
+    const bool independent = first_fixed && last_fixed;
+
+    const NodeIndex up = parent(first, last);
+    double up_area = std::numeric_limits<double>::infinity();
+    if (up != NO_VERTEX)
+    {
+        up_area = effective_area(up, m_prev_vertex[up], m_next_vertex[up],
+                                 m_line);
+    }
+    // since when each end has had its current neighbour in the span
+    double first_since = -std::numeric_limits<double>::infinity();
+    double last_since = first_since;
+    if (!first_fixed)
+    {
+        outer_neighbours(first, true, &m_first_outer);
+    }
+    if (!last_fixed)
+    {
+        outer_neighbours(last, false, &m_last_outer);
+    }
+
+    // same loop as SimplifyWorkspace::eliminate(), on local indices
+    std::vector<double>& areas = m_span_areas;
+    std::vector<NodeIndex>& prev_vertex = m_span_prev;
+    std::vector<NodeIndex>& next_vertex = m_span_next;
+    areas.assign(count, 0.0);
+    prev_vertex.assign(count, NO_VERTEX);
+    next_vertex.assign(count, NO_VERTEX);
+    m_span_left_child.assign(count, NO_VERTEX);
+    m_span_right_child.assign(count, NO_VERTEX);
+    m_heap.reset(count);
+    if (count > 2)
+    {
+        triangle_areas(&m_line[first].X, count, &areas[0]);
+    }
+    for (NodeIndex i=1; i+1 < count; ++i)
+    {
+        if (areas[i] > NEARLY_ZERO)
+        {
+            prev_vertex[i] = i-1;
+            next_vertex[i] = i+1;
+            m_heap.push_unordered(i, areas[i]);
+        }
+        else if (!independent)
+        {
+            // the ends would never become neighbours
+            return false;
+        }
+        else
+        {
+            areas[i] = 0.0;
+        }
+    }
+    m_heap.heapify();
+
+    double min_area = -std::numeric_limits<double>::max();
+    while (!m_heap.empty())
+    {
+        const NodeIndex curr = m_heap.pop();
+        const double area = areas[curr];
+        if (goes_before(up_area, up, area, first + curr))
+        {
+            return false;
+        }
+        min_area = std::max(min_area, area);
+
+        const NodeIndex prev = prev_vertex[curr];
+        const NodeIndex next = next_vertex[curr];
+        if (m_heap.contains(prev))
+        {
+            next_vertex[prev] = next;
+            areas[prev] = effective_area(first + prev,
+                                         first + prev_vertex[prev],
+                                         first + next, m_line);
+            m_heap.update(prev, areas[prev]);
+        }
+        else if (prev == 0 && !first_fixed)
+        {
+            if (!stays_until(first, m_first_outer, first + curr,
+                             first_since, min_area))
+            {
+                return false;
+            }
+            first_since = min_area;
+        }
+        if (m_heap.contains(next))
+        {
+            prev_vertex[next] = prev;
+            areas[next] = effective_area(first + next, first + prev,
+                                         first + next_vertex[next], m_line);
+            m_heap.update(next, areas[next]);
+        }
+        else if (next + 1 == count && !last_fixed)
+        {
+            if (!stays_until(last, m_last_outer, first + curr, last_since,
+                             min_area))
+            {
+                return false;
+            }
+            last_since = min_area;
+        }
+        m_span_right_child[prev] = curr;
+        m_span_left_child[next] = curr;
+        areas[curr] = min_area;
+    }
+    // Past span.old_area, the last vertex replayed goes no sooner than
+    // the old ones all went. Otherwise the ends might go before they did
+    // once neighbours.
+    if (!(min_area > span.old_area)
+        && ((!first_fixed
+             && !(min_outer_area(first, m_first_outer, last)
+                  > span.old_area))
+            || (!last_fixed
+                && !(min_outer_area(last, m_last_outer, first)
+                     > span.old_area))))
+    {
+        return false;
+    }
+
+    for (NodeIndex i=1; i+1 < count; ++i)
+    {
+        const NodeIndex v = first + i;
+        m_effective_areas.areas[v] = areas[i];
+        if (prev_vertex[i] == NO_VERTEX)
+        {
+            m_prev_vertex[v] = NO_VERTEX;
+            m_next_vertex[v] = NO_VERTEX;
+            m_left_child[v] = NO_VERTEX;
+            m_right_child[v] = NO_VERTEX;
+            continue;
+        }
+        m_prev_vertex[v] = first + prev_vertex[i];
+        m_next_vertex[v] = first + next_vertex[i];
+        m_left_child[v] = m_span_left_child[i] == NO_VERTEX
+                          ? NO_VERTEX : first + m_span_left_child[i];
+        m_right_child[v] = m_span_right_child[i] == NO_VERTEX
+                           ? NO_VERTEX : first + m_span_right_child[i];
+    }
+    if (up != NO_VERTEX)
+    {
+        const NodeIndex root = m_span_right_child[0] == NO_VERTEX
+                               ? NO_VERTEX : first + m_span_right_child[0];
+        (up == first ? m_right_child[first] : m_left_child[last]) = root;
+        update_ancestors(up);
+    }
+    return true;
+}
+
+// A vertex's effective area is the largest triangle area among those
+// eliminated before it between its neighbours, and its own: recomputes
+// them from 'v' up, until one does not change.
+void IncrementalSimplifier::update_ancestors(NodeIndex v)
+{
+    std::vector<double>& areas = m_effective_areas.areas;
+    while (v != NO_VERTEX)
+    {
+        const NodeIndex prev = m_prev_vertex[v];
+        const NodeIndex next = m_next_vertex[v];
+        double area = effective_area(v, prev, next, m_line);
+        if (m_left_child[v] != NO_VERTEX)
+        {
+            area = std::max(area, areas[m_left_child[v]]);
+        }
+        if (m_right_child[v] != NO_VERTEX)
+        {
+            area = std::max(area, areas[m_right_child[v]]);
+        }
+        if (area == areas[v])
+        {
+            return;
+        }
+        areas[v] = area;
+        v = parent(prev, next);
+    }
+}
@@ -0,0 +1,124 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef INCREMENTAL_SIMPLIFIER_H
+#define INCREMENTAL_SIMPLIFIER_H
+
+#include <vector>
+#include "geo_types.h"
+#include "visvalingam_algorithm.h"
+
+// Keeps a line's effective areas up to date while its vertices are
+// inserted, moved and erased, e.g.: by an editor, without running the
+// elimination loop over the whole line again. The areas stay exactly those
+// of Visvalingam_Algorithm with the default options.
+//
+// A vertex v eliminated between neighbours a and b goes last of the
+// vertices between them, and those go in the order they would on the line
+// a..b alone: v's effective area is the largest triangle area among them
+// and v itself. An edit is thus replayed over the smallest such span
+// around it, a and b staying put, and the result kept when the rest of the
+// line cannot tell the difference: the span's vertices still all go before
+// a and b, and not so early or late that a or b would go at another time.
+// Otherwise the span grows to the one around it, at most up to the nearest
+// vertices never eliminated: endpoints and those starting with a
+// degenerate triangle, which split the line into independent parts. Past
+// the span, only the effective areas of the vertices eliminated around it
+// can change, and they are updated up to the first that does not.
+//
+// Most edits replay a handful of vertices whatever the length of the line,
+// but one that moves the time a vertex high in the elimination goes
+// replays around it: on a 100k vertex random walk, edits replay 2k vertices
+// on average. Insertions and erasures also shift the per-vertex arrays, a
+// linear pass.
+class IncrementalSimplifier
+{
+public:
+    explicit IncrementalSimplifier(const Linestring& input);
+
+    // Inserts 'point' before vertex 'index', or appends it when index is
+    // the vertex count.
+    void insert_vertex(VertexIndex index, const Point& point);
+    void move_vertex(VertexIndex index, const Point& point);
+    void erase_vertex(VertexIndex index);
+
+    const Linestring& line() const
+    {
+        return m_line;
+    }
+
+    // Same as Visvalingam_Algorithm(line()).effective_areas().
+    const EffectiveAreas& effective_areas() const
+    {
+        return m_effective_areas;
+    }
+
+    // Same as Visvalingam_Algorithm(line()).simplify(area_threshold, res).
+    void simplify(double area_threshold, Linestring* res) const;
+
+    // Vertices run through the elimination loop by the last edit, or by
+    // the constructor.
+    size_t replayed_count() const
+    {
+        return m_replayed_count;
+    }
+
+private:
+    IncrementalSimplifier(const IncrementalSimplifier& other);
+    IncrementalSimplifier& operator=(const IncrementalSimplifier& other);
+
+    // Vertices strictly between 'first' and 'last' are replayed. old_area
+    // is the largest effective area among them before the edit, -infinity
+    // if there were none.
+    struct Span
+    {
+        NodeIndex first;
+        NodeIndex last;
+        double old_area;
+    };
+
+    bool eliminated(NodeIndex v) const;
+    NodeIndex parent(NodeIndex first, NodeIndex last) const;
+    NodeIndex fixed_before(NodeIndex v) const;
+    NodeIndex fixed_after(NodeIndex v) const;
+    Span fixed_span(NodeIndex first, NodeIndex last) const;
+    Span adjacent_span(NodeIndex first, NodeIndex last) const;
+    Span edit_span(NodeIndex v) const;
+    bool is_fixed(NodeIndex v) const;
+
+    void rebuild();
+    void shift_vertices(Span& span, NodeIndex old_count, NodeIndex index,
+                        bool inserted);
+    void update(Span span);
+    bool replay(const Span& span);
+    void outer_neighbours(NodeIndex v, bool left,
+                          std::vector<NodeIndex>* res) const;
+    double min_outer_area(NodeIndex v, const std::vector<NodeIndex>& outer,
+                          NodeIndex inner) const;
+    bool stays_until(NodeIndex v, const std::vector<NodeIndex>& outer,
+                     NodeIndex inner, double from, double to) const;
+    void update_ancestors(NodeIndex v);
+
+    Linestring m_line;
+    EffectiveAreas m_effective_areas;
+    // Neighbours when eliminated, and the vertex last eliminated between
+    // each of them and the vertex. NO_VERTEX for vertices never eliminated.
+    std::vector<NodeIndex> m_prev_vertex;
+    std::vector<NodeIndex> m_next_vertex;
+    std::vector<NodeIndex> m_left_child;
+    std::vector<NodeIndex> m_right_child;
+    size_t m_replayed_count;
+
+    // replay scratch, indexed from the span's first vertex
+    VertexHeap m_heap;
+    std::vector<double> m_span_areas;
+    std::vector<NodeIndex> m_span_prev;
+    std::vector<NodeIndex> m_span_next;
+    std::vector<NodeIndex> m_span_left_child;
+    std::vector<NodeIndex> m_span_right_child;
+    std::vector<NodeIndex> m_first_outer;
+    std::vector<NodeIndex> m_last_outer;
+};
+
+#endif // INCREMENTAL_SIMPLIFIER_H
@@ -4,12 +4,37 @@
 //
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
 #include <cassert>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <map>
+#include <sstream>
+#include <unistd.h>
 #include <ogrsf_frmts.h>
 #include "visvalingam_algorithm.h"
 #include "geo_types.h"
 #include "heap.hpp"
+#include "radix_heap.hpp"
+#include "coordinate_view.hpp"
+#include "thread_pool.h"
+#include "run_stats.h"
+#include "bounded_queue.hpp"
+#include "feature_writer.h"
+#include "area_index.h"
+#include "geometry_cache.h"
+#include "triangle_areas.h"
+#include "streaming_simplifier.h"
+#include "incremental_simplifier.h"
+#include "chunked_areas.h"
+#include "out_of_core_simplifier.h"
+#include "shared_arcs.h"
+#include "segment_grid.h"
 
 void test_vector_sub()
 {
@@ -124,6 +149,661 @@ void test_heap_reheap()
     test_values.clear();
 }
 
+struct HeapIntrusiveTest
+{
+    explicit HeapIntrusiveTest(int32_t v) : value(v), heap_index(0)
+    {}
+    int32_t value;
+    size_t heap_index;
+};
+
+struct HeapIntrusiveTestComp
+{
+    bool operator()(const HeapIntrusiveTest* lhs,
+                    const HeapIntrusiveTest* rhs) const
+    {
+        return lhs->value < rhs->value;
+    }
+};
+
+void test_heap_intrusive_reheap()
+{
+    HeapIntrusiveTest a(2), b(8), c(1);
+    Heap<HeapIntrusiveTest*, HeapIntrusiveTestComp,
+         IntrusiveHeapIndex<HeapIntrusiveTest*> > heap(3);
+    heap.insert(&a);
+    heap.insert(&b);
+    heap.insert(&c);
+    assert(heap.top() == &c);
+
+    c.value = 10;
+    heap.reheap(&c);
+    assert(heap.top() == &a);
+
+    b.value = -1;
+    heap.reheap(&b);
+    assert(heap.top() == &b);
+    heap.pop();
+    assert(heap.top() == &a);
+    heap.pop();
+    assert(heap.top() == &c);
+    heap.pop();
+    assert(heap.empty());
+}
+
+// orders indices by the value they refer to
+struct IndexValueComp
+{
+    explicit IndexValueComp(const std::vector<int32_t>* values)
+        : m_values(values)
+    {}
+    bool operator()(uint32_t lhs, uint32_t rhs) const
+    {
+        return (*m_values)[lhs] < (*m_values)[rhs];
+    }
+    const std::vector<int32_t>* m_values;
+};
+
+void test_heap_dense_index_reheap()
+{
+    std::vector<int32_t> values;
+    values.push_back(5);
+    values.push_back(3);
+    values.push_back(9);
+    values.push_back(7);
+    Heap<uint32_t, IndexValueComp, DenseHeapIndex<uint32_t> >
+        heap(values.size(), IndexValueComp(&values));
+    for (uint32_t i=0; i < values.size(); ++i)
+    {
+        heap.insert(i);
+    }
+    assert(heap.top() == 1);
+
+    values[3] = 0;
+    heap.reheap(3);
+    assert(heap.top() == 3);
+    heap.pop();
+    values[1] = 6;
+    heap.reheap(1);
+
+    const uint32_t expected[] = {0, 1, 2};
+    for (size_t i=0; i < sizeof(expected)/sizeof(expected[0]); ++i)
+    {
+        assert(heap.top() == expected[i]);
+        heap.pop();
+    }
+    assert(heap.empty());
+}
+
+void test_heap_arity()
+{
+    Heap<int32_t, std::less<int32_t>, MapHeapIndex<int32_t>, 4> heap(50);
+    for (int32_t i=0; i < 50; ++i)
+    {
+        heap.insert((i * 37) % 50);
+    }
+    for (int32_t i=0; i < 50; ++i)
+    {
+        assert(heap.top() == i);
+        heap.pop();
+    }
+    assert(heap.empty());
+}
+
+// Pops with interleaved key updates come out in (key, node) order, whether
+// the heap was built by insert() or by heapify().
+template <size_t Arity>
+void test_keyed_heap(bool bulk_build)
+{
+    const uint32_t node_count = 200;
+    KeyedHeap<double, uint32_t, Arity> heap(node_count);
+    std::vector<double> keys(node_count);
+    std::vector<bool> in_heap(node_count, true);
+    for (uint32_t i=0; i < node_count; ++i)
+    {
+        // a few duplicate keys, to exercise the tie break
+        keys[i] = static_cast<double>((i * 7919) % 101);
+        if (bulk_build)
+        {
+            heap.push_unordered(i, keys[i]);
+        }
+        else
+        {
+            heap.insert(i, keys[i]);
+        }
+    }
+    if (bulk_build)
+    {
+        heap.heapify();
+    }
+    assert(heap.size() == node_count);
+
+    double last_key = -1.0;
+    uint32_t last_node = 0;
+    uint32_t step = 0;
+    while (!heap.empty())
+    {
+        const double key = heap.top_key();
+        const uint32_t node = heap.pop();
+        in_heap[node] = false;
+        assert(key == keys[node]);
+        assert(key > last_key || (key == last_key && node > last_node));
+        last_key = key;
+        last_node = node;
+        // raise one node's key and lower another's, staying above the key
+        // just popped
+        for (uint32_t i=0; i < 2; ++i)
+        {
+            const uint32_t other = (node * 31 + ++step * 17) % node_count;
+            if (heap.contains(other))
+            {
+                assert(in_heap[other]);
+                keys[other] = i == 0 ? keys[other] + 50.0
+                                     : std::max(key + 0.5, keys[other] - 30.0);
+                heap.update(other, keys[other]);
+            }
+        }
+    }
+    for (uint32_t i=0; i < node_count; ++i)
+    {
+        assert(!in_heap[i]);
+    }
+
+    heap.reset(4);
+    heap.insert(3, 1.0);
+    heap.insert(0, 2.0);
+    heap.clear();
+    assert(heap.empty() && !heap.contains(3));
+}
+
+// Same operations on both queues: pops come out in the same order,
+// including keys updated below the last one popped and equal keys.
+void test_radix_heap()
+{
+    const uint32_t node_count = 300;
+    RadixHeap<uint32_t> radix_heap(node_count);
+    KeyedHeap<double, uint32_t> keyed_heap(node_count);
+    for (uint32_t i=0; i < node_count; ++i)
+    {
+        const double key = static_cast<double>((i * 7919) % 97) * 0.25;
+        radix_heap.insert(i, key);
+        keyed_heap.insert(i, key);
+    }
+    uint32_t step = 0;
+    while (!keyed_heap.empty())
+    {
+        assert(radix_heap.size() == keyed_heap.size());
+        const double key = keyed_heap.top_key();
+        const uint32_t node = keyed_heap.pop();
+        const uint32_t radix_node = radix_heap.pop();
+        assert(radix_node == node);
+        assert(!radix_heap.contains(node));
+        for (uint32_t i=0; i < 3; ++i)
+        {
+            const uint32_t other = (node * 31 + ++step * 17) % node_count;
+            if (keyed_heap.contains(other))
+            {
+                assert(radix_heap.contains(other));
+                // below, at and above the key just popped
+                const double new_key = std::max(0.0, key + (i - 1.0) * 2.0);
+                radix_heap.update(other, new_key);
+                keyed_heap.update(other, new_key);
+            }
+        }
+    }
+    assert(radix_heap.empty());
+
+    radix_heap.reset(3);
+    radix_heap.insert(2, 5.0);
+    radix_heap.insert(0, 1.0);
+    size_t visited = 0;
+    radix_heap.for_each_node([&visited](uint32_t) { ++visited; });
+    assert(visited == 2);
+    radix_heap.clear();
+    assert(radix_heap.empty() && !radix_heap.contains(2));
+}
+
+// Every kernel available gives effective_area()'s results bit for bit, at
+// any length around their register widths.
+void test_triangle_areas()
+{
+    std::vector<double> xy;
+    for (int i = 0; i < 40; ++i)
+    {
+        xy.push_back(i * 0.37 + (i * i * 7) % 11 * 1e-3);
+        xy.push_back((i * i * 13) % 17 * 0.1 - i);
+    }
+    const TriangleAreaKernel kernels[] = {
+        TRIANGLE_AREA_SCALAR, TRIANGLE_AREA_SSE2, TRIANGLE_AREA_AVX2,
+        TRIANGLE_AREA_AVX512};
+    for (size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k)
+    {
+        if (!triangle_area_kernel_supported(kernels[k]))
+        {
+            continue;
+        }
+        for (size_t count = 0; count <= xy.size() / 2; ++count)
+        {
+            const InterleavedView<double> line(&xy[0], count);
+            std::vector<double> areas(count + 1, -1.0);
+            triangle_areas(&xy[0], count, &areas[0], kernels[k]);
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (i == 0 || i + 1 == count)
+                {
+                    assert(areas[i] == -1.0);
+                }
+                else
+                {
+                    assert(areas[i] == effective_area(i, i-1, i+1, line));
+                }
+            }
+            assert(areas[count] == -1.0);
+        }
+    }
+    assert(triangle_area_kernel_supported(best_triangle_area_kernel()));
+}
+
+// A line shorter than the window comes out as the whole line's
+// simplification; longer ones keep their ends, stay in order and never hold
+// a full window between calls.
+void test_streaming_simplifier()
+{
+    Linestring line;
+    for (int i = 0; i < 300; ++i)
+    {
+        line.push_back(Point(i * 0.5, (i*i*7) % 23 + (i % 5) * 0.1));
+    }
+    const double threshold = 2.0;
+    SimplifyWorkspace workspace;
+    std::vector<VertexIndex> expected(line.size());
+    const size_t expected_count = Visvalingam_Algorithm::simplify_indices(
+            line, threshold, &expected[0], &workspace);
+
+    StreamingSimplifier whole(threshold, line.size() + 1, &workspace);
+    Linestring res;
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        whole.push(line[i], &res);
+    }
+    assert(res.size() == 1);
+    whole.finish(&res);
+    assert(res.size() == expected_count);
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        assert(res[i].X == line[expected[i]].X);
+        assert(res[i].Y == line[expected[i]].Y);
+    }
+
+    const size_t window_sizes[] = {3, 4, 17, 64};
+    for (size_t w = 0; w < sizeof(window_sizes)/sizeof(window_sizes[0]); ++w)
+    {
+        StreamingSimplifier streaming(threshold, window_sizes[w], &workspace);
+        for (size_t pass = 0; pass < 2; ++pass)
+        {
+            Linestring streamed;
+            for (size_t i = 0; i < line.size(); ++i)
+            {
+                streaming.push(line[i], &streamed);
+                assert(streaming.pending_count() < window_sizes[w]);
+            }
+            streaming.finish(&streamed);
+            assert(streaming.pending_count() == 0);
+            assert(streamed.size() >= 2 && streamed.size() <= line.size());
+            // points are taken from the line, in order (X is increasing)
+            for (size_t i = 1; i < streamed.size(); ++i)
+            {
+                assert(streamed[i].X > streamed[i-1].X);
+            }
+            assert(streamed.front().X == line.front().X);
+            assert(streamed.back().X == line.back().X);
+            if (pass == 1)
+            {
+                // the simplifier starts over after finish()
+                assert(streamed.size() == res.size());
+                for (size_t i = 0; i < res.size(); ++i)
+                {
+                    assert(streamed[i].X == res[i].X);
+                }
+            }
+            res.swap(streamed);
+        }
+    }
+
+    // a random walk, against windows simplified one by one: each emits what
+    // simplify_indices() keeps of it, up to its middle
+    Linestring walk;
+    uint32_t state = 99;
+    double x = 0.0;
+    double y = 0.0;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        state = state * 1103515245u + 12345u;
+        x += ((state >> 16) % 2001) / 1000.0 - 1.0;
+        state = state * 1103515245u + 12345u;
+        y += ((state >> 16) % 2001) / 1000.0 - 1.0;
+        walk.push_back(Point(x, y));
+    }
+    const size_t window_size = 64;
+    const double walk_thresholds[] = {0.01, 1.0, 10.0};
+    for (size_t t = 0; t < 3; ++t)
+    {
+        StreamingSimplifier streaming(walk_thresholds[t], window_size,
+                                      &workspace);
+        Linestring streamed;
+        for (size_t i = 0; i < walk.size(); ++i)
+        {
+            streaming.push(walk[i], &streamed);
+        }
+        streaming.finish(&streamed);
+
+        Linestring expected_walk(1, walk[0]);
+        std::vector<VertexIndex> kept(window_size);
+        size_t start = 0;
+        while (true)
+        {
+            const bool full = start + window_size <= walk.size();
+            const Linestring window(
+                    walk.begin() + start,
+                    full ? walk.begin() + start + window_size : walk.end());
+            const size_t kept_count = Visvalingam_Algorithm::simplify_indices(
+                    window, walk_thresholds[t], &kept[0], &workspace);
+            size_t last = 1;
+            while (full && kept[last] < window_size / 2)
+            {
+                ++last;
+            }
+            for (size_t i = 1; i <= (full ? last : kept_count - 1); ++i)
+            {
+                expected_walk.push_back(window[kept[i]]);
+            }
+            if (!full)
+            {
+                break;
+            }
+            start += kept[last];
+        }
+        assert(streamed.size() == expected_walk.size());
+        for (size_t i = 0; i < streamed.size(); ++i)
+        {
+            assert(streamed[i].X == expected_walk[i].X
+                   && streamed[i].Y == expected_walk[i].Y);
+        }
+    }
+}
+
+static void assert_same_areas(const IncrementalSimplifier& incremental)
+{
+    const Visvalingam_Algorithm vis_algo(incremental.line());
+    const std::vector<double>& expected = vis_algo.effective_areas().areas;
+    const std::vector<double>& res = incremental.effective_areas().areas;
+    assert(res.size() == expected.size());
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        assert(res[i] == expected[i]);
+    }
+}
+
+// Random edits, on integer coordinates (ties, repeated points and collinear
+// runs) and on jittered ones, match a full recompute after each one.
+void test_incremental_simplifier()
+{
+    uint32_t state = 12345;
+    for (int grid = 0; grid < 2; ++grid)
+    {
+        const double jitter = grid == 0 ? 0.0 : 0.001;
+        Linestring line;
+        for (int i = 0; i < 2000; ++i)
+        {
+            state = state * 1103515245u + 12345u;
+            line.push_back(Point(i + jitter * (state >> 24),
+                                 (state >> 16) % 7 + jitter * (i % 13)));
+        }
+        IncrementalSimplifier incremental(line);
+        assert(incremental.replayed_count() == line.size() - 2);
+        assert_same_areas(incremental);
+
+        const size_t edit_count = 2000;
+        size_t replayed_count = 0;
+        for (size_t e = 0; e < edit_count; ++e)
+        {
+            state = state * 1103515245u + 12345u;
+            const size_t count = incremental.line().size();
+            // endpoints every so often
+            VertexIndex index = (state >> 8) % count;
+            if (e % 50 == 0)
+            {
+                index = e % 100 == 0 ? 0 : count - 1;
+            }
+            const Point& near = incremental.line()[index];
+            const Point point(near.X + jitter * (state % 17),
+                              (state >> 20) % 7 + jitter * (state % 5));
+            switch (state % 3)
+            {
+            case 0:
+                incremental.insert_vertex(index + (e % 100 == 50), point);
+                break;
+            case 1:
+                incremental.move_vertex(index, point);
+                break;
+            default:
+                incremental.erase_vertex(index);
+                break;
+            }
+            replayed_count += incremental.replayed_count();
+            assert_same_areas(incremental);
+        }
+        // collinear runs split the integer line into short independent
+        // parts: edits only replay their neighbourhood
+        assert(jitter != 0.0 || replayed_count < edit_count * 100);
+
+        Linestring expected;
+        Visvalingam_Algorithm(incremental.line()).simplify(2.0, &expected);
+        Linestring res;
+        incremental.simplify(2.0, &res);
+        assert(res.size() == expected.size());
+        for (size_t i = 0; i < res.size(); ++i)
+        {
+            assert(res[i].X == expected[i].X && res[i].Y == expected[i].Y);
+        }
+    }
+
+    // lines growing from nothing and back
+    IncrementalSimplifier incremental((Linestring()));
+    for (int i = 0; i < 20; ++i)
+    {
+        incremental.insert_vertex(i % 2 == 0 ? 0 : incremental.line().size(),
+                                  Point(i, (i * i) % 5));
+        assert_same_areas(incremental);
+    }
+    while (!incremental.line().empty())
+    {
+        incremental.erase_vertex(incremental.line().size() / 3);
+        assert_same_areas(incremental);
+    }
+}
+
+// Effective areas of 'line' cut in 'chunk_count' chunks as
+// compute_chunked_effective_areas() and OutOfCoreSimplifier cut it,
+// whatever their size.
+static void seamed_areas(const Linestring& line, size_t chunk_count,
+                         std::vector<double>* res)
+{
+    const size_t vertex_count = line.size();
+    res->assign(vertex_count, 0.0);
+    std::vector<NodeIndex> chunk_firsts(chunk_count + 1);
+    for (size_t i = 0; i <= chunk_count; ++i)
+    {
+        chunk_firsts[i] = static_cast<NodeIndex>(
+                (vertex_count - 1) * i / chunk_count);
+    }
+    std::vector<SimplifyWorkspace> workspaces(chunk_count);
+    std::vector<ChunkState> chunks(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        const NodeIndex first = chunk_firsts[i];
+        const NodeIndex count = chunk_firsts[i+1] - first + 1;
+        // links are only kept by the heap
+        assert(count > SMALL_RING_SIZE);
+        workspaces[i].compute_effective_areas(
+                InterleavedView<double>(&line[first].X, count));
+        const std::vector<double>& areas =
+            workspaces[i].effective_areas().areas;
+        std::copy(areas.begin() + 1, areas.end() - 1,
+                  res->begin() + first + 1);
+        chunks[i].areas = &areas[0];
+        chunks[i].prev_vertices = &workspaces[i].prev_vertices()[0];
+        chunks[i].next_vertices = &workspaces[i].next_vertices()[0];
+    }
+    eliminate_chunk_seams(InterleavedView<double>(&line[0].X, vertex_count),
+                          chunk_firsts, chunks, &(*res)[0]);
+}
+
+// A random walk of 'count' steps of up to 1 on either axis.
+static void random_walk(size_t count, uint32_t* state, Linestring* res)
+{
+    double x = 0.0;
+    double y = 0.0;
+    res->clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        *state = *state * 1103515245u + 12345u;
+        x += ((*state >> 16) % 2001) / 1000.0 - 1.0;
+        *state = *state * 1103515245u + 12345u;
+        y += ((*state >> 16) % 2001) / 1000.0 - 1.0;
+        res->push_back(Point(x, y));
+    }
+}
+
+void test_chunked_areas()
+{
+    uint32_t state = 12345;
+    for (int grid = 0; grid < 2; ++grid)
+    {
+        Linestring line;
+        double y = 0.0;
+        for (size_t i = 0; i < 3 * MIN_CHUNK_VERTEX_COUNT + 5; ++i)
+        {
+            state = state * 1103515245u + 12345u;
+            if (grid == 0)
+            {
+                y += ((state >> 16) % 2001) / 1000.0 - 1.0;
+                line.push_back(Point(i + (state >> 28) * 0.1, y));
+            }
+            else
+            {
+                line.push_back(Point(i / 3, (state >> 16) % 7));
+            }
+        }
+        const Visvalingam_Algorithm expected(line);
+        for (size_t thread_count = 1; thread_count <= 3; ++thread_count)
+        {
+            ThreadPool pool(thread_count);
+            std::vector<SimplifyWorkspace> workspaces(pool.size());
+            const Visvalingam_Algorithm chunked(line, &pool, &workspaces);
+            // a single chunk is the whole line's loop
+            std::vector<double> seamed;
+            if (thread_count == 1)
+            {
+                seamed = expected.effective_areas().areas;
+            }
+            else
+            {
+                seamed_areas(line, thread_count, &seamed);
+            }
+            assert(chunked.effective_areas().areas == seamed);
+        }
+    }
+
+    // the seam pass misses a few interleavings: over many short lines in
+    // small chunks, a few areas differ, see chunked_areas.h
+    size_t vertex_count = 0;
+    size_t differing_count = 0;
+    Linestring walk;
+    for (size_t i = 0; i < 400; ++i)
+    {
+        state = state * 1103515245u + 12345u;
+        const size_t chunk_count = 2 + (state >> 16) % 7;
+        const size_t chunk_size = 70 + (state >> 20) % 200;
+        random_walk(chunk_count * chunk_size + 1, &state, &walk);
+        std::vector<double> seamed;
+        seamed_areas(walk, chunk_count, &seamed);
+        const Visvalingam_Algorithm expected(walk);
+        const std::vector<double>& areas = expected.effective_areas().areas;
+        for (size_t v = 0; v < walk.size(); ++v)
+        {
+            differing_count += seamed[v] != areas[v];
+        }
+        vertex_count += walk.size();
+    }
+    assert(differing_count * 2000 < vertex_count);
+}
+
+void test_out_of_core_simplifier()
+{
+    char input_path[] = "/tmp/visvalingam_xy_XXXXXX";
+    const int input_fd = mkstemp(input_path);
+    assert(input_fd >= 0);
+    close(input_fd);
+    char output_path[] = "/tmp/visvalingam_xy_XXXXXX";
+    const int output_fd = mkstemp(output_path);
+    assert(output_fd >= 0);
+    close(output_fd);
+
+    // lines of one to four chunks under a budget of one, each as the seam
+    // pass leaves it over the same chunks
+    uint32_t state = 54321;
+    const double threshold = 2.0;
+    for (size_t chunk_count = 1; chunk_count <= 4; ++chunk_count)
+    {
+        Linestring line;
+        random_walk(chunk_count * MIN_CHUNK_VERTEX_COUNT + 1, &state, &line);
+        FILE* input = fopen(input_path, "wb");
+        assert(input);
+        const size_t written =
+            fwrite(&line[0].X, sizeof(Point), line.size(), input);
+        assert(written == line.size());
+        const int closed = fclose(input);
+        assert(closed == 0);
+
+        std::vector<double> areas;
+        if (chunk_count == 1)
+        {
+            areas = Visvalingam_Algorithm(line).effective_areas().areas;
+        }
+        else
+        {
+            seamed_areas(line, chunk_count, &areas);
+        }
+        Linestring expected_line;
+        for (size_t i = 0; i < line.size(); ++i)
+        {
+            if (i == 0 || i + 1 == line.size() || areas[i] > threshold)
+            {
+                expected_line.push_back(line[i]);
+            }
+        }
+        for (size_t thread_count = 1; thread_count <= 2; ++thread_count)
+        {
+            ThreadPool pool(thread_count);
+            OutOfCoreSimplifier simplifier(1, "/tmp", &pool);
+            const bool simplified =
+                simplifier.simplify(input_path, threshold, output_path);
+            assert(simplified);
+            assert(simplifier.chunk_count() == chunk_count);
+            assert(simplifier.kept_count() == expected_line.size());
+            MappedFile output;
+            const bool mapped = output.open(output_path);
+            assert(mapped);
+            assert(output.size() == expected_line.size() * sizeof(Point));
+            assert(memcmp(output.data(), &expected_line[0].X, output.size())
+                   == 0);
+        }
+    }
+    unlink(input_path);
+    unlink(output_path);
+}
+
 void test_linestring(Linestring* res)
 {
     res->push_back(Point(0,0));
@@ -134,77 +814,2649 @@ void test_linestring(Linestring* res)
     res->push_back(Point(25,0));
 }
 
-void test_basic_visvalingam()
+// Points of 'line' also found in 'border', in order.
+static void border_points(const Linestring& line, const Linestring& border,
+                          Linestring* res)
+{
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        for (size_t j = 0; j < border.size(); ++j)
+        {
+            if (line[i].X == border[j].X && line[i].Y == border[j].Y)
+            {
+                res->push_back(line[i]);
+                break;
+            }
+        }
+    }
+}
+
+void test_shared_arcs()
+{
+    // two squares on either side of a jagged border, the left one with a
+    // hole that a third ring fills, and a ring touching nothing
+    Linestring border;
+    uint32_t state = 777;
+    for (int i = 0; i <= 200; ++i)
+    {
+        state = state * 1103515245u + 12345u;
+        border.push_back(Point(100 + ((state >> 16) % 100) / 10.0, i / 2.0));
+    }
+    Linestring left;
+    left.push_back(Point(0, 100));
+    left.push_back(Point(0, 0));
+    left.insert(left.end(), border.begin(), border.end());
+    left.push_back(Point(0, 100));
+    Linestring right(border.rbegin(), border.rend());
+    right.push_back(Point(200, 0));
+    right.push_back(Point(200, 100));
+    right.push_back(right[0]);
+    Linestring hole;
+    for (int i = 0; i < 80; ++i)
+    {
+        hole.push_back(Point(30 + 10 * cos(i * 0.08), 50 + 10 * sin(i * 0.08)
+                             + (i % 3) * 0.2));
+    }
+    hole.push_back(hole[0]);
+    // the same ring, the other way round from another vertex
+    Linestring island(hole.rbegin() + 10, hole.rend());
+    island.insert(island.end(), hole.rbegin() + 1, hole.rbegin() + 11);
+    Linestring alone;
+    for (int i = 0; i < 90; ++i)
+    {
+        alone.push_back(Point(150 + (i % 2 + 5) * cos(i * 0.07),
+                              150 + (i % 2 + 5) * sin(i * 0.07)));
+    }
+    alone.push_back(alone[0]);
+
+    std::vector<const Linestring*> rings;
+    rings.push_back(&left);
+    rings.push_back(&right);
+    rings.push_back(&hole);
+    rings.push_back(&island);
+    rings.push_back(&alone);
+    SharedArcs arcs(rings);
+    size_t vertex_count = 0;
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        vertex_count += rings[i]->size();
+    }
+    // the border and the hole only once
+    assert(arcs.arc_count() == 7);
+    assert(arcs.arc_vertex_count() + border.size() + hole.size()
+           < vertex_count + 10);
+
+    std::vector<double> thresholds;
+    thresholds.push_back(0.5);
+    thresholds.push_back(4.0);
+    ThreadPool pool(2);
+    std::vector<SimplifyWorkspace> workspaces(pool.size());
+    arcs.simplify(thresholds, &pool, &workspaces);
+    for (size_t level = 0; level < thresholds.size(); ++level)
+    {
+        Linestring res[5];
+        for (size_t i = 0; i < rings.size(); ++i)
+        {
+            arcs.assemble_ring(i, level, &res[i]);
+            assert(res[i].size() >= 4);
+            assert(res[i].front().X == rings[i]->front().X);
+            assert(res[i].back().Y == rings[i]->back().Y);
+        }
+        // both sides keep the same border vertices
+        Linestring left_border;
+        Linestring right_border;
+        border_points(res[0], border, &left_border);
+        // the right ring starts and ends on the border
+        border_points(Linestring(res[1].begin(), res[1].end() - 1), border,
+                      &right_border);
+        assert(left_border.size() == right_border.size());
+        assert(left_border.size() < border.size());
+        for (size_t i = 0; i < left_border.size(); ++i)
+        {
+            const Point& p = right_border[right_border.size() - 1 - i];
+            assert(left_border[i].X == p.X && left_border[i].Y == p.Y);
+        }
+        // so do the hole and the island
+        Linestring hole_points;
+        border_points(res[2], res[3], &hole_points);
+        assert(res[2].size() == res[3].size());
+        assert(hole_points.size() == res[2].size());
+        assert(res[2].size() < hole.size());
+
+        Linestring expected;
+        Visvalingam_Algorithm(alone).simplify(thresholds[level], &expected);
+        assert(res[4].size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            assert(res[4][i].X == expected[i].X
+                   && res[4][i].Y == expected[i].Y);
+        }
+    }
+}
+
+static size_t count_crossings(const Linestring& line)
+{
+    size_t res = 0;
+    for (size_t i = 0; i + 1 < line.size(); ++i)
+    {
+        for (size_t j = i + 1; j + 1 < line.size(); ++j)
+        {
+            if (segments_cross(line[i], line[i+1], line[j], line[j+1]))
+            {
+                ++res;
+            }
+        }
+    }
+    return res;
+}
+
+static size_t count_crossings(const Linestring& a, const Linestring& b)
+{
+    size_t res = 0;
+    for (size_t i = 0; i + 1 < a.size(); ++i)
+    {
+        for (size_t j = 0; j + 1 < b.size(); ++j)
+        {
+            if (segments_cross(a[i], a[i+1], b[j], b[j+1]))
+            {
+                ++res;
+            }
+        }
+    }
+    return res;
+}
+
+void test_prevent_intersections()
+{
+    assert(segments_cross(Point(0,0), Point(2,2), Point(0,2), Point(2,0)));
+    assert(segments_cross(Point(0,0), Point(2,0), Point(1,0), Point(1,1)));
+    assert(!segments_cross(Point(0,0), Point(1,1), Point(1,1), Point(2,0)));
+    assert(!segments_cross(Point(0,0), Point(1,0), Point(0,1), Point(1,1)));
+
+    // a thin band: dropping vertices of the jagged top soon cuts through
+    // the bottom, running just below it
+    const size_t n = 1500;
+    Linestring top;
+    uint32_t state = 1;
+    for (size_t i = 0; i <= n; ++i)
+    {
+        state = state * 1103515245u + 12345u;
+        top.push_back(Point(i, 5 * sin(i * 0.01)
+                               + ((state >> 16) % 1001) / 10000.0 - 0.05));
+    }
+    Linestring ring(top);
+    for (size_t i = n; i-- > 0;)
+    {
+        ring.push_back(Point(i + 0.5, (top[i].Y + top[i+1].Y) / 2 - 0.1));
+    }
+    ring.push_back(ring[0]);
+    assert(count_crossings(ring) == 0);
+
+    SimplifyWorkspace workspace;
+    SimplifyOptions options;
+    Linestring res;
+    Visvalingam_Algorithm::simplify(ring, 10.0, &res, &workspace, options);
+    assert(count_crossings(res) > 0);
+
+    options.prevent_intersections = true;
+    const double thresholds[] = { 0.01, 0.1, 1.0, 10.0 };
+    size_t previous_size = ring.size();
+    for (size_t i = 0; i < sizeof(thresholds) / sizeof(thresholds[0]); ++i)
+    {
+        res.clear();
+        Visvalingam_Algorithm::simplify(ring, thresholds[i], &res,
+                                        &workspace, options);
+        assert(res.size() < previous_size);
+        assert(count_crossings(res) == 0);
+        previous_size = res.size();
+    }
+    // the same band with each top vertex doubled, then joined to the next
+    // by a collinear midpoint: every top vertex is degenerate, yet
+    // dropping them all cuts through the bottom
+    Linestring runs;
+    for (size_t i = 0; i < n; ++i)
+    {
+        runs.push_back(top[i]);
+        runs.push_back(top[i]);
+        runs.push_back(Point((top[i].X + top[i+1].X) / 2,
+                             (top[i].Y + top[i+1].Y) / 2));
+    }
+    runs.insert(runs.end(), ring.begin() + n, ring.end());
+    assert(count_crossings(runs) == 0);
+    const double run_thresholds[] = { 0.0, 1e-9, 1.0 };
+    for (size_t i = 0;
+         i < sizeof(run_thresholds) / sizeof(run_thresholds[0]); ++i)
+    {
+        res.clear();
+        Visvalingam_Algorithm::simplify(runs, run_thresholds[i], &res,
+                                        &workspace, options);
+        assert(res.size() < runs.size());
+        assert(count_crossings(res) == 0);
+    }
+
+    // blocked vertices go back in the queue once a neighbour goes, so the
+    // band still unwinds completely
+    SimplifyStats stats;
+    workspace.set_stats(&stats);
+    workspace.compute_effective_areas(ring, options);
+    workspace.set_stats(NULL);
+    assert(stats.heap_pushes > ring.size() - 2);
+    const std::vector<double>& areas = workspace.effective_areas().areas;
+    assert(std::count(areas.begin(), areas.end(),
+                      std::numeric_limits<double>::infinity()) == 0);
+
+    // the band cut in two along its middle: the top and bottom, each closed
+    // away from the other, run alone, still cross each other
+    Linestring upper(top);
+    upper.push_back(Point(n, 10));
+    upper.push_back(Point(0, 10));
+    upper.push_back(upper[0]);
+    Linestring lower(ring.begin() + n + 1, ring.end() - 1);
+    lower.push_back(Point(0.5, -10));
+    lower.push_back(Point(n - 0.5, -10));
+    lower.push_back(lower[0]);
+    assert(count_crossings(upper, lower) == 0);
+    Linestring upper_res;
+    Linestring lower_res;
+    Visvalingam_Algorithm::simplify(upper, 10.0, &upper_res, &workspace,
+                                    options);
+    Visvalingam_Algorithm::simplify(lower, 10.0, &lower_res, &workspace,
+                                    options);
+    assert(count_crossings(upper_res, lower_res) > 0);
+
+    // through one loop, they do not at any threshold; a single line gets
+    // the same areas either way
+    std::vector<EffectiveAreas> half_areas;
+    const std::vector<const Linestring*> whole(1, &ring);
+    workspace.compute_effective_areas(whole, options, &half_areas);
+    workspace.compute_effective_areas(ring, options);
+    assert(half_areas[0].areas == workspace.effective_areas().areas);
+    std::vector<const Linestring*> halves;
+    halves.push_back(&upper);
+    halves.push_back(&lower);
+    workspace.compute_effective_areas(halves, options, &half_areas);
+    assert(half_areas.size() == 2);
+    assert(half_areas[0].size() == upper.size());
+    assert(half_areas[1].size() == lower.size());
+    const std::vector<double> levels(thresholds, thresholds
+            + sizeof(thresholds) / sizeof(thresholds[0]));
+    std::vector<Linestring> upper_levels;
+    std::vector<Linestring> lower_levels;
+    Visvalingam_Algorithm::simplify(upper, half_areas[0], levels,
+                                    &upper_levels);
+    Visvalingam_Algorithm::simplify(lower, half_areas[1], levels,
+                                    &lower_levels);
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        assert(upper_levels[i].size() < upper.size());
+        assert(lower_levels[i].size() < lower.size());
+        assert(count_crossings(upper_levels[i]) == 0);
+        assert(count_crossings(lower_levels[i]) == 0);
+        assert(count_crossings(upper_levels[i], lower_levels[i]) == 0);
+    }
+
+    // a line without any crossing to prevent loses the same vertices
+    Linestring line;
+    test_linestring(&line);
+    Linestring expected;
+    Visvalingam_Algorithm(line).simplify(30.0, &expected);
+    res.clear();
+    Visvalingam_Algorithm::simplify(line, 30.0, &res, &workspace, options);
+    assert(res.size() == expected.size());
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        assert(res[i].X == expected[i].X && res[i].Y == expected[i].Y);
+    }
+}
+
+void test_basic_visvalingam()
+{
+    Linestring line;
+    test_linestring(&line);
+
+    Visvalingam_Algorithm vis_algo(line);
+    //vis_algo.print_areas();
+}
+
+void test_workspace_reuse()
+{
+    // shrink then grow the workspace: results must match a fresh instance
+    Linestring lines[3];
+    test_linestring(&lines[0]);
+    lines[1].push_back(Point(0,0));
+    lines[1].push_back(Point(1,3));
+    lines[1].push_back(Point(2,-1));
+    lines[1].push_back(Point(0,0));
+    for (int i = 0; i < 40; ++i)
+    {
+        lines[2].push_back(Point(i, (i*i*7) % 11));
+    }
+
+    SimplifyWorkspace workspace;
+    for (size_t i = 0; i < sizeof(lines)/sizeof(lines[0]); ++i)
+    {
+        Linestring expected, res;
+        Visvalingam_Algorithm vis_algo(lines[i]);
+        vis_algo.simplify(1.5, &expected);
+        Visvalingam_Algorithm::simplify(lines[i], 1.5, &res, &workspace);
+        assert(res.size() == expected.size());
+        for (size_t j = 0; j < res.size(); ++j)
+        {
+            assert(res[j].X == expected[j].X && res[j].Y == expected[j].Y);
+        }
+    }
+}
+
+void test_levels_of_detail()
+{
+    Linestring line;
+    for (int i = 0; i < 50; ++i)
+    {
+        line.push_back(Point(i, (i*i*7) % 17));
+    }
+    Visvalingam_Algorithm vis_algo(line);
+
+    std::vector<double> thresholds;
+    thresholds.push_back(4.0);
+    thresholds.push_back(0.5);
+    thresholds.push_back(100.0);
+    thresholds.push_back(2.0);
+    std::vector<Linestring> levels;
+    vis_algo.simplify(thresholds, &levels);
+    assert(levels.size() == thresholds.size());
+
+    SimplifyWorkspace workspace;
+    std::vector<Linestring> workspace_levels;
+    Visvalingam_Algorithm::simplify(line, thresholds, &workspace_levels,
+                                    &workspace);
+    for (size_t i = 0; i < thresholds.size(); ++i)
+    {
+        Linestring expected;
+        vis_algo.simplify(thresholds[i], &expected);
+        assert(levels[i].size() == expected.size());
+        assert(workspace_levels[i].size() == expected.size());
+        for (size_t j = 0; j < expected.size(); ++j)
+        {
+            assert(levels[i][j].X == expected[j].X);
+            assert(levels[i][j].Y == expected[j].Y);
+            assert(workspace_levels[i][j].X == expected[j].X);
+        }
+    }
+}
+
+void test_max_area_threshold()
+{
+    Linestring line;
+    for (int i = 0; i < 200; ++i)
+    {
+        line.push_back(Point(i, (i*i*7) % 23 + (i % 5) * 0.1));
+    }
+    Visvalingam_Algorithm full(line);
+    SimplifyOptions options;
+    options.max_area_threshold = 3.0;
+    Visvalingam_Algorithm bounded(line, options);
+
+    const double thresholds[] = {0.0, 0.5, 1.0, 2.5, 3.0};
+    for (size_t i = 0; i < sizeof(thresholds)/sizeof(thresholds[0]); ++i)
+    {
+        Linestring expected, res;
+        full.simplify(thresholds[i], &expected);
+        bounded.simplify(thresholds[i], &res);
+        assert(res.size() == expected.size());
+        for (size_t j = 0; j < res.size(); ++j)
+        {
+            assert(res[j].X == expected[j].X && res[j].Y == expected[j].Y);
+        }
+    }
+}
+
+void test_radix_queue_areas()
+{
+    Linestring line;
+    for (int i = 0; i < 500; ++i)
+    {
+        line.push_back(Point(i % 37, (i*i*7) % 23 + (i % 5) * 0.1));
+    }
+    SimplifyOptions options;
+    SimplifyOptions radix_options;
+    radix_options.queue = VERTEX_QUEUE_RADIX;
+    const double max_thresholds[] = {
+        std::numeric_limits<double>::infinity(), 3.0};
+    SimplifyWorkspace workspace;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        options.max_area_threshold = max_thresholds[i];
+        radix_options.max_area_threshold = max_thresholds[i];
+        Visvalingam_Algorithm heap_algo(line, options);
+        workspace.compute_effective_areas(line, radix_options);
+        const EffectiveAreas& expected = heap_algo.effective_areas();
+        const EffectiveAreas& res = workspace.effective_areas();
+        assert(res.size() == expected.size());
+        for (size_t j = 0; j < res.size(); ++j)
+        {
+            assert(res.areas[j] == expected.areas[j]);
+        }
+    }
+}
+
+// Effective areas by brute force: every step recomputes the triangles of
+// the vertices left and drops the smallest.
+static void reference_effective_areas(const Linestring& line,
+                                      double max_area_threshold,
+                                      std::vector<double>* res)
+{
+    const size_t n = line.size();
+    res->assign(n, 0.0);
+    // vertices still in the line, and whether each one is being eliminated
+    std::vector<VertexIndex> left;
+    std::vector<bool> queued(n, false);
+    for (size_t i = 0; i < n; ++i)
+    {
+        left.push_back(i);
+        queued[i] = i > 0 && i + 1 < n
+            && effective_area(i, i-1, i+1, line) > NEARLY_ZERO;
+        (*res)[i] = queued[i] ? effective_area(i, i-1, i+1, line) : 0.0;
+    }
+    double min_area = -std::numeric_limits<double>::max();
+    for (;;)
+    {
+        size_t best = left.size();
+        for (size_t j = 1; j + 1 < left.size(); ++j)
+        {
+            if (queued[left[j]] && (best == left.size()
+                                    || (*res)[left[j]] < (*res)[left[best]]))
+            {
+                best = j;
+            }
+        }
+        if (best == left.size())
+        {
+            break;
+        }
+        const VertexIndex curr = left[best];
+        min_area = std::max(min_area, (*res)[curr]);
+        if (min_area > max_area_threshold)
+        {
+            for (size_t j = 0; j < left.size(); ++j)
+            {
+                if (queued[left[j]])
+                {
+                    (*res)[left[j]] = min_area;
+                }
+            }
+            break;
+        }
+        (*res)[curr] = min_area;
+        queued[curr] = false;
+        left.erase(left.begin() + best);
+        for (size_t j = best - 1; j <= best; ++j)
+        {
+            if (queued[left[j]])
+            {
+                (*res)[left[j]] = effective_area(left[j], left[j-1],
+                                                 left[j+1], line);
+            }
+        }
+    }
+}
+
+void test_small_rings()
+{
+    // line sizes around SMALL_RING_SIZE, with repeated points and ties
+    SimplifyWorkspace workspace;
+    const double max_thresholds[] = {
+        std::numeric_limits<double>::infinity(), 3.0};
+    for (size_t size = 0; size <= SMALL_RING_SIZE + 2; ++size)
+    {
+        Linestring line;
+        for (size_t i = 0; i < size; ++i)
+        {
+            line.push_back(Point(i % 13, (i*i*7) % 5 + (i % 3 == 0)));
+        }
+        for (size_t t = 0; t < 2; ++t)
+        {
+            SimplifyOptions options;
+            options.max_area_threshold = max_thresholds[t];
+            std::vector<double> expected;
+            reference_effective_areas(line, max_thresholds[t], &expected);
+            workspace.compute_effective_areas(line, options);
+            const std::vector<double>& res = workspace.effective_areas().areas;
+            assert(res.size() == expected.size());
+            for (size_t j = 0; j < res.size(); ++j)
+            {
+                assert(res[j] == expected[j]);
+            }
+        }
+    }
+}
+
+void test_collinear_prefilter()
+{
+    // a square with a repeated corner and extra points along two sides
+    Linestring line;
+    line.push_back(Point(0,0));
+    line.push_back(Point(1,0));
+    line.push_back(Point(2,0));
+    line.push_back(Point(4,0));
+    line.push_back(Point(4,0));
+    line.push_back(Point(4,2));
+    line.push_back(Point(4,4));
+    line.push_back(Point(0,4));
+    line.push_back(Point(0,4));
+    line.push_back(Point(0,0));
+    SimplifyOptions options;
+    options.collinear_tolerance = 0.0;
+    Visvalingam_Algorithm vis_algo(line, options);
+
+    const VertexIndex expected_indices[] = {0, 4, 6, 8, 9};
+    const EffectiveAreas& areas = vis_algo.effective_areas();
+    assert(areas.size() == sizeof(expected_indices)/sizeof(expected_indices[0]));
+    for (size_t i = 0; i < areas.size(); ++i)
+    {
+        assert(areas.source_index(i) == expected_indices[i]);
+    }
+
+    // the square's corners survive at any threshold below their area
+    Linestring res;
+    vis_algo.simplify(1.0, &res);
+    assert(res.size() == 5);
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        const Point& p = line[expected_indices[i]];
+        assert(res[i].X == p.X && res[i].Y == p.Y);
+    }
+
+    VertexIndex kept[10];
+    SimplifyWorkspace workspace;
+    const size_t kept_count = Visvalingam_Algorithm::simplify_indices(
+            InterleavedView<double>(&line[0].X, line.size()), 1.0, kept,
+            &workspace, options);
+    assert(kept_count == 5);
+    for (size_t i = 0; i < kept_count; ++i)
+    {
+        assert(kept[i] == expected_indices[i]);
+    }
+
+    // a densely sampled circle: each vertex is nearly collinear with its
+    // neighbours, but dropped runs must stay close to their chord
+    Linestring circle;
+    const size_t n = 10000;
+    for (size_t i = 0; i <= n; ++i)
+    {
+        const double angle = 2 * M_PI * i / n;
+        circle.push_back(Point(cos(angle), sin(angle)));
+    }
+    // at 1e-3 runs end at COLLINEAR_RUN_LIMIT, at 1e-7 on the tolerance
+    const double tolerances[] = { 1e-3, 1e-7 };
+    SimplifyWorkspace circle_workspace;
+    for (size_t t = 0; t < sizeof(tolerances) / sizeof(tolerances[0]); ++t)
+    {
+        options.collinear_tolerance = tolerances[t];
+        circle_workspace.compute_effective_areas(circle, options);
+        const EffectiveAreas& circle_areas =
+                circle_workspace.effective_areas();
+        assert(circle_areas.size() > n / (COLLINEAR_RUN_LIMIT + 1)
+               && circle_areas.size() < circle.size());
+        for (size_t i = 0; i + 1 < circle_areas.size(); ++i)
+        {
+            const VertexIndex first = circle_areas.source_index(i);
+            const VertexIndex last = circle_areas.source_index(i+1);
+            assert(last - first <= COLLINEAR_RUN_LIMIT + 1);
+            const Point chord = vector_sub(circle[last], circle[first]);
+            for (VertexIndex j = first + 1; j < last; ++j)
+            {
+                const Point offset = vector_sub(circle[j], circle[first]);
+                assert(0.5 * fabs(cross_product(chord, offset))
+                       <= tolerances[t]);
+            }
+        }
+    }
+}
+
+void test_simplify_stats()
+{
+    Linestring line;
+    for (int i = 0; i < 100; ++i)
+    {
+        line.push_back(Point(i, (i*i*7) % 23));
+    }
+    SimplifyWorkspace workspace;
+    SimplifyStats stats;
+    workspace.set_stats(&stats);
+    workspace.compute_effective_areas(line);
+    assert(stats.line_count == 1);
+    assert(stats.heap_pushes > 0 && stats.heap_pushes <= line.size() - 2);
+    assert(stats.heap_pops == stats.heap_pushes);
+    assert(stats.max_heap_size == stats.heap_pushes);
+    assert(stats.heap_reheaps > 0);
+
+    // an early stop leaves vertices in the heap
+    SimplifyStats bounded_stats;
+    workspace.set_stats(&bounded_stats);
+    SimplifyOptions options;
+    options.max_area_threshold = 1.0;
+    workspace.compute_effective_areas(line, options);
+    assert(bounded_stats.heap_pushes == stats.heap_pushes);
+    assert(bounded_stats.heap_pops < bounded_stats.heap_pushes);
+
+    stats.add(bounded_stats);
+    assert(stats.line_count == 2);
+
+    workspace.set_stats(NULL);
+    workspace.compute_effective_areas(line);
+    assert(stats.line_count == 2);
+}
+
+void test_select_area_cutoff()
+{
+    const double values[] = {5, 1, 3, 3, 8, 3, 0};
+    std::vector<double> areas(values, values + sizeof(values)/sizeof(values[0]));
+
+    AreaCutoff cutoff = select_area_cutoff(&areas, 3);
+    assert(cutoff.area == 3);
+    assert(cutoff.tie_count == 1);
+
+    cutoff = select_area_cutoff(&areas, 5);
+    assert(cutoff.area == 3);
+    assert(cutoff.tie_count == 3);
+
+    cutoff = select_area_cutoff(&areas, 2);
+    assert(cutoff.area == 5);
+    assert(cutoff.tie_count == 1);
+
+    // keeping nothing or everything
+    cutoff = select_area_cutoff(&areas, 0);
+    assert(cutoff.area > 8 && cutoff.tie_count == 0);
+    cutoff = select_area_cutoff(&areas, 7);
+    assert(cutoff.area < 0 && cutoff.tie_count == 0);
+}
+
+void test_simplify_to_count()
+{
+    Linestring line;
+    for (int i = 0; i < 50; ++i)
+    {
+        line.push_back(Point(i, (i*i*7) % 17));
+    }
+    Visvalingam_Algorithm vis_algo(line);
+    SimplifyWorkspace workspace;
+    const size_t counts[] = {4, 10, 25, 50, 80};
+    for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i)
+    {
+        Linestring res, workspace_res;
+        vis_algo.simplify_to_count(counts[i], &res);
+        Visvalingam_Algorithm::simplify_to_count(line, counts[i],
+                                                 &workspace_res, &workspace);
+        assert(res.size() == std::min(counts[i], line.size()));
+        assert(workspace_res.size() == res.size());
+        assert(res.front().X == line.front().X);
+        assert(res.back().X == line.back().X);
+    }
+
+    // the kept vertices are the ones a threshold would keep
+    std::vector<Linestring> levels;
+    std::vector<double> thresholds(1, 2.0);
+    vis_algo.simplify(thresholds, &levels);
+    Linestring res;
+    vis_algo.simplify_to_count(levels[0].size(), &res);
+    assert(res.size() == levels[0].size());
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        assert(res[i].X == levels[0][i].X && res[i].Y == levels[0][i].Y);
+    }
+}
+
+void test_coordinate_views()
+{
+    Linestring line;
+    for (int i = 0; i < 30; ++i)
+    {
+        line.push_back(Point(i, (i*i*5) % 13));
+    }
+    Visvalingam_Algorithm vis_algo(line);
+    Linestring expected;
+    vis_algo.simplify(2.0, &expected);
+    assert(expected.size() >= 4);
+
+    // interleaved XYZ doubles and separate float arrays
+    std::vector<double> xyz;
+    std::vector<float> xs, ys;
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        xyz.push_back(line[i].X);
+        xyz.push_back(line[i].Y);
+        xyz.push_back(-1.0);
+        xs.push_back(static_cast<float>(line[i].X));
+        ys.push_back(static_cast<float>(line[i].Y));
+    }
+
+    SimplifyWorkspace workspace;
+    std::vector<VertexIndex> kept(line.size());
+    size_t kept_count = Visvalingam_Algorithm::simplify_indices(
+            InterleavedView<double>(&xyz[0], line.size(), 3), 2.0,
+            &kept[0], &workspace);
+    assert(kept_count == expected.size());
+    for (size_t i = 0; i < kept_count; ++i)
+    {
+        assert(line[kept[i]].X == expected[i].X);
+        assert(line[kept[i]].Y == expected[i].Y);
+    }
+
+    std::vector<float> out(2 * line.size());
+    kept_count = Visvalingam_Algorithm::simplify_coordinates(
+            SeparateView<float>(&xs[0], &ys[0], line.size()), 2.0,
+            &out[0], 2, &workspace);
+    assert(kept_count == expected.size());
+    for (size_t i = 0; i < kept_count; ++i)
+    {
+        assert(out[2*i] == expected[i].X);
+        assert(out[2*i+1] == expected[i].Y);
+    }
+}
+
+void test_ogr_round_trip()
+{
+    MultiPolygon shape(1);
+    test_linestring(&shape[0].exterior_ring);
+    shape[0].exterior_ring.push_back(shape[0].exterior_ring.front());
+    shape[0].interior_rings.resize(1);
+    shape[0].interior_rings[0].push_back(Point(10,-3));
+    shape[0].interior_rings[0].push_back(Point(11,-3));
+    shape[0].interior_rings[0].push_back(Point(11,-2));
+    shape[0].interior_rings[0].push_back(Point(10,-3));
+
+    OGRMultiPolygon ogr_shape;
+    to_ogr_shape(shape, &ogr_shape);
+    MultiPolygon res;
+    from_ogr_shape(ogr_shape, &res);
+
+    assert(res.size() == 1);
+    assert(res[0].interior_rings.size() == 1);
+    const Linestring* expected[] = { &shape[0].exterior_ring,
+                                     &shape[0].interior_rings[0] };
+    const Linestring* actual[] = { &res[0].exterior_ring,
+                                   &res[0].interior_rings[0] };
+    for (size_t i = 0; i < 2; ++i)
+    {
+        assert(actual[i]->size() == expected[i]->size());
+        for (size_t j = 0; j < expected[i]->size(); ++j)
+        {
+            assert((*actual[i])[j].X == (*expected[i])[j].X);
+            assert((*actual[i])[j].Y == (*expected[i])[j].Y);
+        }
+    }
+
+    // a single polygon keeps its rings too
+    OGRPolygon ogr_polygon;
+    to_ogr_shape(shape[0], &ogr_polygon);
+    assert(ogr_polygon.getNumInteriorRings() == 1);
+    Polygon polygon;
+    from_ogr_shape(ogr_polygon, &polygon);
+    assert(polygon.exterior_ring.size() == shape[0].exterior_ring.size());
+    assert(polygon.interior_rings.size() == 1);
+    assert(polygon.interior_rings[0].size() ==
+           shape[0].interior_rings[0].size());
+}
+
+void test_thread_pool()
+{
+    const size_t task_count = 1000;
+    std::vector<size_t> done(task_count, 0);
+    ThreadPool pool(4);
+    assert(pool.size() == 4);
+    for (size_t i = 0; i < task_count; ++i)
+    {
+        pool.submit([&done, &pool, i](size_t worker_index)
+        {
+            assert(worker_index < pool.size());
+            done[i] += i;
+        });
+    }
+    pool.wait();
+    for (size_t i = 0; i < task_count; ++i)
+    {
+        assert(done[i] == i);
+    }
+
+    // a single thread pool runs tasks inline
+    ThreadPool inline_pool(1);
+    size_t inline_runs = 0;
+    inline_pool.submit([&inline_runs](size_t worker_index)
+    {
+        assert(worker_index == 0);
+        ++inline_runs;
+    });
+    assert(inline_runs == 1);
+    inline_pool.wait();
+}
+
+void test_bounded_queue()
+{
+    // the consumer sees every item in order; the producer never gets more
+    // than the capacity ahead.
+    const int item_count = 1000;
+    BoundedQueue<int> queue(2);
+    std::thread producer([&queue, item_count]()
+    {
+        for (int i = 0; i < item_count; ++i)
+        {
+            queue.push(i);
+        }
+        queue.close();
+    });
+    int expected = 0;
+    int item = -1;
+    while (queue.pop(&item))
+    {
+        assert(item == expected);
+        ++expected;
+    }
+    producer.join();
+    assert(expected == item_count);
+    const bool popped = queue.pop(&item);
+    assert(!popped);
+
+    // once the consumer cancels, the producer's pushes fail and it stops;
+    // what was queued is still drained
+    BoundedQueue<int> cancelled_queue(2);
+    int pushed_count = 0;
+    std::thread stopped_producer([&cancelled_queue, &pushed_count]()
+    {
+        while (cancelled_queue.push(pushed_count))
+        {
+            ++pushed_count;
+        }
+        cancelled_queue.close();
+    });
+    int popped_count = 0;
+    while (popped_count < 10 && cancelled_queue.pop(&item))
+    {
+        ++popped_count;
+    }
+    cancelled_queue.cancel();
+    while (cancelled_queue.pop(&item))
+    {
+        ++popped_count;
+    }
+    stopped_producer.join();
+    assert(cancelled_queue.cancelled());
+    assert(popped_count == pushed_count);
+}
+
+// Reads the first sizeof(Header) bytes of file 'path'.
+template <typename Header>
+static void read_file_header(const char* path, Header* res)
+{
+    FILE* file = fopen(path, "rb");
+    assert(file);
+    const size_t read_count = fread(res, sizeof(Header), 1, file);
+    assert(read_count == 1);
+    fclose(file);
+}
+
+// Overwrites the uint64_t at byte 'offset' of file 'path'.
+static void patch_file(const char* path, uint64_t offset, uint64_t value)
+{
+    FILE* file = fopen(path, "r+b");
+    assert(file);
+    const int seek_res = fseeko(file, offset, SEEK_SET);
+    assert(seek_res == 0);
+    const size_t written = fwrite(&value, sizeof(value), 1, file);
+    assert(written == 1);
+    const int closed = fclose(file);
+    assert(closed == 0);
+}
+
+void test_area_index()
+{
+    // two features: a polygon with a hole, then two polygons
+    MultiPolygon shapes[2];
+    shapes[0].resize(1);
+    for (int i = 0; i < 60; ++i)
+    {
+        shapes[0][0].exterior_ring.push_back(Point(i, (i*i*7) % 13));
+    }
+    shapes[0][0].exterior_ring.push_back(shapes[0][0].exterior_ring[0]);
+    shapes[0][0].interior_rings.resize(1);
+    test_linestring(&shapes[0][0].interior_rings[0]);
+    shapes[1].resize(2);
+    test_linestring(&shapes[1][0].exterior_ring);
+    for (int i = 0; i < 30; ++i)
+    {
+        shapes[1][1].exterior_ring.push_back(Point(i % 7, i * 3 % 11));
+    }
+
+    char path[] = "/tmp/visvalingam_index_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    AreaIndexWriter writer;
+    bool ok = writer.open(path);
+    assert(ok);
+    SimplifyWorkspace workspace;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        std::vector<EffectiveAreas> ring_areas;
+        for (size_t j = 0; j < shapes[i].size(); ++j)
+        {
+            workspace.compute_effective_areas(shapes[i][j].exterior_ring);
+            ring_areas.push_back(workspace.effective_areas());
+            for (size_t k = 0; k < shapes[i][j].interior_rings.size(); ++k)
+            {
+                workspace.compute_effective_areas(
+                        shapes[i][j].interior_rings[k]);
+                ring_areas.push_back(workspace.effective_areas());
+            }
+        }
+        ok = writer.add_feature(100 + i, shapes[i], &ring_areas[0]);
+        assert(ok);
+    }
+    ok = writer.close();
+    assert(ok);
+
+    AreaIndex index;
+    ok = index.open(path);
+    assert(ok);
+    assert(index.feature_count() == 2);
+    const double thresholds[] = {0.0, 0.5, 2.0, 10.0};
+    for (size_t i = 0; i < 2; ++i)
+    {
+        assert(index.feature_fid(i) == static_cast<int64_t>(100 + i));
+        MultiPolygon source;
+        index.source_shape(i, &source);
+        assert(source.size() == shapes[i].size());
+        assert(source[0].exterior_ring.size() ==
+               shapes[i][0].exterior_ring.size());
+
+        for (size_t t = 0; t < sizeof(thresholds)/sizeof(thresholds[0]); ++t)
+        {
+            MultiPolygon res;
+            index.simplify(i, thresholds[t], &res);
+            assert(res.size() == shapes[i].size());
+            for (size_t j = 0; j < res.size(); ++j)
+            {
+                assert(res[j].interior_rings.size() ==
+                       shapes[i][j].interior_rings.size());
+                for (size_t k = 0; k <= res[j].interior_rings.size(); ++k)
+                {
+                    const Linestring& input = k == 0
+                        ? shapes[i][j].exterior_ring
+                        : shapes[i][j].interior_rings[k-1];
+                    const Linestring& actual = k == 0
+                        ? res[j].exterior_ring
+                        : res[j].interior_rings[k-1];
+                    Linestring expected;
+                    Visvalingam_Algorithm vis_algo(input);
+                    vis_algo.simplify(thresholds[t], &expected);
+                    assert(actual.size() == expected.size());
+                    for (size_t v = 0; v < expected.size(); ++v)
+                    {
+                        assert(actual[v].X == expected[v].X);
+                        assert(actual[v].Y == expected[v].Y);
+                    }
+                }
+            }
+        }
+    }
+
+    // corrupt offsets are refused: a polygon without rings, then a ring
+    // reaching past the vertices
+    AreaIndexHeader header;
+    read_file_header(path, &header);
+    patch_file(path, header.polygon_offsets_offset + 8, 0);
+    AreaIndex no_ring;
+    ok = no_ring.open(path);
+    assert(!ok);
+    patch_file(path, header.polygon_offsets_offset + 8, 1);
+    patch_file(path, header.ring_offsets_offset + 8, header.vertex_count + 1);
+    AreaIndex past_end;
+    ok = past_end.open(path);
+    assert(!ok);
+    patch_file(path, header.ring_offsets_offset + 8,
+               shapes[0][0].exterior_ring.size());
+    AreaIndex restored;
+    ok = restored.open(path);
+    assert(ok);
+
+    // a truncated file is refused
+    const int truncated_res = truncate(path, sizeof(AreaIndexHeader) + 8);
+    assert(truncated_res == 0);
+    AreaIndex truncated;
+    ok = truncated.open(path);
+    assert(!ok);
+    unlink(path);
+}
+
+void test_geometry_cache()
+{
+    // a polygon with a hole, then two polygons
+    MultiPolygon shapes[2];
+    shapes[0].resize(1);
+    for (int i = 0; i < 40; ++i)
+    {
+        shapes[0][0].exterior_ring.push_back(Point(i, (i*i*5) % 11));
+    }
+    shapes[0][0].interior_rings.resize(1);
+    test_linestring(&shapes[0][0].interior_rings[0]);
+    shapes[1].resize(2);
+    test_linestring(&shapes[1][0].exterior_ring);
+    for (int i = 0; i < 25; ++i)
+    {
+        shapes[1][1].exterior_ring.push_back(Point(i % 5, i * 3 % 7));
+    }
+
+    char path[] = "/tmp/visvalingam_cache_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    std::vector<std::string> field_names;
+    field_names.push_back("NAME");
+    field_names.push_back("POP");
+    GeometryCacheWriter writer;
+    bool ok = writer.open(path, field_names);
+    assert(ok);
+    std::vector<std::string> values(2);
+    values[0] = "first";
+    values[1] = "";
+    ok = writer.add_feature(7, shapes[0], true, values);
+    assert(ok);
+    values[0] = "second";
+    values[1] = "12345";
+    ok = writer.add_feature(9, shapes[1], false, values);
+    assert(ok);
+    ok = writer.close();
+    assert(ok);
+
+    GeometryCache cache;
+    ok = cache.open(path);
+    assert(ok);
+    assert(cache.feature_count() == 2);
+    assert(cache.feature_fid(0) == 7 && cache.feature_fid(1) == 9);
+    assert(cache.feature_is_polygon(0) && !cache.feature_is_polygon(1));
+    assert(cache.field_count() == 2);
+    assert(cache.field_name(0) == "NAME" && cache.field_name(1) == "POP");
+    assert(cache.field_value(0, 0) == "first");
+    assert(cache.field_value(1, 0) == "");
+    assert(cache.field_value(0, 1) == "second");
+    assert(cache.field_value(1, 1) == "12345");
+
+    SimplifyWorkspace workspace;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        MultiPolygon source;
+        cache.source_shape(i, &source);
+        assert(source.size() == shapes[i].size());
+        for (size_t j = 0; j < source.size(); ++j)
+        {
+            const size_t polygon = cache.first_polygon(i) + j;
+            const size_t first_ring = cache.first_ring(polygon);
+            assert(cache.first_ring(polygon + 1) - first_ring ==
+                   1 + shapes[i][j].interior_rings.size());
+            for (size_t k = 0; k <= shapes[i][j].interior_rings.size(); ++k)
+            {
+                const Linestring& expected = k == 0
+                    ? shapes[i][j].exterior_ring
+                    : shapes[i][j].interior_rings[k-1];
+                const Linestring& copy = k == 0
+                    ? source[j].exterior_ring
+                    : source[j].interior_rings[k-1];
+                assert(copy.size() == expected.size());
+                // the view reads the mapped coordinates in place
+                const InterleavedView<double> view =
+                    cache.ring(first_ring + k);
+                assert(view.size() == expected.size());
+                for (size_t v = 0; v < expected.size(); ++v)
+                {
+                    assert(view[v].X == expected[v].X);
+                    assert(view[v].Y == expected[v].Y);
+                    assert(copy[v].X == expected[v].X);
+                }
+                Linestring from_view;
+                Linestring from_line;
+                Visvalingam_Algorithm::simplify(view, 1.0, &from_view,
+                                                &workspace);
+                Visvalingam_Algorithm::simplify(expected, 1.0, &from_line,
+                                                &workspace);
+                assert(from_view.size() == from_line.size());
+                for (size_t v = 0; v < from_line.size(); ++v)
+                {
+                    assert(from_view[v].X == from_line[v].X);
+                    assert(from_view[v].Y == from_line[v].Y);
+                }
+            }
+        }
+    }
+
+    // corrupt offsets are refused: a polygon without rings, then a string
+    // going backwards
+    GeometryCacheHeader header;
+    read_file_header(path, &header);
+    patch_file(path, header.polygon_offsets_offset + 8, 0);
+    GeometryCache no_ring;
+    ok = no_ring.open(path);
+    assert(!ok);
+    patch_file(path, header.polygon_offsets_offset + 8, 2);
+    patch_file(path, header.string_offsets_offset + 16, 0);
+    GeometryCache backwards;
+    ok = backwards.open(path);
+    assert(!ok);
+    // "NAME" then "first"
+    patch_file(path, header.string_offsets_offset + 16, 9);
+    GeometryCache restored;
+    ok = restored.open(path);
+    assert(ok);
+    assert(restored.field_value(0, 0) == "first");
+
+    // a truncated file is refused
+    const int truncated_res =
+        truncate(path, sizeof(GeometryCacheHeader) + 8);
+    assert(truncated_res == 0);
+    GeometryCache truncated;
+    ok = truncated.open(path);
+    assert(!ok);
+    unlink(path);
+}
+
+bool unit_tests()
+{
+    try
+    {
+        test_vector_sub();
+        test_cross_product();
+        test_heap_sort();
+        test_heap_insert_remove_mix();
+        test_heap_reheap();
+        test_heap_intrusive_reheap();
+        test_heap_dense_index_reheap();
+        test_heap_arity();
+        test_keyed_heap<2>(false);
+        test_keyed_heap<4>(false);
+        test_keyed_heap<8>(false);
+        test_keyed_heap<2>(true);
+        test_keyed_heap<4>(true);
+        test_keyed_heap<8>(true);
+        test_radix_heap();
+        test_triangle_areas();
+        //test_effective_area();
+        test_basic_visvalingam();
+        test_workspace_reuse();
+        test_levels_of_detail();
+        test_max_area_threshold();
+        test_radix_queue_areas();
+        test_small_rings();
+        test_streaming_simplifier();
+        test_incremental_simplifier();
+        test_chunked_areas();
+        test_out_of_core_simplifier();
+        test_shared_arcs();
+        test_prevent_intersections();
+        test_collinear_prefilter();
+        test_simplify_stats();
+        test_select_area_cutoff();
+        test_simplify_to_count();
+        test_coordinate_views();
+        test_ogr_round_trip();
+        test_thread_pool();
+        test_bounded_queue();
+        test_area_index();
+        test_geometry_cache();
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+static std::string to_wkt(const OGRGeometry& ogr_geometry)
+{
+    char* wkt_text = NULL;
+    ogr_geometry.exportToWkt(&wkt_text);
+    std::string res(wkt_text);
+    OGRFree(wkt_text);
+    return res;
+}
+
+// How the vertices to keep are chosen.
+enum SelectionMode
+{
+    SELECT_BY_AREA,             // one level per area threshold
+    SELECT_BY_COUNT,            // at most keep_count vertices per ring
+    SELECT_BY_RATIO,            // keep_ratio of each ring's vertices
+    SELECT_BY_FEATURE_BUDGET    // keep_count vertices over a feature's rings
+};
+
+// Command line settings that shape how features are processed.
+struct RunOptions
+{
+    RunOptions()
+        : print_source(false)
+        , write_dataset(false)
+        , build_index(false)
+        , shared_arcs(false)
+        , split_rings(false)
+        , selection(SELECT_BY_AREA)
+        , area_thresholds(1, 0.002)
+        , keep_count(0)
+        , keep_ratio(1.0)
+    {
+    }
+
+    size_t level_count() const
+    {
+        return selection == SELECT_BY_AREA ? area_thresholds.size() : 1;
+    }
+
+    bool print_source;
+    // keep OGR geometries for a FeatureWriter instead of WKT for stdout
+    bool write_dataset;
+    // only compute full effective areas, for an AreaIndexWriter
+    bool build_index;
+    // simplify borders shared by rings once, see SharedArcs; batches then
+    // hold a whole layer
+    bool shared_arcs;
+    // split rings too large for one thread over the pool, see
+    // compute_chunked_effective_areas(): their areas can differ from one
+    // thread's
+    bool split_rings;
+    SelectionMode selection;
+    // one level of detail per threshold
+    std::vector<double> area_thresholds;
+    size_t keep_count;
+    double keep_ratio;
+    SimplifyOptions simplify_options;
+};
+
+// Features read from a layer, processed in parallel passes (convert,
+// simplify, convert back) and output in read order.
+struct FeatureBatch
+{
+    FeatureBatch() : vertex_count(0) {}
+
+    std::vector<OGRFeature*> features;
+    std::vector<MultiPolygon> shapes;
+    // [feature][level]
+    std::vector<std::vector<MultiPolygon> > simplified;
+    std::vector<std::string> source_wkt;
+    std::vector<std::vector<std::string> > simplified_wkt;
+    // [feature][level], owned until handed to the writer
+    std::vector<std::vector<OGRGeometry*> > simplified_ogr;
+    // when building an index: every ring's areas, in feature, polygon and
+    // ring order
+    std::vector<EffectiveAreas> ring_areas;
+    size_t vertex_count;
+};
+
+// Upper bound on the vertices held by a batch, to keep memory bounded on
+// large inputs while giving the pool enough rings to balance.
+static const size_t BATCH_VERTEX_COUNT = 1 << 22;
+
+// Batches waiting between two pipeline stages (read, simplify, write). Each
+// stage also holds the batch it works on, so memory stays around five
+// batches whatever the input size.
+static const size_t PIPELINE_QUEUE_SIZE = 1;
+
+static size_t count_vertices(const OGRPolygon& ogr_polygon)
+{
+    size_t res = 0;
+    const OGRLinearRing* ogr_exterior = ogr_polygon.getExteriorRing();
+    if (ogr_exterior)
+    {
+        res += ogr_exterior->getNumPoints();
+    }
+    for (int i = 0; i < ogr_polygon.getNumInteriorRings(); ++i)
+    {
+        res += ogr_polygon.getInteriorRing(i)->getNumPoints();
+    }
+    return res;
+}
+
+static size_t count_vertices(const OGRMultiPolygon& ogr_multi_poly)
+{
+    size_t res = 0;
+    for (int i = 0; i < ogr_multi_poly.getNumGeometries(); ++i)
+    {
+        res += count_vertices(
+                *(const OGRPolygon*)ogr_multi_poly.getGeometryRef(i));
+    }
+    return res;
+}
+
+// Reads polygon and multipolygon features until the batch holds
+// 'max_vertex_count' vertices or the layer is exhausted. Returns false if
+// nothing was read.
+static bool read_batch(OGRLayer* layer, size_t max_vertex_count,
+                       FeatureBatch* batch)
+{
+    OGRFeature* feat;
+    while (batch->vertex_count < max_vertex_count
+            && (feat = layer->GetNextFeature()) != NULL)
+    {
+        OGRGeometry* geometry = feat->GetGeometryRef();
+        const OGRwkbGeometryType type =
+            geometry ? wkbFlatten(geometry->getGeometryType()) : wkbUnknown;
+        if (type == wkbPolygon)
+        {
+            batch->vertex_count += count_vertices(*(OGRPolygon*)geometry);
+        }
+        else if (type == wkbMultiPolygon)
+        {
+            batch->vertex_count += count_vertices(*(OGRMultiPolygon*)geometry);
+        }
+        else
+        {
+            OGRFeature::DestroyFeature(feat);
+            continue;
+        }
+        batch->features.push_back(feat);
+    }
+    return !batch->features.empty();
+}
+
+static bool is_polygon(const OGRGeometry& ogr_geometry)
+{
+    return wkbFlatten(ogr_geometry.getGeometryType()) == wkbPolygon;
+}
+
+// Polygons are simplified as multipolygons of one polygon.
+static void from_ogr_geometry(const OGRGeometry& ogr_geometry,
+                              MultiPolygon* res)
+{
+    if (is_polygon(ogr_geometry))
+    {
+        res->resize(1);
+        from_ogr_shape((const OGRPolygon&)ogr_geometry, &(*res)[0]);
+    }
+    else
+    {
+        from_ogr_shape((const OGRMultiPolygon&)ogr_geometry, res);
+    }
+}
+
+// Converts back to the source geometry's type: a Polygon if 'polygon' and
+// the shape still has one polygon, otherwise a MultiPolygon.
+static OGRGeometry* to_ogr_geometry(const MultiPolygon& shape, bool polygon)
+{
+    if (polygon && shape.size() == 1)
+    {
+        OGRPolygon* res = new OGRPolygon();
+        to_ogr_shape(shape[0], res);
+        return res;
+    }
+    OGRMultiPolygon* res = new OGRMultiPolygon();
+    to_ogr_shape(shape, res);
+    return res;
+}
+
+// Ring 0 is the exterior ring, ring i the (i-1)th interior ring.
+static const Linestring& ring_at(const Polygon& poly, size_t ring)
+{
+    return ring == 0 ? poly.exterior_ring : poly.interior_rings[ring-1];
+}
+
+static Linestring& ring_at(Polygon& poly, size_t ring)
+{
+    return ring == 0 ? poly.exterior_ring : poly.interior_rings[ring-1];
+}
+
+struct RingJob
+{
+    const Linestring* input;
+    size_t feature;
+    size_t polygon;
+    size_t ring;
+};
+
+// Orders job indices so that the largest rings come first
+struct RingJobLarger
+{
+    explicit RingJobLarger(const std::vector<RingJob>* jobs) : m_jobs(jobs) {}
+
+    bool operator()(size_t lhs, size_t rhs) const
+    {
+        return (*m_jobs)[lhs].input->size() > (*m_jobs)[rhs].input->size();
+    }
+
+    const std::vector<RingJob>* m_jobs;
+};
+
+static void add_ring_jobs(const MultiPolygon& shape, size_t feature,
+                          size_t level_count,
+                          std::vector<MultiPolygon>* res,
+                          std::vector<RingJob>* jobs)
+{
+    // size the outputs up front: jobs write into them concurrently.
+    res->assign(level_count, MultiPolygon(shape.size()));
+    for (size_t i = 0; i < shape.size(); ++i)
+    {
+        const Polygon& poly = shape[i];
+        for (size_t level = 0; level < level_count; ++level)
+        {
+            (*res)[level][i].interior_rings.resize(poly.interior_rings.size());
+        }
+        for (size_t ring = 0; ring <= poly.interior_rings.size(); ++ring)
+        {
+            RingJob job = { &ring_at(poly, ring), feature, i, ring };
+            jobs->push_back(job);
+        }
+    }
+}
+
+// Simplifies ring 'ring' of polygon 'polygon' into every level of its
+// feature's output 'res'. With a feature budget, only computes the ring's
+// effective areas into 'areas'. 'input' is a Linestring or a coordinate
+// view.
+template <typename PointSequence>
+static void simplify_ring(const PointSequence& input, size_t polygon,
+                          size_t ring, const RunOptions& options,
+                          std::vector<MultiPolygon>* res,
+                          EffectiveAreas* areas, SimplifyWorkspace* workspace)
+{
+    Linestring& first_level = ring_at((*res)[0][polygon], ring);
+    switch (options.selection)
+    {
+    case SELECT_BY_AREA:
+    {
+        std::vector<Linestring> levels;
+        Visvalingam_Algorithm::simplify(input, options.area_thresholds,
+                                        &levels, workspace,
+                                        options.simplify_options);
+        for (size_t level = 0; level < levels.size(); ++level)
+        {
+            ring_at((*res)[level][polygon], ring).swap(levels[level]);
+        }
+        break;
+    }
+    case SELECT_BY_COUNT:
+    {
+        Visvalingam_Algorithm::simplify_to_count(input, options.keep_count,
+                                                 &first_level, workspace,
+                                                 options.simplify_options);
+        break;
+    }
+    case SELECT_BY_RATIO:
+    {
+        const size_t keep_count = static_cast<size_t>(
+                ceil(options.keep_ratio * input.size()));
+        Visvalingam_Algorithm::simplify_to_count(input, keep_count,
+                                                 &first_level, workspace,
+                                                 options.simplify_options);
+        break;
+    }
+    case SELECT_BY_FEATURE_BUDGET:
+    {
+        workspace->compute_effective_areas(input, options.simplify_options);
+        *areas = workspace->effective_areas();
+        break;
+    }
+    }
+}
+
+// Filters ring 'ring' of polygon 'polygon' into every level of its
+// feature's output 'res', given effective areas computed earlier, by
+// another thread or along with the feature's other rings. Not for a
+// feature budget, which needs every ring's areas first.
+template <typename PointSequence>
+static void filter_ring(const PointSequence& input,
+                        const EffectiveAreas& areas, size_t polygon,
+                        size_t ring, const RunOptions& options,
+                        std::vector<MultiPolygon>* res)
+{
+    if (options.selection == SELECT_BY_AREA)
+    {
+        std::vector<Linestring> levels;
+        Visvalingam_Algorithm::simplify(input, areas, options.area_thresholds,
+                                        &levels);
+        for (size_t level = 0; level < levels.size(); ++level)
+        {
+            ring_at((*res)[level][polygon], ring).swap(levels[level]);
+        }
+        return;
+    }
+    assert(options.selection == SELECT_BY_COUNT
+           || options.selection == SELECT_BY_RATIO);
+    const size_t keep_count = options.selection == SELECT_BY_COUNT
+        ? options.keep_count
+        : static_cast<size_t>(ceil(options.keep_ratio * input.size()));
+    std::vector<double> candidate_areas;
+    Visvalingam_Algorithm::append_candidate_areas(areas, &candidate_areas);
+    // endpoints take two of the vertices
+    const AreaCutoff cutoff = select_area_cutoff(
+            &candidate_areas, keep_count > 2 ? keep_count - 2 : 0);
+    size_t ties_left = cutoff.tie_count;
+    Visvalingam_Algorithm::simplify(input, areas, cutoff, &ties_left,
+                                    &ring_at((*res)[0][polygon], ring));
+}
+
+// As run_ring_job(), for a ring whose effective areas 'split_ring' already
+// computed over the whole pool.
+static void filter_split_ring(const RingJob& job,
+                              const Visvalingam_Algorithm& split_ring,
+                              const RunOptions& options, FeatureBatch* batch,
+                              EffectiveAreas* areas)
+{
+    if (options.build_index || options.selection == SELECT_BY_FEATURE_BUDGET)
+    {
+        *areas = split_ring.effective_areas();
+        return;
+    }
+    filter_ring(*job.input, split_ring.effective_areas(), job.polygon,
+                job.ring, options, &batch->simplified[job.feature]);
+}
+
+// Simplifies one ring into every level of its feature's output. With a
+// feature budget or to build an index, only computes the ring's effective
+// areas into 'areas'. 'split_ring', unless NULL, already holds them.
+static void run_ring_job(const RingJob& job, const RunOptions& options,
+                         FeatureBatch* batch, EffectiveAreas* areas,
+                         SimplifyWorkspace* workspace,
+                         const Visvalingam_Algorithm* split_ring)
+{
+    if (split_ring)
+    {
+        filter_split_ring(job, *split_ring, options, batch, areas);
+        return;
+    }
+    if (options.build_index)
+    {
+        // the index serves any threshold: no early termination
+        SimplifyOptions index_options = options.simplify_options;
+        index_options.max_area_threshold =
+            std::numeric_limits<double>::infinity();
+        workspace->compute_effective_areas(*job.input, index_options);
+        *areas = workspace->effective_areas();
+        return;
+    }
+    simplify_ring(*job.input, job.polygon, job.ring, options,
+                  &batch->simplified[job.feature], areas, workspace);
+}
+
+// Settings of an elimination loop over several rings: as those of a
+// single ring, it can stop once past the largest threshold, except to build
+// an index, which serves any threshold.
+static SimplifyOptions joint_simplify_options(const RunOptions& options)
+{
+    SimplifyOptions res = options.simplify_options;
+    if (options.build_index)
+    {
+        res.max_area_threshold = std::numeric_limits<double>::infinity();
+    }
+    else if (options.selection == SELECT_BY_AREA)
+    {
+        res.max_area_threshold = std::min(
+                res.max_area_threshold,
+                *std::max_element(options.area_thresholds.begin(),
+                                  options.area_thresholds.end()));
+    }
+    return res;
+}
+
+// Simplifies the rings of one feature, jobs [first_job, end_job), through a
+// single elimination loop, so that with prevent_intersections they cannot
+// cross each other either. With a feature budget or to build an index,
+// only computes their effective areas into 'areas', one per job.
+static void run_feature_job(const std::vector<RingJob>& jobs,
+                            size_t first_job, size_t end_job,
+                            const RunOptions& options, FeatureBatch* batch,
+                            EffectiveAreas* areas,
+                            SimplifyWorkspace* workspace)
+{
+    std::vector<const Linestring*> rings(end_job - first_job);
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        rings[i] = jobs[first_job + i].input;
+    }
+    std::vector<EffectiveAreas> ring_areas;
+    workspace->compute_effective_areas(rings, joint_simplify_options(options),
+                                       &ring_areas);
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        if (areas)
+        {
+            areas[i] = ring_areas[i];
+        }
+        else
+        {
+            const RingJob& job = jobs[first_job + i];
+            filter_ring(*job.input, ring_areas[i], job.polygon, job.ring,
+                        options, &batch->simplified[job.feature]);
+        }
+    }
+}
+
+// Puts ring 'ring' of 'arcs', that of 'job', back together into every
+// level of its feature's output.
+static void assemble_shared_ring(const RingJob& job, const SharedArcs& arcs,
+                                 size_t ring, FeatureBatch* batch)
+{
+    std::vector<MultiPolygon>& res = batch->simplified[job.feature];
+    for (size_t level = 0; level < res.size(); ++level)
+    {
+        arcs.assemble_ring(ring, level, &ring_at(res[level][job.polygon],
+                                                 job.ring));
+    }
+}
+
+// Area cutoff spreading options.keep_count vertices over rings with the
+// given effective areas.
+static AreaCutoff feature_budget_cutoff(const RunOptions& options,
+                                        const EffectiveAreas* areas,
+                                        size_t ring_count)
+{
+    // endpoints are always kept and come out of the budget first
+    std::vector<double> candidate_areas;
+    size_t endpoint_count = 0;
+    for (size_t i = 0; i < ring_count; ++i)
+    {
+        Visvalingam_Algorithm::append_candidate_areas(areas[i],
+                                                      &candidate_areas);
+        endpoint_count += std::min<size_t>(areas[i].size(), 2);
+    }
+    const size_t interior_count = options.keep_count > endpoint_count
+                                  ? options.keep_count - endpoint_count : 0;
+    return select_area_cutoff(&candidate_areas, interior_count);
+}
+
+// Spreads options.keep_count vertices over the rings of one feature,
+// given their effective areas. Jobs [first_job, end_job) are its rings.
+static void run_feature_budget(const RunOptions& options, FeatureBatch* batch,
+                               const std::vector<RingJob>& jobs,
+                               const std::vector<EffectiveAreas>& areas,
+                               size_t first_job, size_t end_job)
+{
+    const AreaCutoff cutoff = feature_budget_cutoff(
+            options, &areas[first_job], end_job - first_job);
+    size_t ties_left = cutoff.tie_count;
+    for (size_t i = first_job; i < end_job; ++i)
+    {
+        const RingJob& job = jobs[i];
+        MultiPolygon& res = batch->simplified[job.feature][0];
+        Visvalingam_Algorithm::simplify(*job.input, areas[i], cutoff,
+                                        &ties_left,
+                                        &ring_at(res[job.polygon], job.ring));
+    }
+}
+
+// Sums the rings and vertices going into and out of one level of a
+// feature.
+static void count_rings(const MultiPolygon& input, const MultiPolygon& res,
+                        bool count_input, WorkerStats* stats)
+{
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        const Polygon& poly = input[i];
+        for (size_t ring = 0; ring <= poly.interior_rings.size(); ++ring)
+        {
+            const size_t in_size = ring_at(poly, ring).size();
+            const size_t out_size = ring_at(res[i], ring).size();
+            if (count_input)
+            {
+                ++stats->ring_count;
+                stats->vertices_in += in_size;
+                if (in_size < 4)
+                {
+                    ++stats->rings_skipped;
+                }
+            }
+            if (in_size >= 4 && out_size == 0)
+            {
+                ++stats->rings_collapsed;
+            }
+            stats->vertices_out += out_size;
+        }
+    }
+}
+
+// 'stats' is NULL unless statistics were requested.
+static void run_visvalingam(FeatureBatch* batch, const RunOptions& options,
+                            ThreadPool* pool,
+                            std::vector<SimplifyWorkspace>* workspaces,
+                            RunStats* stats)
+{
+    const size_t feature_count = batch->features.size();
+    const size_t level_count = options.level_count();
+    const bool print_source = options.print_source;
+    batch->shapes.resize(feature_count);
+    batch->simplified.resize(feature_count);
+    batch->source_wkt.resize(feature_count);
+    if (options.write_dataset)
+    {
+        batch->simplified_ogr.assign(
+                feature_count, std::vector<OGRGeometry*>(level_count));
+    }
+    else
+    {
+        batch->simplified_wkt.assign(feature_count,
+                                     std::vector<std::string>(level_count));
+    }
+
+    // convert from OGR, one task per feature
+    for (size_t i = 0; i < feature_count; ++i)
+    {
+        pool->submit([batch, print_source, stats, i](size_t worker_index)
+        {
+            WorkerStats* worker_stats =
+                stats ? &stats->worker(worker_index) : NULL;
+            const OGRGeometry& ogr_geometry =
+                *batch->features[i]->GetGeometryRef();
+            if (print_source)
+            {
+                StageTimer timer(worker_stats, STAGE_EXPORT_WKT);
+                batch->source_wkt[i] = to_wkt(ogr_geometry);
+            }
+            StageTimer timer(worker_stats, STAGE_FROM_OGR);
+            from_ogr_geometry(ogr_geometry, &batch->shapes[i]);
+        });
+    }
+    pool->wait();
+
+    // simplify, one task per ring. Large rings go first so they do not end
+    // up running alone at the end of the batch.
+    std::vector<RingJob> jobs;
+    std::vector<size_t> feature_first_job(feature_count + 1);
+    for (size_t i = 0; i < feature_count; ++i)
+    {
+        feature_first_job[i] = jobs.size();
+        add_ring_jobs(batch->shapes[i], i, level_count,
+                      &batch->simplified[i], &jobs);
+    }
+    feature_first_job[feature_count] = jobs.size();
+
+    std::vector<size_t> schedule(jobs.size());
+    for (size_t i = 0; i < schedule.size(); ++i)
+    {
+        schedule[i] = i;
+    }
+    std::stable_sort(schedule.begin(), schedule.end(), RingJobLarger(&jobs));
+
+    // A ring holding more than a thread's share of the batch would end up
+    // running alone: with --split-rings, its elimination loop is split over
+    // the whole pool first instead, see compute_chunked_effective_areas().
+    std::vector<Visvalingam_Algorithm*> split_rings(jobs.size(), NULL);
+    if (options.split_rings && pool->size() > 1 && !options.shared_arcs
+        && options.simplify_options.collinear_tolerance < 0
+        && !options.simplify_options.prevent_intersections)
+    {
+        size_t vertex_count = 0;
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            vertex_count += jobs[i].input->size();
+        }
+        const size_t split_size = std::max(vertex_count / pool->size(),
+                                           2 * MIN_CHUNK_VERTEX_COUNT);
+        for (size_t i = 0; i < schedule.size()
+             && jobs[schedule[i]].input->size() >= split_size; ++i)
+        {
+            split_rings[schedule[i]] = new Visvalingam_Algorithm(
+                    *jobs[schedule[i]].input, pool, workspaces,
+                    options.simplify_options);
+        }
+    }
+
+    // With shared arcs, the rings' arcs are simplified first, once each;
+    // ring jobs then only put them back together.
+    SharedArcs* shared_arcs = NULL;
+    if (options.shared_arcs)
+    {
+        std::vector<const Linestring*> rings(jobs.size());
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            rings[i] = jobs[i].input;
+        }
+        shared_arcs = new SharedArcs(rings);
+        shared_arcs->simplify(options.area_thresholds, pool, workspaces,
+                              options.simplify_options);
+    }
+
+    std::vector<EffectiveAreas> job_areas;
+    if (options.selection == SELECT_BY_FEATURE_BUDGET || options.build_index)
+    {
+        job_areas.resize(jobs.size());
+    }
+    const RunOptions* run_options = &options;
+    const std::vector<RingJob>* ring_jobs = &jobs;
+    std::vector<EffectiveAreas>* areas = &job_areas;
+    const std::vector<Visvalingam_Algorithm*>* splits = &split_rings;
+    const SharedArcs* arcs = shared_arcs;
+    if (options.simplify_options.prevent_intersections)
+    {
+        // rings must not cross the other rings of their feature either:
+        // one task per feature instead
+        for (size_t i = 0; i < feature_count; ++i)
+        {
+            const size_t first_job = feature_first_job[i];
+            const size_t end_job = feature_first_job[i+1];
+            pool->submit([batch, run_options, ring_jobs, areas, workspaces,
+                          stats, first_job, end_job](size_t worker_index)
+            {
+                StageTimer timer(stats ? &stats->worker(worker_index) : NULL,
+                                 STAGE_FILTER);
+                run_feature_job(*ring_jobs, first_job, end_job, *run_options,
+                                batch,
+                                areas->empty() ? NULL : &(*areas)[first_job],
+                                &(*workspaces)[worker_index]);
+            });
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < schedule.size(); ++i)
+        {
+            const size_t job = schedule[i];
+            pool->submit([batch, run_options, ring_jobs, areas, workspaces,
+                          stats, splits, arcs, job](size_t worker_index)
+            {
+                StageTimer timer(stats ? &stats->worker(worker_index) : NULL,
+                                 STAGE_FILTER);
+                if (arcs)
+                {
+                    assemble_shared_ring((*ring_jobs)[job], *arcs, job,
+                                         batch);
+                    return;
+                }
+                run_ring_job((*ring_jobs)[job], *run_options, batch,
+                             areas->empty() ? NULL : &(*areas)[job],
+                             &(*workspaces)[worker_index], (*splits)[job]);
+            });
+        }
+    }
+    pool->wait();
+    for (size_t i = 0; i < split_rings.size(); ++i)
+    {
+        delete split_rings[i];
+    }
+    delete shared_arcs;
+
+    if (options.build_index)
+    {
+        batch->ring_areas.swap(job_areas);
+        return;
+    }
+
+    if (options.selection == SELECT_BY_FEATURE_BUDGET)
+    {
+        // needs every ring's areas: one task per feature
+        for (size_t i = 0; i < feature_count; ++i)
+        {
+            const size_t first_job = feature_first_job[i];
+            const size_t end_job = feature_first_job[i+1];
+            pool->submit([batch, run_options, ring_jobs, areas, stats,
+                          first_job, end_job](size_t worker_index)
+            {
+                StageTimer timer(stats ? &stats->worker(worker_index) : NULL,
+                                 STAGE_FILTER);
+                run_feature_budget(*run_options, batch, *ring_jobs, *areas,
+                                   first_job, end_job);
+            });
+        }
+        pool->wait();
+    }
+
+    // convert back to OGR shape, one task per feature and level
+    for (size_t i = 0; i < feature_count; ++i)
+    {
+        for (size_t level = 0; level < level_count; ++level)
+        {
+            pool->submit([batch, stats, i, level](size_t worker_index)
+            {
+                WorkerStats* worker_stats =
+                    stats ? &stats->worker(worker_index) : NULL;
+                if (worker_stats)
+                {
+                    worker_stats->feature_count += (level == 0);
+                    count_rings(batch->shapes[i], batch->simplified[i][level],
+                                level == 0, worker_stats);
+                }
+                OGRGeometry* ogr_geometry = NULL;
+                {
+                    StageTimer timer(worker_stats, STAGE_TO_OGR);
+                    const OGRGeometry& source =
+                        *batch->features[i]->GetGeometryRef();
+                    ogr_geometry = to_ogr_geometry(
+                            batch->simplified[i][level], is_polygon(source));
+                }
+                if (!batch->simplified_ogr.empty())
+                {
+                    batch->simplified_ogr[i][level] = ogr_geometry;
+                    return;
+                }
+                StageTimer timer(worker_stats, STAGE_EXPORT_WKT);
+                batch->simplified_wkt[i][level] = to_wkt(*ogr_geometry);
+                delete ogr_geometry;
+            });
+        }
+    }
+    pool->wait();
+}
+
+// 'source_wkt' is only printed with options.print_source.
+static void print_feature(const std::string& source_wkt,
+                          const std::vector<std::string>& simplified_wkt,
+                          const RunOptions& options)
+{
+    if (options.print_source)
+    {
+        std::cout << "SOURCE DATA: " << std::endl;
+        std::cout << std::endl << source_wkt << std::endl;
+        std::cout << std::endl;
+    }
+    const size_t level_count = simplified_wkt.size();
+    for (size_t level = 0; level < level_count; ++level)
+    {
+        std::cout << "SIMPLIFIED SHAPE";
+        if (options.selection == SELECT_BY_AREA && level_count > 1)
+        {
+            std::cout << " (area threshold "
+                      << options.area_thresholds[level] << ")";
+        }
+        std::cout << ": " << std::endl;
+        std::cout << std::endl << simplified_wkt[level] << std::endl;
+    }
+}
+
+static void print_batch(const FeatureBatch& batch, const RunOptions& options)
+{
+    for (size_t i = 0; i < batch.features.size(); ++i)
+    {
+        print_feature(batch.source_wkt[i], batch.simplified_wkt[i], options);
+    }
+}
+
+// Appends every feature of the batch, with its rings' areas, to 'writer'.
+static bool index_batch(const FeatureBatch& batch, AreaIndexWriter* writer)
+{
+    const EffectiveAreas* ring_areas =
+        batch.ring_areas.empty() ? NULL : &batch.ring_areas[0];
+    for (size_t i = 0; i < batch.features.size(); ++i)
+    {
+        const MultiPolygon& shape = batch.shapes[i];
+        if (!writer->add_feature(batch.features[i]->GetFID(), shape,
+                                 ring_areas))
+        {
+            return false;
+        }
+        for (size_t j = 0; j < shape.size(); ++j)
+        {
+            ring_areas += 1 + shape[j].interior_rings.size();
+        }
+    }
+    return true;
+}
+
+// Hands every simplified geometry of the batch over to 'writer'.
+static bool write_batch(FeatureBatch* batch, FeatureWriter* writer)
+{
+    bool res = true;
+    writer->begin_batch();
+    for (size_t i = 0; i < batch->features.size() && res; ++i)
+    {
+        std::vector<OGRGeometry*>& levels = batch->simplified_ogr[i];
+        for (size_t level = 0; level < levels.size() && res; ++level)
+        {
+            res = writer->write(batch->features[i], level, levels[level]);
+            levels[level] = NULL;
+        }
+    }
+    return writer->end_batch() && res;
+}
+
+static void destroy_batch(FeatureBatch* batch)
+{
+    for (size_t i = 0; i < batch->features.size(); ++i)
+    {
+        OGRFeature::DestroyFeature(batch->features[i]);
+    }
+    for (size_t i = 0; i < batch->simplified_ogr.size(); ++i)
+    {
+        for (size_t level = 0; level < batch->simplified_ogr[i].size();
+             ++level)
+        {
+            delete batch->simplified_ogr[i][level];
+        }
+    }
+    *batch = FeatureBatch();
+}
+
+typedef BoundedQueue<FeatureBatch*> BatchQueue;
+
+// Pipeline stage: reads the layer into batches.
+static void read_layer(OGRLayer* layer, size_t batch_vertex_count,
+                       BatchQueue* read_queue, WorkerStats* stats)
+{
+    while (true)
+    {
+        FeatureBatch* batch = new FeatureBatch();
+        bool has_features = false;
+        {
+            StageTimer timer(stats, STAGE_READ);
+            has_features = read_batch(layer, batch_vertex_count, batch);
+        }
+        if (!has_features)
+        {
+            delete batch;
+            break;
+        }
+        if (!read_queue->push(batch))
+        {
+            // the writer gave up
+            destroy_batch(batch);
+            delete batch;
+            break;
+        }
+    }
+    read_queue->close();
+}
+
+// Pipeline stage: prints, writes or indexes batches, then frees them.
+// After a write error, 'read_queue' is cancelled so that reading and
+// simplifying stop, and the remaining batches are only freed.
+static void write_batches(BatchQueue* write_queue, BatchQueue* read_queue,
+                          const RunOptions* options, FeatureWriter* writer,
+                          AreaIndexWriter* index_writer, WorkerStats* stats,
+                          bool* write_failed)
+{
+    FeatureBatch* batch = NULL;
+    while (write_queue->pop(&batch))
+    {
+        if (!*write_failed)
+        {
+            StageTimer timer(stats, STAGE_WRITE);
+            if (index_writer)
+            {
+                *write_failed = !index_batch(*batch, index_writer);
+            }
+            else if (writer)
+            {
+                *write_failed = !write_batch(batch, writer);
+            }
+            else
+            {
+                print_batch(*batch, *options);
+            }
+            if (*write_failed)
+            {
+                read_queue->cancel();
+            }
+        }
+        destroy_batch(batch);
+        delete batch;
+    }
+}
+
+// Prints the features of an index built with --build-index at the area
+// thresholds of 'options'. Returns the process exit code.
+static int print_index(const char* path, const RunOptions& options)
+{
+    if (options.selection != SELECT_BY_AREA)
+    {
+        std::cerr << "An index serves area thresholds only" << std::endl;
+        return 1;
+    }
+    AreaIndex index;
+    if (!index.open(path))
+    {
+        return 1;
+    }
+    const size_t level_count = options.area_thresholds.size();
+    std::string source_wkt;
+    std::vector<std::string> simplified_wkt(level_count);
+    MultiPolygon shape;
+    for (size_t i = 0; i < index.feature_count(); ++i)
+    {
+        if (options.print_source)
+        {
+            OGRMultiPolygon ogr_shape;
+            index.source_shape(i, &shape);
+            to_ogr_shape(shape, &ogr_shape);
+            source_wkt = to_wkt(ogr_shape);
+        }
+        for (size_t level = 0; level < level_count; ++level)
+        {
+            OGRMultiPolygon ogr_shape;
+            index.simplify(i, options.area_thresholds[level], &shape);
+            to_ogr_shape(shape, &ogr_shape);
+            simplified_wkt[level] = to_wkt(ogr_shape);
+        }
+        print_feature(source_wkt, simplified_wkt, options);
+    }
+    return 0;
+}
+
+static void print_stream_points(const std::string& track,
+                                const Linestring& points)
+{
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        std::cout << track << ' ' << points[i].X << ' ' << points[i].Y
+                  << '\n';
+    }
+}
+
+// Simplifies the tracks read from 'in', one "TRACK X Y" point per line, as
+// they arrive: each track's vertices are printed in the same format once
+// final. A line holding only a track name ends that track; the others end
+// with the input. Returns the process exit code.
+static int simplify_stream(std::istream& in, const RunOptions& options,
+                           size_t window_size)
+{
+    if (options.selection != SELECT_BY_AREA
+        || options.area_thresholds.size() != 1)
+    {
+        std::cerr << "--stream takes a single area threshold" << std::endl;
+        return 1;
+    }
+    if (window_size < 3)
+    {
+        std::cerr << "--stream needs a window of at least 3 points"
+                  << std::endl;
+        return 1;
+    }
+    std::cout.precision(std::numeric_limits<double>::max_digits10);
+    // tracks in progress, by name; they share one workspace
+    SimplifyWorkspace workspace;
+    std::map<std::string, StreamingSimplifier*> tracks;
+    std::string line;
+    std::string track;
+    Linestring emitted;
+    int res = 0;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        Point point;
+        if (!(fields >> track))
+        {
+            continue;
+        }
+        emitted.clear();
+        std::map<std::string, StreamingSimplifier*>::iterator it =
+            tracks.find(track);
+        if (!(fields >> point.X))
+        {
+            if (it != tracks.end())
+            {
+                it->second->finish(&emitted);
+                delete it->second;
+                tracks.erase(it);
+            }
+        }
+        else if (!(fields >> point.Y))
+        {
+            std::cerr << "Invalid point: " << line << std::endl;
+            res = 1;
+            break;
+        }
+        else
+        {
+            if (it == tracks.end())
+            {
+                it = tracks.insert(std::make_pair(track,
+                        new StreamingSimplifier(options.area_thresholds[0],
+                                                window_size, &workspace,
+                                                options.simplify_options)))
+                     .first;
+            }
+            it->second->push(point, &emitted);
+        }
+        if (!emitted.empty())
+        {
+            print_stream_points(track, emitted);
+            std::cout.flush();
+        }
+    }
+    for (std::map<std::string, StreamingSimplifier*>::iterator it =
+            tracks.begin(); it != tracks.end(); ++it)
+    {
+        emitted.clear();
+        it->second->finish(&emitted);
+        print_stream_points(it->first, emitted);
+        delete it->second;
+    }
+    std::cout.flush();
+    return res;
+}
+
+// Simplifies the X Y doubles of 'input_filename' as a single line, larger
+// than memory, into 'output_filename'. Returns the process exit code.
+static int simplify_out_of_core(const char* input_filename,
+                                const char* output_filename,
+                                const RunOptions& options,
+                                size_t thread_count, size_t ram_budget,
+                                const char* spill_directory)
+{
+    if (options.selection != SELECT_BY_AREA
+        || options.area_thresholds.size() != 1)
+    {
+        std::cerr << "--xy-input takes a single area threshold" << std::endl;
+        return 1;
+    }
+    if (output_filename == NULL)
+    {
+        std::cerr << "--xy-input writes to --xy-output" << std::endl;
+        return 1;
+    }
+    if (options.simplify_options.collinear_tolerance >= 0
+        || options.simplify_options.prevent_intersections)
+    {
+        std::cerr << "--xy-input does not support --collinear-tolerance or "
+                     "--prevent-intersections" << std::endl;
+        return 1;
+    }
+    ThreadPool pool(thread_count);
+    OutOfCoreSimplifier simplifier(
+            ram_budget, spill_directory ? spill_directory : "/tmp", &pool,
+            options.simplify_options);
+    if (!simplifier.simplify(input_filename, options.area_thresholds[0],
+                             output_filename))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// Converts the polygon features of 'filename' into a geometry cache at
+// 'cache_path'. Its fields are those of the first layer; features of other
+// layers get the ones they have by the same name. Returns the process exit
+// code.
+static int import_cache(const char* filename, const char* cache_path,
+                        const char* attribute_filter)
+{
+    OGRRegisterAll();
+    OGRDataSource* datasource = OGRSFDriverRegistrar::Open(filename, FALSE);
+    if (datasource == NULL)
+    {
+        std::cerr << "Open failed for file: " << filename << std::endl;
+        return 1;
+    }
+    std::vector<std::string> field_names;
+    if (datasource->GetLayerCount() > 0)
+    {
+        OGRFeatureDefn* defn = datasource->GetLayer(0)->GetLayerDefn();
+        for (int i = 0; i < defn->GetFieldCount(); ++i)
+        {
+            field_names.push_back(defn->GetFieldDefn(i)->GetNameRef());
+        }
+    }
+
+    GeometryCacheWriter writer;
+    bool failed = !writer.open(cache_path, field_names);
+    std::vector<int> field_indices(field_names.size());
+    std::vector<std::string> field_values(field_names.size());
+    MultiPolygon shape;
+    size_t layer_count = datasource->GetLayerCount();
+    for (size_t i = 0; i < layer_count && !failed; ++i)
+    {
+        OGRLayer* layer = datasource->GetLayer(i);
+        assert(layer);
+        layer->ResetReading();
+        if (attribute_filter
+            && layer->SetAttributeFilter(attribute_filter) != OGRERR_NONE)
+        {
+            std::cerr << "Invalid attribute filter: " << attribute_filter
+                      << std::endl;
+            failed = true;
+            break;
+        }
+        OGRFeatureDefn* defn = layer->GetLayerDefn();
+        for (size_t j = 0; j < field_names.size(); ++j)
+        {
+            field_indices[j] = defn->GetFieldIndex(field_names[j].c_str());
+        }
+        OGRFeature* feat;
+        while (!failed && (feat = layer->GetNextFeature()) != NULL)
+        {
+            OGRGeometry* geometry = feat->GetGeometryRef();
+            const OGRwkbGeometryType type =
+                geometry ? wkbFlatten(geometry->getGeometryType()) : wkbUnknown;
+            if (type == wkbPolygon || type == wkbMultiPolygon)
+            {
+                // from_ogr_shape() appends
+                shape.clear();
+                from_ogr_geometry(*geometry, &shape);
+                for (size_t j = 0; j < field_names.size(); ++j)
+                {
+                    const int index = field_indices[j];
+                    field_values[j] = index >= 0 && feat->IsFieldSet(index)
+                                      ? feat->GetFieldAsString(index) : "";
+                }
+                failed = !writer.add_feature(feat->GetFID(), shape,
+                                             type == wkbPolygon,
+                                             field_values);
+            }
+            OGRFeature::DestroyFeature(feat);
+        }
+    }
+    if (!writer.close() && !failed)
+    {
+        std::cerr << "Cannot write geometry cache: " << cache_path
+                  << std::endl;
+        failed = true;
+    }
+    OGRDataSource::DestroyDataSource(datasource);
+    return failed ? 1 : 0;
+}
+
+// Simplifies one feature of 'cache' into every level of 'res', reading its
+// rings in place.
+static void simplify_cached_feature(const GeometryCache& cache,
+                                    size_t feature, const RunOptions& options,
+                                    SimplifyWorkspace* workspace,
+                                    std::vector<MultiPolygon>* res)
 {
-    Linestring line;
-    test_linestring(&line);
+    const size_t first_polygon = cache.first_polygon(feature);
+    const size_t polygon_count =
+        cache.first_polygon(feature + 1) - first_polygon;
+    res->assign(options.level_count(), MultiPolygon(polygon_count));
+    // every ring, in polygon and ring order
+    std::vector<InterleavedView<double> > rings;
+    for (size_t i = 0; i < polygon_count; ++i)
+    {
+        const size_t first_ring = cache.first_ring(first_polygon + i);
+        const size_t ring_count =
+            cache.first_ring(first_polygon + i + 1) - first_ring;
+        for (size_t level = 0; level < res->size(); ++level)
+        {
+            (*res)[level][i].interior_rings.resize(ring_count - 1);
+        }
+        for (size_t ring = 0; ring < ring_count; ++ring)
+        {
+            rings.push_back(cache.ring(first_ring + ring));
+        }
+    }
+    // with a feature budget or prevent_intersections: every ring's areas
+    std::vector<EffectiveAreas> ring_areas;
+    const bool joint = options.simplify_options.prevent_intersections;
+    if (joint)
+    {
+        // through one loop, see run_feature_job()
+        std::vector<const InterleavedView<double>*> lines(rings.size());
+        for (size_t i = 0; i < rings.size(); ++i)
+        {
+            lines[i] = &rings[i];
+        }
+        workspace->compute_effective_areas(lines,
+                                           joint_simplify_options(options),
+                                           &ring_areas);
+    }
+    else if (options.selection == SELECT_BY_FEATURE_BUDGET)
+    {
+        ring_areas.resize(rings.size());
+    }
+    size_t ring_index = 0;
+    for (size_t i = 0; i < polygon_count; ++i)
+    {
+        const size_t ring_count = (*res)[0][i].interior_rings.size() + 1;
+        for (size_t ring = 0; ring < ring_count; ++ring, ++ring_index)
+        {
+            if (!joint)
+            {
+                simplify_ring(rings[ring_index], i, ring, options, res,
+                              ring_areas.empty() ? NULL
+                                                 : &ring_areas[ring_index],
+                              workspace);
+            }
+            else if (options.selection != SELECT_BY_FEATURE_BUDGET)
+            {
+                filter_ring(rings[ring_index], ring_areas[ring_index], i,
+                            ring, options, res);
+            }
+        }
+    }
+    if (options.selection != SELECT_BY_FEATURE_BUDGET)
+    {
+        return;
+    }
 
-    Visvalingam_Algorithm vis_algo(line);
-    //vis_algo.print_areas();
+    const AreaCutoff cutoff = feature_budget_cutoff(
+            options, ring_areas.empty() ? NULL : &ring_areas[0],
+            ring_areas.size());
+    size_t ties_left = cutoff.tie_count;
+    ring_index = 0;
+    for (size_t i = 0; i < polygon_count; ++i)
+    {
+        const size_t first_ring = cache.first_ring(first_polygon + i);
+        const size_t ring_count =
+            cache.first_ring(first_polygon + i + 1) - first_ring;
+        for (size_t ring = 0; ring < ring_count; ++ring, ++ring_index)
+        {
+            Visvalingam_Algorithm::simplify(cache.ring(first_ring + ring),
+                                            ring_areas[ring_index], cutoff,
+                                            &ties_left,
+                                            &ring_at((*res)[0][i], ring));
+        }
+    }
 }
 
-bool unit_tests()
+// Prints the features of a cache written with --import-cache, one pool
+// task per feature, about BATCH_VERTEX_COUNT vertices at a time. Output is
+// the same as when reading the source with --file. Returns the process
+// exit code.
+static int print_cache(const char* path, const RunOptions& options,
+                       ThreadPool* pool,
+                       std::vector<SimplifyWorkspace>* workspaces,
+                       RunStats* stats)
 {
-    try
+    if (options.write_dataset || options.build_index || options.shared_arcs)
     {
-        test_vector_sub();
-        test_cross_product();
-        test_heap_sort();
-        test_heap_insert_remove_mix();
-        test_heap_reheap();
-        //test_effective_area();
-        test_basic_visvalingam();
-        return true;
+        std::cerr << "--output, --build-index and --shared-arcs read from "
+                     "--file" << std::endl;
+        return 1;
     }
-    catch (...)
+    GeometryCache cache;
+    if (!cache.open(path))
     {
-        return false;
+        return 1;
+    }
+    const size_t level_count = options.level_count();
+    std::vector<std::string> source_wkt;
+    std::vector<std::vector<std::string> > simplified_wkt;
+    const GeometryCache* features = &cache;
+    const RunOptions* run_options = &options;
+    std::vector<std::string>* sources = &source_wkt;
+    std::vector<std::vector<std::string> >* simplified = &simplified_wkt;
+    size_t first = 0;
+    while (first < cache.feature_count())
+    {
+        size_t end = first;
+        size_t vertex_count = 0;
+        while (end < cache.feature_count()
+               && vertex_count < BATCH_VERTEX_COUNT)
+        {
+            ++end;
+            vertex_count +=
+                cache.first_vertex(cache.first_ring(cache.first_polygon(end)))
+                - cache.first_vertex(
+                        cache.first_ring(cache.first_polygon(end - 1)));
+        }
+        source_wkt.assign(end - first, std::string());
+        simplified_wkt.assign(end - first,
+                              std::vector<std::string>(level_count));
+        for (size_t i = first; i < end; ++i)
+        {
+            pool->submit([features, run_options, workspaces, stats, sources,
+                          simplified, first, i](size_t worker_index)
+            {
+                WorkerStats* worker_stats =
+                    stats ? &stats->worker(worker_index) : NULL;
+                std::vector<MultiPolygon> levels;
+                {
+                    StageTimer timer(worker_stats, STAGE_FILTER);
+                    simplify_cached_feature(*features, i, *run_options,
+                                            &(*workspaces)[worker_index],
+                                            &levels);
+                }
+                const bool polygon = features->feature_is_polygon(i);
+                // the source is only copied out of the cache when needed
+                MultiPolygon source;
+                if (run_options->print_source || worker_stats)
+                {
+                    features->source_shape(i, &source);
+                }
+                if (run_options->print_source)
+                {
+                    StageTimer timer(worker_stats, STAGE_EXPORT_WKT);
+                    OGRGeometry* ogr_source = to_ogr_geometry(source, polygon);
+                    (*sources)[i - first] = to_wkt(*ogr_source);
+                    delete ogr_source;
+                }
+                if (worker_stats)
+                {
+                    ++worker_stats->feature_count;
+                }
+                for (size_t level = 0; level < levels.size(); ++level)
+                {
+                    if (worker_stats)
+                    {
+                        count_rings(source, levels[level], level == 0,
+                                    worker_stats);
+                    }
+                    OGRGeometry* ogr_geometry = NULL;
+                    {
+                        StageTimer timer(worker_stats, STAGE_TO_OGR);
+                        ogr_geometry = to_ogr_geometry(levels[level], polygon);
+                    }
+                    StageTimer timer(worker_stats, STAGE_EXPORT_WKT);
+                    (*simplified)[i - first][level] = to_wkt(*ogr_geometry);
+                    delete ogr_geometry;
+                }
+            });
+        }
+        pool->wait();
+
+        StageTimer timer(stats ? &stats->writer() : NULL, STAGE_WRITE);
+        for (size_t i = 0; i < end - first; ++i)
+        {
+            print_feature(source_wkt[i], simplified_wkt[i], options);
+        }
+        first = end;
     }
+    return 0;
 }
 
-static void print_wkt(const OGRMultiPolygon& ogr_multi_poly)
+// Points the elimination loop counters of each workspace at its worker's
+// statistics.
+static void attach_stats(RunStats* stats,
+                         std::vector<SimplifyWorkspace>* workspaces)
 {
-    char* wkt_text = NULL;
-    ogr_multi_poly.exportToWkt(&wkt_text);
-    std::cout << std::endl << wkt_text << std::endl;
-    OGRFree(wkt_text);
+    for (size_t i = 0; i < workspaces->size(); ++i)
+    {
+        (*workspaces)[i].set_stats(&stats->worker(i).simplify);
+    }
 }
 
-static void run_visvalingam(const Linestring& shape, Linestring* res)
+// Reports 'stats', if any, as requested on the command line. Returns false
+// if the JSON file cannot be written.
+static bool report_stats(RunStats* stats,
+                         std::chrono::steady_clock::time_point start,
+                         bool print_stats, const char* stats_json_filename)
 {
-    Visvalingam_Algorithm vis_algo(shape);
-    Linestring simplified_linestring;
-    vis_algo.simplify(0.002, res);
+    if (stats == NULL)
+    {
+        return true;
+    }
+    stats->set_wall_ns(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    if (print_stats)
+    {
+        // stdout carries the shapes
+        stats->print(std::cerr);
+    }
+    if (stats_json_filename)
+    {
+        std::ofstream json_file(stats_json_filename);
+        if (!json_file)
+        {
+            std::cerr << "Cannot write statistics to: "
+                      << stats_json_filename << std::endl;
+            return false;
+        }
+        stats->print_json(json_file);
+    }
+    return true;
 }
 
-static void run_visvalingam(const MultiPolygon& shape)
+// Default --ram-budget: elimination state of ~30M vertices.
+static const size_t DEFAULT_RAM_BUDGET = size_t(1) << 30;
+
+// Parses a comma separated list of numbers, e.g.: "0.001,0.01,0.1".
+static bool parse_thresholds(const char* text, std::vector<double>* res)
 {
-    MultiPolygon res;
-    for (size_t i = 0; i < shape.size(); ++i)
+    res->clear();
+    while (true)
     {
-        const Polygon& poly = shape[i];
-        res.push_back(Polygon());
-        run_visvalingam(poly.exterior_ring, &res.back().exterior_ring);
-        for (size_t j = 0; j < poly.interior_rings.size(); ++j)
+        char* end = NULL;
+        double value = strtod(text, &end);
+        if (end == text || value < 0)
+        {
+            return false;
+        }
+        res->push_back(value);
+        if (*end == '\0')
         {
-            res.back().interior_rings.push_back(Linestring());
-            run_visvalingam(poly.interior_rings[j], &res.back().interior_rings.back());
+            return true;
         }
+        if (*end != ',')
+        {
+            return false;
+        }
+        text = end + 1;
     }
+}
 
-    // convert back to OGR shape
-    OGRMultiPolygon ogr_multipolygon;
-    to_ogr_shape(res, &ogr_multipolygon);
-    std::cout << "SIMPLIFIED SHAPE: " << std::endl;
-    print_wkt(ogr_multipolygon);
+// Parses a positive count, e.g.: "8".
+static bool parse_count(const char* text, size_t* res)
+{
+    // strtoul() would take "-1" as ULONG_MAX
+    if (*text < '0' || *text > '9')
+    {
+        return false;
+    }
+    errno = 0;
+    char* end = NULL;
+    const unsigned long value = strtoul(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value < 1)
+    {
+        return false;
+    }
+    *res = value;
+    return true;
 }
 
+// Parses a fraction in (0, 1], e.g.: "0.25".
+static bool parse_ratio(const char* text, double* res)
+{
+    char* end = NULL;
+    const double value = strtod(text, &end);
+    if (end == text || *end != '\0' || !(value > 0.0 && value <= 1.0))
+    {
+        return false;
+    }
+    *res = value;
+    return true;
+}
 
 int main(int argc, char **argv)
 {
     bool run_unit_tests = false;
-    bool print_source = false;
+    RunOptions options;
     const char* filename = NULL;
+    size_t thread_count = 1;
+    const char* attribute_filter = NULL;
+    const char* output_filename = NULL;
+    const char* output_format = "GPKG";
+    const char* build_index_filename = NULL;
+    const char* index_filename = NULL;
+    const char* import_cache_filename = NULL;
+    const char* cache_filename = NULL;
+    bool print_stats = false;
+    const char* stats_json_filename = NULL;
+    size_t stream_window = 0;
+    const char* xy_input_filename = NULL;
+    const char* xy_output_filename = NULL;
+    size_t ram_budget = DEFAULT_RAM_BUDGET;
+    const char* spill_directory = getenv("TMPDIR");
     for (int i=1; i < argc; ++i)
     {
         if (strcmp(argv[i], "--check") == 0)
@@ -218,7 +3470,178 @@ int main(int argc, char **argv)
         }
         else if (strcmp(argv[i], "--dump-source") == 0)
         {
-            print_source = true;
+            options.print_source = true;
+        }
+        else if ((strcmp(argv[i], "--threshold") == 0
+                  || strcmp(argv[i], "--thresholds") == 0) && (i+1) < argc)
+        {
+            ++i;
+            options.selection = SELECT_BY_AREA;
+            if (!parse_thresholds(argv[i], &options.area_thresholds))
+            {
+                std::cerr << "Invalid area thresholds: " << argv[i]
+                          << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--keep-count") == 0 && (i+1) < argc)
+        {
+            ++i;
+            options.selection = SELECT_BY_COUNT;
+            if (!parse_count(argv[i], &options.keep_count))
+            {
+                std::cerr << "Invalid vertex count: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--keep-ratio") == 0 && (i+1) < argc)
+        {
+            ++i;
+            options.selection = SELECT_BY_RATIO;
+            if (!parse_ratio(argv[i], &options.keep_ratio))
+            {
+                std::cerr << "Invalid keep ratio, expected 0 < R <= 1: "
+                          << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--vertex-budget") == 0 && (i+1) < argc)
+        {
+            ++i;
+            options.selection = SELECT_BY_FEATURE_BUDGET;
+            if (!parse_count(argv[i], &options.keep_count))
+            {
+                std::cerr << "Invalid vertex budget: " << argv[i]
+                          << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--collinear-tolerance") == 0
+                 && (i+1) < argc)
+        {
+            ++i;
+            options.simplify_options.collinear_tolerance = atof(argv[i]);
+        }
+        else if (strcmp(argv[i], "--prevent-intersections") == 0)
+        {
+            options.simplify_options.prevent_intersections = true;
+        }
+        else if (strcmp(argv[i], "--queue") == 0 && (i+1) < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "radix") == 0)
+            {
+                options.simplify_options.queue = VERTEX_QUEUE_RADIX;
+            }
+            else if (strcmp(argv[i], "heap") == 0)
+            {
+                options.simplify_options.queue = VERTEX_QUEUE_HEAP;
+            }
+            else
+            {
+                std::cerr << "Unknown queue: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--where") == 0 && (i+1) < argc)
+        {
+            ++i;
+            attribute_filter = argv[i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && (i+1) < argc)
+        {
+            ++i;
+            output_filename = argv[i];
+            options.write_dataset = true;
+        }
+        else if (strcmp(argv[i], "--format") == 0 && (i+1) < argc)
+        {
+            ++i;
+            output_format = argv[i];
+        }
+        else if (strcmp(argv[i], "--build-index") == 0 && (i+1) < argc)
+        {
+            ++i;
+            build_index_filename = argv[i];
+            options.build_index = true;
+        }
+        else if (strcmp(argv[i], "--index") == 0 && (i+1) < argc)
+        {
+            ++i;
+            index_filename = argv[i];
+        }
+        else if (strcmp(argv[i], "--import-cache") == 0 && (i+1) < argc)
+        {
+            ++i;
+            import_cache_filename = argv[i];
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && (i+1) < argc)
+        {
+            ++i;
+            cache_filename = argv[i];
+        }
+        else if (strcmp(argv[i], "--stream") == 0 && (i+1) < argc)
+        {
+            ++i;
+            if (!parse_count(argv[i], &stream_window))
+            {
+                std::cerr << "Invalid stream window: " << argv[i]
+                          << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--xy-input") == 0 && (i+1) < argc)
+        {
+            ++i;
+            xy_input_filename = argv[i];
+        }
+        else if (strcmp(argv[i], "--xy-output") == 0 && (i+1) < argc)
+        {
+            ++i;
+            xy_output_filename = argv[i];
+        }
+        else if (strcmp(argv[i], "--ram-budget") == 0 && (i+1) < argc)
+        {
+            ++i;
+            // in megabytes
+            if (!parse_count(argv[i], &ram_budget)
+                || ram_budget > (std::numeric_limits<size_t>::max() >> 20))
+            {
+                std::cerr << "Invalid RAM budget: " << argv[i] << std::endl;
+                return 1;
+            }
+            ram_budget <<= 20;
+        }
+        else if (strcmp(argv[i], "--spill-dir") == 0 && (i+1) < argc)
+        {
+            ++i;
+            spill_directory = argv[i];
+        }
+        else if (strcmp(argv[i], "--shared-arcs") == 0)
+        {
+            options.shared_arcs = true;
+        }
+        else if (strcmp(argv[i], "--split-rings") == 0)
+        {
+            options.split_rings = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            print_stats = true;
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0 && (i+1) < argc)
+        {
+            ++i;
+            stats_json_filename = argv[i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && (i+1) < argc)
+        {
+            ++i;
+            if (!parse_count(argv[i], &thread_count))
+            {
+                std::cerr << "Invalid thread count: " << argv[i] << std::endl;
+                return 1;
+            }
         }
     }
 
@@ -236,6 +3659,70 @@ int main(int argc, char **argv)
         }
     }
 
+    if (index_filename != NULL)
+    {
+        return print_index(index_filename, options);
+    }
+
+    if (stream_window != 0)
+    {
+        return simplify_stream(std::cin, options, stream_window);
+    }
+
+    if (xy_input_filename != NULL)
+    {
+        return simplify_out_of_core(xy_input_filename, xy_output_filename,
+                                    options, thread_count, ram_budget,
+                                    spill_directory);
+    }
+
+    if (import_cache_filename != NULL)
+    {
+        if (filename == NULL)
+        {
+            std::cerr << "--import-cache reads from --file" << std::endl;
+            return 1;
+        }
+        return import_cache(filename, import_cache_filename,
+                            attribute_filter);
+    }
+
+    if (cache_filename != NULL)
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        ThreadPool pool(thread_count);
+        std::vector<SimplifyWorkspace> workspaces(pool.size());
+        RunStats run_stats(pool.size());
+        RunStats* stats = NULL;
+        if (print_stats || stats_json_filename)
+        {
+            stats = &run_stats;
+            attach_stats(stats, &workspaces);
+        }
+        if (print_cache(cache_filename, options, &pool, &workspaces, stats)
+            != 0)
+        {
+            return 1;
+        }
+        return report_stats(stats, start, print_stats, stats_json_filename)
+               ? 0 : 1;
+    }
+
+    if (options.shared_arcs
+        && (options.selection != SELECT_BY_AREA || options.build_index))
+    {
+        std::cerr << "--shared-arcs only simplifies by area thresholds"
+                  << std::endl;
+        return 1;
+    }
+    if (options.shared_arcs && options.simplify_options.prevent_intersections)
+    {
+        std::cerr << "--shared-arcs does not support --prevent-intersections"
+                  << std::endl;
+        return 1;
+    }
+
     if (filename != NULL)
     {
         // Parse shape files via OGR: http://gdal.org/ogr/index.html
@@ -248,51 +3735,110 @@ int main(int argc, char **argv)
             return 1;
         }
 
+        FeatureWriter writer;
+        AreaIndexWriter index_writer;
+        if (build_index_filename)
+        {
+            if (!index_writer.open(build_index_filename))
+            {
+                OGRDataSource::DestroyDataSource(datasource);
+                return 1;
+            }
+        }
+        else if (output_filename
+                 && !writer.open(output_filename, output_format))
+        {
+            OGRDataSource::DestroyDataSource(datasource);
+            return 1;
+        }
+
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        ThreadPool pool(thread_count);
+        // one per worker so buffers are only allocated for the largest ring
+        std::vector<SimplifyWorkspace> workspaces(pool.size());
+
+        // statistics cost nothing beyond a NULL test unless requested
+        RunStats run_stats(pool.size());
+        RunStats* stats = NULL;
+        WorkerStats* reader_stats = NULL;
+        WorkerStats* writer_stats = NULL;
+        if (print_stats || stats_json_filename)
+        {
+            stats = &run_stats;
+            reader_stats = &run_stats.reader();
+            writer_stats = &run_stats.writer();
+            attach_stats(stats, &workspaces);
+        }
+
+        bool failed = false;
         size_t layer_count = datasource->GetLayerCount();
-        for (size_t i=0; i < layer_count; ++i)
+        for (size_t i=0; i < layer_count && !failed; ++i)
         {
             OGRLayer* layer = datasource->GetLayer(i);
             assert(layer);
             layer->ResetReading();
-            layer->SetAttributeFilter("NAME LIKE 'united states%'");
-
-            OGRFeature* feat;
-            while ((feat = layer->GetNextFeature()) != NULL)
+            if (attribute_filter
+                && layer->SetAttributeFilter(attribute_filter) != OGRERR_NONE)
             {
-                OGRGeometry* geometry = feat->GetGeometryRef();
-                if (geometry == NULL)
-                {
-                    continue;
-                }
-                switch (geometry->getGeometryType())
-                {
-                case wkbMultiPolygon:
-                {
-                    OGRMultiPolygon* ogr_multi_poly = (OGRMultiPolygon*)geometry;
-
-                    if (print_source)
-                    {
-                        std::cout << "SOURCE DATA: " << std::endl;
-                        print_wkt(*ogr_multi_poly);
-                        std::cout << std::endl;
-                    }
-
-                    MultiPolygon multi_poly;
-                    from_ogr_shape(*ogr_multi_poly, &multi_poly);
-
-                    run_visvalingam(multi_poly);
-                    break;
-                }
+                std::cerr << "Invalid attribute filter: " << attribute_filter
+                          << std::endl;
+                failed = true;
+                break;
+            }
+            if (output_filename && !build_index_filename
+                && !writer.begin_layer(layer, options.level_count()))
+            {
+                failed = true;
+                break;
+            }
 
-                default:
+            // reading and writing run on their own threads, overlapping
+            // with the pool simplifying the batch in between.
+            BatchQueue read_queue(PIPELINE_QUEUE_SIZE);
+            BatchQueue write_queue(PIPELINE_QUEUE_SIZE);
+            // shared borders are only found within a batch
+            const size_t batch_vertex_count = options.shared_arcs
+                ? std::numeric_limits<size_t>::max() : BATCH_VERTEX_COUNT;
+            std::thread reader(read_layer, layer, batch_vertex_count,
+                               &read_queue, reader_stats);
+            std::thread batch_writer(
+                    write_batches, &write_queue, &read_queue, &options,
+                    output_filename ? &writer : NULL,
+                    build_index_filename ? &index_writer : NULL,
+                    writer_stats, &failed);
+            FeatureBatch* batch = NULL;
+            while (read_queue.pop(&batch))
+            {
+                // batches left after a write error are only freed
+                if (!read_queue.cancelled())
                 {
-                    break;
+                    run_visvalingam(batch, options, &pool, &workspaces,
+                                    stats);
                 }
-                }
-                OGRFeature::DestroyFeature(feat);
+                write_queue.push(batch);
             }
+            write_queue.close();
+            reader.join();
+            batch_writer.join();
+        }
+        writer.close();
+        if (build_index_filename && !index_writer.close())
+        {
+            std::cerr << "Cannot write index: " << build_index_filename
+                      << std::endl;
+            failed = true;
         }
         OGRDataSource::DestroyDataSource(datasource);
+        if (failed)
+        {
+            return 1;
+        }
+
+        if (!report_stats(stats, start, print_stats, stats_json_filename))
+        {
+            return 1;
+        }
     }
 	return 0;
 }
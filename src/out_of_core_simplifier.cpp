@@ -0,0 +1,256 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "out_of_core_simplifier.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "chunked_areas.h"
+#include "thread_pool.h"
+
+// Output is written through a buffer of this many vertices.
+static const size_t OUTPUT_BUFFER_VERTEX_COUNT = 1 << 16;
+
+SpillFile::SpillFile()
+    : m_data(NULL)
+    , m_size(0)
+{
+}
+
+SpillFile::~SpillFile()
+{
+    close();
+}
+
+bool SpillFile::open(const char* directory, size_t size)
+{
+    close();
+    std::string path = std::string(directory) + "/visvalingam_spill_XXXXXX";
+    std::vector<char> path_buffer(path.begin(), path.end());
+    path_buffer.push_back('\0');
+    const int fd = mkstemp(&path_buffer[0]);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // the pages stay reachable through the mapping only, and go with it
+    unlink(&path_buffer[0]);
+    if (size > 0)
+    {
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fd, 0);
+        if (data == MAP_FAILED)
+        {
+            ::close(fd);
+            return false;
+        }
+        m_data = static_cast<char*>(data);
+        m_size = size;
+    }
+    ::close(fd);
+    return true;
+}
+
+void SpillFile::close()
+{
+    if (m_data)
+    {
+        munmap(m_data, m_size);
+    }
+    m_data = NULL;
+    m_size = 0;
+}
+
+OutOfCoreSimplifier::OutOfCoreSimplifier(size_t ram_budget,
+                                         const char* spill_directory,
+                                         ThreadPool* pool,
+                                         const SimplifyOptions& options)
+    : m_ram_budget(ram_budget)
+    , m_spill_directory(spill_directory)
+    , m_pool(pool)
+    , m_options(options)
+    , m_workspaces(pool->size())
+    , m_chunk_count(0)
+    , m_kept_count(0)
+{
+    assert(options.collinear_tolerance < 0);
+    assert(!options.prevent_intersections);
+}
+
+void OutOfCoreSimplifier::compute_effective_areas(
+        const InterleavedView<double>& input, double area_threshold,
+        double* areas, NodeIndex* prev_vertices, NodeIndex* next_vertices)
+{
+    const size_t vertex_count = input.size();
+    const size_t chunk_vertex_count = std::max(
+            MIN_CHUNK_VERTEX_COUNT,
+            m_ram_budget / (m_pool->size() * ELIMINATION_BYTES_PER_VERTEX));
+    m_chunk_count = std::max<size_t>(
+            1, (vertex_count - 1 + chunk_vertex_count - 1) /
+               chunk_vertex_count);
+
+    SimplifyOptions chunk_options = m_options;
+    if (m_chunk_count == 1)
+    {
+        // no seam pass: elimination can stop at the threshold
+        chunk_options.max_area_threshold =
+            std::min(m_options.max_area_threshold, area_threshold);
+        SimplifyWorkspace& workspace = m_workspaces[0];
+        workspace.compute_effective_areas(input, chunk_options);
+        const std::vector<double>& line_areas =
+            workspace.effective_areas().areas;
+        std::copy(line_areas.begin(), line_areas.end(), areas);
+        return;
+    }
+    chunk_options.max_area_threshold =
+        std::numeric_limits<double>::infinity();
+
+    std::vector<NodeIndex> chunk_firsts(m_chunk_count + 1);
+    for (size_t i = 0; i <= m_chunk_count; ++i)
+    {
+        chunk_firsts[i] = static_cast<NodeIndex>(
+                (vertex_count - 1) * i / m_chunk_count);
+    }
+    // chunks spill their areas and links, indexed from their first vertex,
+    // at their place in the line; ends are left to the seam pass
+    const InterleavedView<double>* line = &input;
+    const SimplifyOptions* line_options = &chunk_options;
+    std::vector<SimplifyWorkspace>* workspaces = &m_workspaces;
+    const std::vector<NodeIndex>* firsts = &chunk_firsts;
+    for (size_t i = 0; i < m_chunk_count; ++i)
+    {
+        m_pool->submit([line, line_options, workspaces, firsts, areas,
+                        prev_vertices, next_vertices, i](size_t worker_index)
+        {
+            const NodeIndex first = (*firsts)[i];
+            const NodeIndex count = (*firsts)[i+1] - first + 1;
+            assert(count > SMALL_RING_SIZE);
+            SimplifyWorkspace& workspace = (*workspaces)[worker_index];
+            workspace.compute_effective_areas(
+                    InterleavedView<double>(line->data() + 2 * first, count),
+                    *line_options);
+            const std::vector<double>& chunk_areas =
+                workspace.effective_areas().areas;
+            std::copy(chunk_areas.begin() + 1, chunk_areas.end() - 1,
+                      areas + first + 1);
+            const std::vector<NodeIndex>& chunk_prev =
+                workspace.prev_vertices();
+            const std::vector<NodeIndex>& chunk_next =
+                workspace.next_vertices();
+            std::copy(chunk_prev.begin() + 1, chunk_prev.end() - 1,
+                      prev_vertices + first + 1);
+            std::copy(chunk_next.begin() + 1, chunk_next.end() - 1,
+                      next_vertices + first + 1);
+        });
+    }
+    m_pool->wait();
+
+    std::vector<ChunkState> chunks(m_chunk_count);
+    for (size_t i = 0; i < m_chunk_count; ++i)
+    {
+        const NodeIndex first = chunk_firsts[i];
+        chunks[i].areas = areas + first;
+        chunks[i].prev_vertices = prev_vertices + first;
+        chunks[i].next_vertices = next_vertices + first;
+    }
+    eliminate_chunk_seams(input, chunk_firsts, chunks, areas);
+}
+
+bool OutOfCoreSimplifier::simplify(const char* input_path,
+                                   double area_threshold,
+                                   const char* output_path)
+{
+    m_chunk_count = 0;
+    m_kept_count = 0;
+    MappedFile input_file;
+    if (!input_file.open(input_path))
+    {
+        std::cerr << "Cannot map " << input_path << ": " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    const size_t vertex_size = 2 * sizeof(double);
+    if (input_file.size() % vertex_size != 0)
+    {
+        std::cerr << input_path << " does not hold X Y double pairs"
+                  << std::endl;
+        return false;
+    }
+    const size_t vertex_count = input_file.size() / vertex_size;
+    if (vertex_count > std::numeric_limits<NodeIndex>::max())
+    {
+        std::cerr << input_path << " holds more vertices than a line can"
+                  << std::endl;
+        return false;
+    }
+    const double* xy = reinterpret_cast<const double*>(input_file.data());
+
+    SpillFile spill;
+    if (vertex_count > 2)
+    {
+        const size_t spill_size =
+            vertex_count * (sizeof(double) + 2 * sizeof(NodeIndex));
+        if (!spill.open(m_spill_directory.c_str(), spill_size))
+        {
+            std::cerr << "Cannot spill to " << m_spill_directory << ": "
+                      << strerror(errno) << std::endl;
+            return false;
+        }
+        double* areas = reinterpret_cast<double*>(spill.data());
+        NodeIndex* prev_vertices =
+            reinterpret_cast<NodeIndex*>(areas + vertex_count);
+        NodeIndex* next_vertices = prev_vertices + vertex_count;
+        compute_effective_areas(InterleavedView<double>(xy, vertex_count),
+                                area_threshold, areas, prev_vertices,
+                                next_vertices);
+    }
+
+    FILE* output_file = fopen(output_path, "wb");
+    if (output_file == NULL)
+    {
+        std::cerr << "Cannot open " << output_path << ": " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    const double* areas = reinterpret_cast<const double*>(spill.data());
+    std::vector<double> buffer;
+    buffer.reserve(2 * OUTPUT_BUFFER_VERTEX_COUNT);
+    bool failed = false;
+    for (size_t i = 0; i < vertex_count && !failed; ++i)
+    {
+        const bool endpoint = i == 0 || i + 1 == vertex_count;
+        if (!endpoint && areas[i] <= area_threshold)
+        {
+            continue;
+        }
+        buffer.push_back(xy[2 * i]);
+        buffer.push_back(xy[2 * i + 1]);
+        ++m_kept_count;
+        if (buffer.size() == buffer.capacity() || i + 1 == vertex_count)
+        {
+            failed = fwrite(&buffer[0], sizeof(double), buffer.size(),
+                            output_file) != buffer.size();
+            buffer.clear();
+        }
+    }
+    failed = fclose(output_file) != 0 || failed;
+    if (failed)
+    {
+        std::cerr << "Cannot write " << output_path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef OUT_OF_CORE_SIMPLIFIER_H
+#define OUT_OF_CORE_SIMPLIFIER_H
+
+#include <string>
+#include <vector>
+#include "geo_types.h"
+#include "visvalingam_algorithm.h"
+#include "area_index.h"
+
+class ThreadPool;
+
+// Bytes of elimination state per vertex held in memory while a chunk runs:
+// prev/next links, the area, the heap entry and the heap position.
+static const size_t ELIMINATION_BYTES_PER_VERTEX = 36;
+
+// Read-write mapping of an unlinked temporary file: memory the kernel
+// writes back to disk and drops under pressure instead of swapping it.
+class SpillFile
+{
+public:
+    SpillFile();
+    ~SpillFile();
+
+    // Returns false, with errno set, if a file of 'size' bytes cannot be
+    // created in 'directory' and mapped.
+    bool open(const char* directory, size_t size);
+    void close();
+
+    char* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    SpillFile(const SpillFile& other);
+    SpillFile& operator=(const SpillFile& other);
+
+    char* m_data;
+    size_t m_size;
+};
+
+// Simplifies a line larger than memory, e.g.: a lidar-derived contour of
+// billions of vertices. Input and output files hold X Y doubles,
+// interleaved, in native byte order.
+//
+// The input is memory-mapped and goes through the elimination loop in
+// chunks as large as the RAM budget allows, each with its ends pinned.
+// Their effective areas and links spill to an unlinked file, 16 bytes per
+// vertex, for eliminate_chunk_seams() to read
+// around the chunk ends. Kept vertices are then written out in one
+// sequential pass. As with compute_chunked_effective_areas(), a few
+// effective areas can differ from those of Visvalingam_Algorithm, and so
+// which vertices are kept.
+//
+// Memory holds the elimination state of one chunk per worker,
+// ELIMINATION_BYTES_PER_VERTEX each, and the seam pass over a few
+// thousand vertices; coordinates and spilled state are file pages the
+// kernel can drop. Lines hold less than 2^32 vertices.
+class OutOfCoreSimplifier
+{
+public:
+    // Keeps the elimination state within about 'ram_budget' bytes, but
+    // never less than MIN_CHUNK_VERTEX_COUNT vertices per worker of 'pool'
+    // (not owned). Spills to 'spill_directory'. Neither the collinear
+    // pre-filter nor prevent_intersections is supported.
+    OutOfCoreSimplifier(size_t ram_budget, const char* spill_directory,
+                        ThreadPool* pool,
+                        const SimplifyOptions& options = SimplifyOptions());
+
+    // Writes the vertices of the line in 'input_path' whose effective area
+    // is above 'area_threshold', endpoints included, to 'output_path'.
+    // Returns false, reporting on stderr, if a file cannot be mapped or
+    // written.
+    bool simplify(const char* input_path, double area_threshold,
+                  const char* output_path);
+
+    // Chunks the last line was cut into.
+    size_t chunk_count() const
+    {
+        return m_chunk_count;
+    }
+
+    // Vertices written for the last line.
+    size_t kept_count() const
+    {
+        return m_kept_count;
+    }
+
+private:
+    OutOfCoreSimplifier(const OutOfCoreSimplifier& other);
+    OutOfCoreSimplifier& operator=(const OutOfCoreSimplifier& other);
+
+    void compute_effective_areas(const InterleavedView<double>& input,
+                                 double area_threshold, double* areas,
+                                 NodeIndex* prev_vertices,
+                                 NodeIndex* next_vertices);
+
+    size_t m_ram_budget;
+    std::string m_spill_directory;
+    ThreadPool* m_pool;
+    SimplifyOptions m_options;
+    // one per worker, reused from chunk to chunk
+    std::vector<SimplifyWorkspace> m_workspaces;
+    size_t m_chunk_count;
+    size_t m_kept_count;
+};
+
+#endif // OUT_OF_CORE_SIMPLIFIER_H
@@ -0,0 +1,271 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef RADIX_HEAP_HPP
+#define RADIX_HEAP_HPP
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include "heap.hpp"
+
+// Monotone priority queue of dense node indices in [0, fixed_size), keyed
+// on non-negative doubles, with the same interface and pop order as
+// KeyedHeap: smallest key first, ties broken on the node index.
+//
+// Non-negative doubles order like their bit patterns, so keys are bucketed
+// by the highest bit where they differ from the last key popped: bucket b
+// holds keys sharing their top 64 - b bits with it. Popping from an empty
+// front refills it from the lowest non-empty bucket, whose entries then
+// all move to lower buckets: every entry moves at most 64 times, whatever
+// the number of updates in between, so operations are O(1) amortized
+// instead of O(log n).
+//
+// This relies on keys mostly arriving at or above the last key popped, as
+// Visvalingam's clamped effective areas do. The few that do not, e.g.: a
+// neighbour whose triangle shrank below the current area, go to a small
+// KeyedHeap popped first, as do the keys equal to the last one popped so
+// that their ties are broken on the node index.
+template <typename Node>
+class RadixHeap
+{
+public:
+    explicit RadixHeap(size_t fixed_size)
+    :
+    m_buckets(BUCKET_COUNT),
+    m_nonempty_buckets(0),
+    m_locations(),
+    m_front(0),
+    m_last_key(0.0),
+    m_size(0)
+    {
+        reset(fixed_size);
+    }
+
+    /** reset empties the queue and makes room for fixed_size elements.
+     *  Storage only ever grows, as with Heap::reset().
+     */
+    void reset(size_t fixed_size)
+    {
+        for (size_t b = 0; b < BUCKET_COUNT; ++b)
+        {
+            m_buckets[b].clear();
+        }
+        m_nonempty_buckets = 0;
+        m_locations.assign(fixed_size, Location());
+        m_front.reset(fixed_size);
+        m_last_key = 0.0;
+        m_size = 0;
+    }
+
+    void insert(Node node, double key)
+    {
+        assert(key >= 0.0);
+        assert(!contains(node));
+        ++m_size;
+        push(node, key);
+    }
+
+    /** As KeyedHeap's: insert() already is O(1), so heapify() has nothing
+     *  left to do.
+     */
+    void push_unordered(Node node, double key)
+    {
+        insert(node, key);
+    }
+
+    void heapify()
+    {
+    }
+
+    Node pop()
+    {
+        assert(!empty());
+        if (m_front.empty())
+        {
+            refill_front();
+        }
+        --m_size;
+        const Node res = m_front.pop();
+        m_locations[res].bucket = NOT_QUEUED;
+        return res;
+    }
+
+    /** update gives node a new key. */
+    void update(Node node, double key)
+    {
+        assert(key >= 0.0);
+        remove(node);
+        push(node, key);
+    }
+
+    bool contains(Node node) const
+    {
+        return m_locations[node].bucket != NOT_QUEUED;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /** for_each_node calls f(node) on every node queued, in no order. */
+    template <typename Function>
+    void for_each_node(Function f) const
+    {
+        m_front.for_each_node(f);
+        for (size_t b = 1; b < BUCKET_COUNT; ++b)
+        {
+            for (size_t i = 0; i < m_buckets[b].size(); ++i)
+            {
+                f(m_buckets[b][i].node);
+            }
+        }
+    }
+
+    void clear()
+    {
+        for (size_t b = 1; b < BUCKET_COUNT; ++b)
+        {
+            for (size_t i = 0; i < m_buckets[b].size(); ++i)
+            {
+                m_locations[m_buckets[b][i].node].bucket = NOT_QUEUED;
+            }
+            m_buckets[b].clear();
+        }
+        m_front.for_each_node([this](Node node)
+        {
+            m_locations[node].bucket = NOT_QUEUED;
+        });
+        m_front.clear();
+        m_nonempty_buckets = 0;
+        m_size = 0;
+    }
+
+private:
+    RadixHeap(const RadixHeap& other);
+    RadixHeap& operator=(const RadixHeap& other);
+
+    // bucket 0 is the front, a KeyedHeap: m_buckets[0] stays empty
+    static const size_t BUCKET_COUNT = 65;
+    static const uint32_t FRONT = 0;
+    static const uint32_t NOT_QUEUED = ~uint32_t(0);
+
+    struct Entry
+    {
+        double key;
+        Node node;
+    };
+
+    struct Location
+    {
+        Location() : bucket(NOT_QUEUED), position(0) {}
+
+        uint32_t bucket;
+        uint32_t position;
+    };
+
+    static uint64_t key_bits(double key)
+    {
+        uint64_t res;
+        memcpy(&res, &key, sizeof(res));
+        return res;
+    }
+
+    uint32_t bucket_index(double key) const
+    {
+        if (key <= m_last_key)
+        {
+            return FRONT;
+        }
+        return 64 - __builtin_clzll(key_bits(key) ^ key_bits(m_last_key));
+    }
+
+    void push(Node node, double key)
+    {
+        const uint32_t b = bucket_index(key);
+        Location& location = m_locations[node];
+        location.bucket = b;
+        if (b == FRONT)
+        {
+            m_front.insert(node, key);
+            return;
+        }
+        location.position = static_cast<uint32_t>(m_buckets[b].size());
+        const Entry entry = { key, node };
+        m_buckets[b].push_back(entry);
+        m_nonempty_buckets |= uint64_t(1) << (b - 1);
+    }
+
+    void remove(Node node)
+    {
+        const Location location = m_locations[node];
+        assert(location.bucket != NOT_QUEUED);
+        m_locations[node].bucket = NOT_QUEUED;
+        if (location.bucket == FRONT)
+        {
+            m_front.remove(node);
+            return;
+        }
+        // the bucket's last entry fills the hole
+        std::vector<Entry>& bucket = m_buckets[location.bucket];
+        if (location.position + 1 != bucket.size())
+        {
+            bucket[location.position] = bucket.back();
+            m_locations[bucket[location.position].node].position =
+                location.position;
+        }
+        bucket.pop_back();
+        if (bucket.empty())
+        {
+            m_nonempty_buckets &= ~(uint64_t(1) << (location.bucket - 1));
+        }
+    }
+
+    // Moves the lowest non-empty bucket's minimum key and its ties to the
+    // front, and the rest of that bucket to lower buckets.
+    void refill_front()
+    {
+        assert(m_nonempty_buckets != 0);
+        const uint32_t b = 1 + __builtin_ctzll(m_nonempty_buckets);
+        std::vector<Entry>& bucket = m_buckets[b];
+        double min_key = bucket[0].key;
+        for (size_t i = 1; i < bucket.size(); ++i)
+        {
+            min_key = std::min(min_key, bucket[i].key);
+        }
+        m_last_key = min_key;
+        // entries only move to lower buckets, so 'bucket' is never pushed
+        // to while walked
+        m_nonempty_buckets &= ~(uint64_t(1) << (b - 1));
+        for (size_t i = 0; i < bucket.size(); ++i)
+        {
+            push(bucket[i].node, bucket[i].key);
+        }
+        bucket.clear();
+    }
+
+    std::vector<std::vector<Entry> > m_buckets;
+    // bit b - 1 set when bucket b has entries
+    uint64_t m_nonempty_buckets;
+    std::vector<Location> m_locations;
+    KeyedHeap<double, Node> m_front;
+    double m_last_key;
+    size_t m_size;
+};
+
+template <typename Node>
+const size_t RadixHeap<Node>::BUCKET_COUNT;
+template <typename Node>
+const uint32_t RadixHeap<Node>::FRONT;
+template <typename Node>
+const uint32_t RadixHeap<Node>::NOT_QUEUED;
+
+#endif // RADIX_HEAP_HPP
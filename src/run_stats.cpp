@@ -0,0 +1,189 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "run_stats.h"
+#include <cstring>
+#include <iomanip>
+
+static const char* STAGE_NAMES[STAGE_COUNT] =
+{
+    "read",
+    "from_ogr",
+    "effective_areas",
+    "filter",
+    "to_ogr",
+    "export_wkt",
+    "write"
+};
+
+WorkerStats::WorkerStats()
+    : feature_count(0)
+    , ring_count(0)
+    , rings_skipped(0)
+    , rings_collapsed(0)
+    , vertices_in(0)
+    , vertices_out(0)
+    , simplify()
+{
+    memset(stage_ns, 0, sizeof(stage_ns));
+}
+
+void WorkerStats::add(const WorkerStats& other)
+{
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+    {
+        stage_ns[i] += other.stage_ns[i];
+    }
+    feature_count += other.feature_count;
+    ring_count += other.ring_count;
+    rings_skipped += other.rings_skipped;
+    rings_collapsed += other.rings_collapsed;
+    vertices_in += other.vertices_in;
+    vertices_out += other.vertices_out;
+    simplify.add(other.simplify);
+}
+
+static uint64_t stage_ns(const WorkerStats& stats, size_t stage)
+{
+    const uint64_t elimination_ns = stats.simplify.elimination_ns;
+    switch (stage)
+    {
+    case STAGE_EFFECTIVE_AREAS:
+        return elimination_ns;
+    case STAGE_FILTER:
+        return stats.stage_ns[stage] > elimination_ns
+               ? stats.stage_ns[stage] - elimination_ns : 0;
+    default:
+        return stats.stage_ns[stage];
+    }
+}
+
+static double to_ms(uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+static const char* thread_name(size_t index, size_t thread_count)
+{
+    if (index + 2 < thread_count)
+    {
+        return "worker";
+    }
+    return index + 2 == thread_count ? "reader" : "writer";
+}
+
+RunStats::RunStats(size_t worker_count)
+    : m_workers(worker_count + 2)
+    , m_wall_ns(0)
+{
+}
+
+WorkerStats RunStats::total() const
+{
+    WorkerStats res;
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        res.add(m_workers[i]);
+    }
+    return res;
+}
+
+void RunStats::print(std::ostream& out) const
+{
+    const WorkerStats sum = total();
+    out << std::fixed << std::setprecision(3);
+    out << "wall time: " << to_ms(m_wall_ns) << " ms" << std::endl;
+    out << "stage times (ms, summed over threads):" << std::endl;
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+    {
+        out << "  " << std::left << std::setw(16) << STAGE_NAMES[i]
+            << std::right << std::setw(12) << to_ms(stage_ns(sum, i))
+            << std::endl;
+    }
+    out << "features: " << sum.feature_count << std::endl;
+    out << "rings: " << sum.ring_count << " (skipped " << sum.rings_skipped
+        << ", collapsed " << sum.rings_collapsed << ")" << std::endl;
+    out << "vertices: " << sum.vertices_in << " in, " << sum.vertices_out
+        << " out" << std::endl;
+    out << "heap: " << sum.simplify.heap_pushes << " pushes, "
+        << sum.simplify.heap_pops << " pops, "
+        << sum.simplify.heap_reheaps << " reheaps, max size "
+        << sum.simplify.max_heap_size << std::endl;
+    out << "per thread (ms):" << std::endl;
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        const WorkerStats& worker = m_workers[i];
+        uint64_t busy_ns = 0;
+        for (size_t j = 0; j < STAGE_COUNT; ++j)
+        {
+            busy_ns += stage_ns(worker, j);
+        }
+        out << "  " << thread_name(i, m_workers.size());
+        if (i + 2 < m_workers.size())
+        {
+            out << " " << i;
+        }
+        out << ": busy " << to_ms(busy_ns) << ", effective_areas "
+            << to_ms(stage_ns(worker, STAGE_EFFECTIVE_AREAS)) << ", lines "
+            << worker.simplify.line_count << std::endl;
+    }
+}
+
+static void print_json_counters(std::ostream& out, const WorkerStats& stats,
+                                const char* indent)
+{
+    out << indent << "\"stage_ms\": {";
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+    {
+        out << (i ? ", " : "") << "\"" << STAGE_NAMES[i] << "\": "
+            << to_ms(stage_ns(stats, i));
+    }
+    out << "}," << std::endl;
+    out << indent << "\"features\": " << stats.feature_count << ","
+        << std::endl;
+    out << indent << "\"rings\": " << stats.ring_count << "," << std::endl;
+    out << indent << "\"rings_skipped\": " << stats.rings_skipped << ","
+        << std::endl;
+    out << indent << "\"rings_collapsed\": " << stats.rings_collapsed << ","
+        << std::endl;
+    out << indent << "\"vertices_in\": " << stats.vertices_in << ","
+        << std::endl;
+    out << indent << "\"vertices_out\": " << stats.vertices_out << ","
+        << std::endl;
+    out << indent << "\"lines\": " << stats.simplify.line_count << ","
+        << std::endl;
+    out << indent << "\"heap_pushes\": " << stats.simplify.heap_pushes << ","
+        << std::endl;
+    out << indent << "\"heap_pops\": " << stats.simplify.heap_pops << ","
+        << std::endl;
+    out << indent << "\"heap_reheaps\": " << stats.simplify.heap_reheaps
+        << "," << std::endl;
+    out << indent << "\"max_heap_size\": " << stats.simplify.max_heap_size
+        << std::endl;
+}
+
+void RunStats::print_json(std::ostream& out) const
+{
+    out << std::fixed << std::setprecision(3);
+    out << "{" << std::endl;
+    out << "  \"wall_ms\": " << to_ms(m_wall_ns) << "," << std::endl;
+    out << "  \"total\": {" << std::endl;
+    print_json_counters(out, total(), "    ");
+    out << "  }," << std::endl;
+    out << "  \"threads\": [" << std::endl;
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        out << "    {" << std::endl;
+        out << "      \"thread\": \"" << thread_name(i, m_workers.size())
+            << "\"," << std::endl;
+        if (i + 2 < m_workers.size())
+        {
+            out << "      \"worker_index\": " << i << "," << std::endl;
+        }
+        print_json_counters(out, m_workers[i], "      ");
+        out << "    }" << (i + 1 < m_workers.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
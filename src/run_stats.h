@@ -0,0 +1,124 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <stdint.h>
+#include "visvalingam_algorithm.h"
+
+// Stages of a command line run, timed separately. Ring jobs are timed as a
+// whole under STAGE_FILTER; the elimination loop's share is moved out of it
+// into STAGE_EFFECTIVE_AREAS when reported.
+enum RunStage
+{
+    STAGE_READ,             // OGR feature reading
+    STAGE_FROM_OGR,         // from_ogr_shape()
+    STAGE_EFFECTIVE_AREAS,  // elimination loop, from SimplifyStats
+    STAGE_FILTER,           // rest of the simplification: vertex selection
+    STAGE_TO_OGR,           // to_ogr_shape()
+    STAGE_EXPORT_WKT,       // exportToWkt()
+    STAGE_WRITE,            // output: WKT printing or dataset writes
+    STAGE_COUNT
+};
+
+// Counters of one thread. Each thread only writes its own, so they need no
+// synchronization; they are summed when reported.
+struct WorkerStats
+{
+    WorkerStats();
+
+    void add(const WorkerStats& other);
+
+    uint64_t stage_ns[STAGE_COUNT];
+    size_t feature_count;
+    size_t ring_count;
+    // rings too short to simplify (less than 4 points)
+    size_t rings_skipped;
+    // rings simplified below 4 points, hence dropped
+    size_t rings_collapsed;
+    size_t vertices_in;
+    size_t vertices_out;
+    SimplifyStats simplify;
+
+private:
+    // keeps two workers' counters off the same cache line
+    char m_padding[64];
+};
+
+// Statistics of a whole run: one WorkerStats per pool worker, then one for
+// the reader and one for the writer thread.
+class RunStats
+{
+public:
+    explicit RunStats(size_t worker_count);
+
+    WorkerStats& worker(size_t worker_index)
+    {
+        return m_workers[worker_index];
+    }
+
+    WorkerStats& reader()
+    {
+        return m_workers[m_workers.size() - 2];
+    }
+
+    WorkerStats& writer()
+    {
+        return m_workers.back();
+    }
+
+    void set_wall_ns(uint64_t wall_ns)
+    {
+        m_wall_ns = wall_ns;
+    }
+
+    void print(std::ostream& out) const;
+    void print_json(std::ostream& out) const;
+
+private:
+    WorkerStats total() const;
+
+    std::vector<WorkerStats> m_workers;
+    uint64_t m_wall_ns;
+};
+
+// Adds the time between construction and destruction to one stage. Does
+// nothing, not even reading the clock, when 'stats' is NULL.
+class StageTimer
+{
+public:
+    StageTimer(WorkerStats* stats, RunStage stage)
+        : m_stats(stats)
+        , m_stage(stage)
+    {
+        if (m_stats)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~StageTimer()
+    {
+        if (m_stats)
+        {
+            m_stats->stage_ns[m_stage] +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - m_start).count();
+        }
+    }
+
+private:
+    StageTimer(const StageTimer& other);
+    StageTimer& operator=(const StageTimer& other);
+
+    WorkerStats* m_stats;
+    RunStage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // RUN_STATS_H
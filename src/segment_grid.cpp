@@ -0,0 +1,227 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "segment_grid.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+static bool same_point(const Point& lhs, const Point& rhs)
+{
+    return lhs.X == rhs.X && lhs.Y == rhs.Y;
+}
+
+// > 0 if c is left of a->b, < 0 if right, 0 if on the line through them.
+// Inlined rather than through cross_product(): this is the inner loop.
+static double orientation(const Point& a, const Point& b, const Point& c)
+{
+    return (b.X - a.X) * (c.Y - a.Y) - (b.Y - a.Y) * (c.X - a.X);
+}
+
+// Whether c, on the line through a and b, lies within their box.
+static bool within_box(const Point& a, const Point& b, const Point& c)
+{
+    return std::min(a.X, b.X) <= c.X && c.X <= std::max(a.X, b.X)
+           && std::min(a.Y, b.Y) <= c.Y && c.Y <= std::max(a.Y, b.Y);
+}
+
+bool segments_cross(const Point& a, const Point& b,
+                    const Point& c, const Point& d)
+{
+    // most segments of a cell are not even near
+    if (std::max(a.X, b.X) < std::min(c.X, d.X)
+        || std::max(c.X, d.X) < std::min(a.X, b.X)
+        || std::max(a.Y, b.Y) < std::min(c.Y, d.Y)
+        || std::max(c.Y, d.Y) < std::min(a.Y, b.Y))
+    {
+        return false;
+    }
+    if (same_point(a, c) || same_point(a, d) || same_point(b, c)
+        || same_point(b, d))
+    {
+        return false;
+    }
+    const double abc = orientation(a, b, c);
+    const double abd = orientation(a, b, d);
+    const double cda = orientation(c, d, a);
+    const double cdb = orientation(c, d, b);
+    if (((abc > 0 && abd < 0) || (abc < 0 && abd > 0))
+        && ((cda > 0 && cdb < 0) || (cda < 0 && cdb > 0)))
+    {
+        return true;
+    }
+    // an endpoint on the other segment
+    return (abc == 0 && within_box(a, b, c))
+           || (abd == 0 && within_box(a, b, d))
+           || (cda == 0 && within_box(c, d, a))
+           || (cdb == 0 && within_box(c, d, b));
+}
+
+SegmentGrid::SegmentGrid()
+    : m_origin(0.0, 0.0)
+    , m_cell_size(1.0)
+    , m_cells()
+    , m_segment_count(0)
+    , m_built_count(0)
+{
+}
+
+void SegmentGrid::reset(const Point& origin, double cell_size)
+{
+    assert(cell_size > 0);
+    m_origin = origin;
+    m_cell_size = cell_size;
+    m_cells.clear();
+    m_segment_count = 0;
+    m_built_count = 0;
+}
+
+int64_t SegmentGrid::column(double x) const
+{
+    return static_cast<int64_t>(floor((x - m_origin.X) / m_cell_size));
+}
+
+int64_t SegmentGrid::row(double y) const
+{
+    return static_cast<int64_t>(floor((y - m_origin.Y) / m_cell_size));
+}
+
+uint64_t SegmentGrid::cell_key(int64_t row, int64_t column) const
+{
+    // rows and columns stay within 32 bits: lines are shorter than 2^32
+    // segments of about a cell
+    return (static_cast<uint64_t>(row) << 32) ^ static_cast<uint32_t>(column);
+}
+
+// A row at a time. Each row's columns are widened a little, so that
+// rounding cannot drop a cell where two segments cross.
+template <typename Function>
+void SegmentGrid::for_each_cell(const Point& a, const Point& b,
+                                Function f) const
+{
+    const double low_y = std::min(a.Y, b.Y);
+    const double high_y = std::max(a.Y, b.Y);
+    const int64_t first_row = row(low_y);
+    const int64_t last_row = row(high_y);
+    const double margin = 1e-6 * m_cell_size;
+    for (int64_t r = first_row; r <= last_row; ++r)
+    {
+        double low_x = std::min(a.X, b.X);
+        double high_x = std::max(a.X, b.X);
+        if (first_row != last_row)
+        {
+            // the part of the segment within the row
+            const double y0 = std::max(low_y, m_origin.Y + r * m_cell_size);
+            const double y1 = std::min(high_y,
+                                       m_origin.Y + (r + 1) * m_cell_size);
+            const double slope = (b.X - a.X) / (b.Y - a.Y);
+            const double x0 = a.X + slope * (y0 - a.Y);
+            const double x1 = a.X + slope * (y1 - a.Y);
+            low_x = std::max(low_x, std::min(x0, x1) - margin);
+            high_x = std::min(high_x, std::max(x0, x1) + margin);
+        }
+        const int64_t last_column = column(high_x);
+        for (int64_t c = column(low_x); c <= last_column; ++c)
+        {
+            f(cell_key(r, c));
+        }
+    }
+}
+
+void SegmentGrid::insert(uint32_t segment, const Point& a, const Point& b)
+{
+    const Entry entry = { segment, a, b };
+    CellMap* cells = &m_cells;
+    for_each_cell(a, b, [cells, &entry](uint64_t cell)
+    {
+        (*cells)[cell].push_back(entry);
+    });
+    ++m_segment_count;
+    m_built_count = std::max(m_built_count, m_segment_count);
+}
+
+void SegmentGrid::erase(uint32_t segment, const Point& a, const Point& b)
+{
+    CellMap* cells = &m_cells;
+    for_each_cell(a, b, [cells, segment](uint64_t cell)
+    {
+        const CellMap::iterator it = cells->find(cell);
+        assert(it != cells->end());
+        std::vector<Entry>& entries = it->second;
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (entries[i].segment == segment)
+            {
+                entries[i] = entries.back();
+                entries.pop_back();
+                break;
+            }
+        }
+    });
+    --m_segment_count;
+    if (2 * m_segment_count < m_built_count)
+    {
+        coarsen();
+    }
+}
+
+void SegmentGrid::coarsen()
+{
+    // each segment once: from the cell of its first point
+    std::vector<Entry> entries;
+    entries.reserve(m_segment_count);
+    for (CellMap::const_iterator it = m_cells.begin(); it != m_cells.end();
+         ++it)
+    {
+        for (size_t i = 0; i < it->second.size(); ++i)
+        {
+            const Entry& entry = it->second[i];
+            if (cell_key(row(entry.a.Y), column(entry.a.X)) == it->first)
+            {
+                entries.push_back(entry);
+            }
+        }
+    }
+    assert(entries.size() == m_segment_count);
+    m_cells.clear();
+    m_cell_size *= 2.0;
+    m_segment_count = 0;
+    m_built_count = 0;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        insert(entries[i].segment, entries[i].a, entries[i].b);
+    }
+}
+
+bool SegmentGrid::crosses(const Point& a, const Point& b,
+                          uint32_t ignored_first,
+                          uint32_t ignored_second) const
+{
+    // once a crossing is found, the remaining cells are walked but not
+    // looked up
+    const CellMap* cells = &m_cells;
+    bool res = false;
+    for_each_cell(a, b, [cells, &a, &b, ignored_first, ignored_second,
+                         &res](uint64_t cell)
+    {
+        if (res)
+        {
+            return;
+        }
+        const CellMap::const_iterator it = cells->find(cell);
+        if (it == cells->end())
+        {
+            return;
+        }
+        const std::vector<Entry>& entries = it->second;
+        for (size_t i = 0; i < entries.size() && !res; ++i)
+        {
+            const Entry& entry = entries[i];
+            res = entry.segment != ignored_first
+                  && entry.segment != ignored_second
+                  && segments_cross(a, b, entry.a, entry.b);
+        }
+    });
+    return res;
+}
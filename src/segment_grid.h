@@ -0,0 +1,82 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef SEGMENT_GRID_H
+#define SEGMENT_GRID_H
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "geo_types.h"
+
+// Whether segments a-b and c-d have a point in common, other than an
+// endpoint they share: consecutive segments of a line only touch there.
+bool segments_cross(const Point& a, const Point& b,
+                    const Point& c, const Point& d);
+
+// Segments of a line bucketed in a uniform grid, to find those near a new
+// one without going through the whole line, e.g.: while the elimination
+// loop joins the neighbours of each vertex it removes. Each segment is
+// listed in every cell it goes through, under the index of its first
+// vertex.
+//
+// Only cells holding segments are stored, hashed: a line only goes
+// through a sliver of its bounding box, e.g.: a ring around it. Cells
+// start about as large as the line's segments, so each holds a few.
+// Segments left by the elimination loop grow longer as the line holds
+// fewer of them: each time their count halves, cells double in size and
+// the grid is rebuilt, O(n) over the whole loop, so that each still goes
+// through a handful of cells. Cells emptied in between are only dropped
+// then.
+class SegmentGrid
+{
+public:
+    SegmentGrid();
+
+    // Empties the grid and lays it from 'origin', in square cells of
+    // 'cell_size' to start with.
+    void reset(const Point& origin, double cell_size);
+
+    void insert(uint32_t segment, const Point& a, const Point& b);
+    // 'a' and 'b' are those the segment was inserted with.
+    void erase(uint32_t segment, const Point& a, const Point& b);
+
+    // Whether a-b crosses a segment of the grid other than 'ignored_first'
+    // and 'ignored_second', see segments_cross().
+    bool crosses(const Point& a, const Point& b, uint32_t ignored_first,
+                 uint32_t ignored_second) const;
+
+private:
+    SegmentGrid(const SegmentGrid& other);
+    SegmentGrid& operator=(const SegmentGrid& other);
+
+    struct Entry
+    {
+        uint32_t segment;
+        Point a;
+        Point b;
+    };
+
+    typedef std::unordered_map<uint64_t, std::vector<Entry> > CellMap;
+
+    int64_t column(double x) const;
+    int64_t row(double y) const;
+    uint64_t cell_key(int64_t row, int64_t column) const;
+
+    // Doubles the cell size, rebuilding the grid.
+    void coarsen();
+
+    // Calls f(cell key) for every cell a-b goes through.
+    template <typename Function>
+    void for_each_cell(const Point& a, const Point& b, Function f) const;
+
+    Point m_origin;
+    double m_cell_size;
+    CellMap m_cells;
+    size_t m_segment_count;
+    // most segments held since the grid was last built
+    size_t m_built_count;
+};
+
+#endif // SEGMENT_GRID_H
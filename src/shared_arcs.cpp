@@ -0,0 +1,295 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "shared_arcs.h"
+#include <cassert>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include "coordinate_view.hpp"
+#include "thread_pool.h"
+
+static bool same_point(const Point& lhs, const Point& rhs)
+{
+    return lhs.X == rhs.X && lhs.Y == rhs.Y;
+}
+
+struct PointEqual
+{
+    bool operator()(const Point& lhs, const Point& rhs) const
+    {
+        return same_point(lhs, rhs);
+    }
+};
+
+struct PointHash
+{
+    size_t operator()(const Point& p) const
+    {
+        // + 0.0 folds -0.0 into 0.0, which compare equal
+        const std::hash<double> hash;
+        const size_t x = hash(p.X + 0.0);
+        return x ^ (hash(p.Y + 0.0) + 0x9e3779b9 + (x << 6) + (x >> 2));
+    }
+};
+
+// First two coordinates of an arc, in the direction it is gone through.
+struct ArcKey
+{
+    Point first;
+    Point second;
+};
+
+struct ArcKeyEqual
+{
+    bool operator()(const ArcKey& lhs, const ArcKey& rhs) const
+    {
+        return same_point(lhs.first, rhs.first)
+               && same_point(lhs.second, rhs.second);
+    }
+};
+
+struct ArcKeyHash
+{
+    size_t operator()(const ArcKey& key) const
+    {
+        const PointHash hash;
+        const size_t first = hash(key.first);
+        return first ^ (hash(key.second) + 0x9e3779b9 + (first << 6)
+                        + (first >> 2));
+    }
+};
+
+// Distinct coordinates found next to one over every ring, up to the third,
+// which makes it a junction.
+struct VertexNeighbours
+{
+    VertexNeighbours() : count(0), junction(false) {}
+
+    void add(const Point& neighbour)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (same_point(neighbours[i], neighbour))
+            {
+                return;
+            }
+        }
+        if (count == 2)
+        {
+            junction = true;
+            return;
+        }
+        neighbours[count++] = neighbour;
+    }
+
+    Point neighbours[2];
+    size_t count;
+    bool junction;
+};
+
+typedef std::unordered_map<Point, VertexNeighbours, PointHash, PointEqual>
+        NeighbourMap;
+
+// Arc found first with this key, and whether it was then gone through
+// backwards.
+struct ArcRef
+{
+    size_t arc;
+    bool reversed;
+};
+
+typedef std::unordered_map<ArcKey, ArcRef, ArcKeyHash, ArcKeyEqual> ArcMap;
+
+SharedArcs::SharedArcs(const std::vector<const Linestring*>& rings)
+    : m_rings(rings)
+    , m_arcs()
+    , m_ring_arcs()
+    , m_ring_first_arc(1, 0)
+    , m_simplified()
+{
+    size_t vertex_count = 0;
+    for (size_t r = 0; r < rings.size(); ++r)
+    {
+        vertex_count += rings[r]->size();
+    }
+    NeighbourMap neighbours;
+    neighbours.reserve(vertex_count);
+    for (size_t r = 0; r < rings.size(); ++r)
+    {
+        const Linestring& ring = *rings[r];
+        for (size_t i = 0; i < ring.size(); ++i)
+        {
+            VertexNeighbours& vertex = neighbours[ring[i]];
+            if (i == 0 || i + 1 == ring.size())
+            {
+                vertex.junction = true;
+                continue;
+            }
+            vertex.add(ring[i-1]);
+            vertex.add(ring[i+1]);
+        }
+    }
+
+    // an arc is identified by its first two coordinates: past them, its
+    // vertices only have one way to go
+    ArcMap arcs;
+    std::vector<NodeIndex> junctions;
+    for (size_t r = 0; r < rings.size(); ++r)
+    {
+        const Linestring& ring = *rings[r];
+        junctions.clear();
+        for (size_t i = 0; i < ring.size(); ++i)
+        {
+            const VertexNeighbours& vertex = neighbours[ring[i]];
+            if (vertex.junction || vertex.count < 2)
+            {
+                junctions.push_back(static_cast<NodeIndex>(i));
+            }
+        }
+        for (size_t j = 0; j + 1 < junctions.size(); ++j)
+        {
+            const ArcSpan span = { r, junctions[j],
+                                   junctions[j+1] - junctions[j] + 1 };
+            const ArcKey key = { ring[span.first], ring[span.first + 1] };
+            ArcUse use = { m_arcs.size(), false };
+            const ArcMap::const_iterator it = arcs.find(key);
+            // same first coordinates, but a spike can still turn back
+            if (it != arcs.end()
+                && m_arcs[it->second.arc].size == span.size)
+            {
+                const ArcSpan& found = m_arcs[it->second.arc];
+                bool same = true;
+                for (size_t i = 0; i < span.size && same; ++i)
+                {
+                    same = same_point(arc_point(span, i, false),
+                                      arc_point(found, i,
+                                                it->second.reversed));
+                }
+                if (same)
+                {
+                    use.arc = it->second.arc;
+                    use.reversed = it->second.reversed;
+                }
+            }
+            if (use.arc == m_arcs.size())
+            {
+                const ArcRef forward = { use.arc, false };
+                const ArcRef backward = { use.arc, true };
+                const ArcKey back_key = { ring[span.first + span.size - 1],
+                                          ring[span.first + span.size - 2] };
+                arcs.insert(std::make_pair(key, forward));
+                arcs.insert(std::make_pair(back_key, backward));
+                m_arcs.push_back(span);
+            }
+            m_ring_arcs.push_back(use);
+        }
+        m_ring_first_arc.push_back(m_ring_arcs.size());
+    }
+}
+
+// Orders arc indices so that the largest arcs come first
+struct ArcLarger
+{
+    explicit ArcLarger(const std::vector<size_t>* sizes) : m_sizes(sizes) {}
+
+    bool operator()(size_t lhs, size_t rhs) const
+    {
+        return (*m_sizes)[lhs] > (*m_sizes)[rhs];
+    }
+
+    const std::vector<size_t>* m_sizes;
+};
+
+void SharedArcs::simplify(const std::vector<double>& area_thresholds,
+                          ThreadPool* pool,
+                          std::vector<SimplifyWorkspace>* workspaces,
+                          const SimplifyOptions& options)
+{
+    assert(!area_thresholds.empty());
+    assert(workspaces->size() >= pool->size());
+    m_simplified.assign(m_arcs.size(), std::vector<Linestring>());
+    std::vector<size_t> sizes(m_arcs.size());
+    std::vector<size_t> schedule(m_arcs.size());
+    for (size_t i = 0; i < m_arcs.size(); ++i)
+    {
+        sizes[i] = m_arcs[i].size;
+        schedule[i] = i;
+    }
+    std::stable_sort(schedule.begin(), schedule.end(), ArcLarger(&sizes));
+
+    // every level is filtered from the same effective areas
+    SimplifyOptions arc_options = options;
+    arc_options.max_area_threshold = std::min(
+            options.max_area_threshold,
+            *std::max_element(area_thresholds.begin(),
+                              area_thresholds.end()));
+    const std::vector<double>* thresholds = &area_thresholds;
+    const SimplifyOptions* line_options = &arc_options;
+    const std::vector<const Linestring*>* rings = &m_rings;
+    const std::vector<ArcSpan>* arcs = &m_arcs;
+    std::vector<std::vector<Linestring> >* simplified = &m_simplified;
+    for (size_t i = 0; i < schedule.size(); ++i)
+    {
+        const size_t arc = schedule[i];
+        pool->submit([thresholds, line_options, rings, arcs, simplified,
+                      workspaces, arc](size_t worker_index)
+        {
+            const ArcSpan& span = (*arcs)[arc];
+            const InterleavedView<double> input(
+                    &(*(*rings)[span.ring])[span.first].X, span.size);
+            SimplifyWorkspace& workspace = (*workspaces)[worker_index];
+            workspace.compute_effective_areas(input, *line_options);
+            const EffectiveAreas& areas = workspace.effective_areas();
+            const size_t last = areas.size() - 1;
+            std::vector<Linestring>& levels = (*simplified)[arc];
+            levels.resize(thresholds->size());
+            for (size_t level = 0; level < levels.size(); ++level)
+            {
+                const double threshold = (*thresholds)[level];
+                for (size_t v = 0; v <= last; ++v)
+                {
+                    if (v == 0 || v == last || areas.areas[v] > threshold)
+                    {
+                        levels[level].push_back(
+                                input[areas.source_index(v)]);
+                    }
+                }
+            }
+        });
+    }
+    pool->wait();
+}
+
+void SharedArcs::assemble_ring(size_t ring, size_t level,
+                               Linestring* res) const
+{
+    assert(ring + 1 < m_ring_first_arc.size());
+    res->clear();
+    for (size_t a = m_ring_first_arc[ring]; a < m_ring_first_arc[ring+1]; ++a)
+    {
+        const ArcUse& use = m_ring_arcs[a];
+        const Linestring& kept = m_simplified[use.arc][level];
+        // arcs share their junctions
+        for (size_t i = res->empty() ? 0 : 1; i < kept.size(); ++i)
+        {
+            res->push_back(kept[use.reversed ? kept.size() - 1 - i : i]);
+        }
+    }
+    if (res->size() < 4)
+    {
+        res->clear();
+    }
+}
+
+size_t SharedArcs::arc_vertex_count() const
+{
+    size_t res = 0;
+    for (size_t i = 0; i < m_arcs.size(); ++i)
+    {
+        res += m_arcs[i].size;
+    }
+    return res;
+}
@@ -0,0 +1,90 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef SHARED_ARCS_H
+#define SHARED_ARCS_H
+
+#include <vector>
+#include "geo_types.h"
+#include "visvalingam_algorithm.h"
+
+class ThreadPool;
+
+// Rings cut where they meet, e.g.: the countries of a layer, so that a
+// border two rings share is simplified once, for both. Simplifying each
+// ring on its own does the work twice, and keeps different vertices of the
+// border on either side: gaps and slivers between neighbours.
+//
+// A junction is a coordinate found next to more or fewer than two distinct
+// others over all rings, where borders meet or end, or one of a ring's
+// ends, so that output rings start where input rings do. Rings are cut at
+// every junction into arcs, the vertices in between being next to the same
+// two coordinates wherever they appear. Arcs going through the same
+// coordinates, in either direction, are simplified once with their ends
+// pinned, then rings put back together from them: rings keep the same
+// vertices wherever they touch.
+//
+// Coordinates are matched exactly, as they are in topologically clean
+// datasets. Pinned junctions keep a few more vertices than simplifying
+// each ring on its own.
+class SharedArcs
+{
+public:
+    // Cuts 'rings' (not owned, kept until destruction) into arcs.
+    explicit SharedArcs(const std::vector<const Linestring*>& rings);
+
+    // Simplifies every arc at each of 'area_thresholds', one task per arc
+    // on 'pool', with one workspace per worker.
+    void simplify(const std::vector<double>& area_thresholds,
+                  ThreadPool* pool, std::vector<SimplifyWorkspace>* workspaces,
+                  const SimplifyOptions& options = SimplifyOptions());
+
+    // Ring 'ring' put back together from its arcs simplified at
+    // area_thresholds[level]. As with Visvalingam_Algorithm, rings left
+    // with fewer than 4 vertices come out empty.
+    void assemble_ring(size_t ring, size_t level, Linestring* res) const;
+
+    // Distinct arcs, and their vertices: what simplify() goes through.
+    size_t arc_count() const
+    {
+        return m_arcs.size();
+    }
+
+    size_t arc_vertex_count() const;
+
+private:
+    SharedArcs(const SharedArcs& other);
+    SharedArcs& operator=(const SharedArcs& other);
+
+    // Vertices [first, first + size) of the ring the arc was found in.
+    struct ArcSpan
+    {
+        size_t ring;
+        NodeIndex first;
+        NodeIndex size;
+    };
+
+    // Arc of a ring, going through it backwards if 'reversed'.
+    struct ArcUse
+    {
+        size_t arc;
+        bool reversed;
+    };
+
+    const Point& arc_point(const ArcSpan& arc, size_t i, bool reversed) const
+    {
+        return (*m_rings[arc.ring])[arc.first +
+                                    (reversed ? arc.size - 1 - i : i)];
+    }
+
+    std::vector<const Linestring*> m_rings;
+    std::vector<ArcSpan> m_arcs;
+    // arcs of ring i: [m_ring_first_arc[i], m_ring_first_arc[i+1])
+    std::vector<ArcUse> m_ring_arcs;
+    std::vector<size_t> m_ring_first_arc;
+    // [arc][level]: vertices kept, in arc order
+    std::vector<std::vector<Linestring> > m_simplified;
+};
+
+#endif // SHARED_ARCS_H
@@ -0,0 +1,77 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "streaming_simplifier.h"
+#include <cassert>
+
+StreamingSimplifier::StreamingSimplifier(double area_threshold,
+                                         size_t window_size,
+                                         SimplifyWorkspace* workspace,
+                                         const SimplifyOptions& options)
+    : m_area_threshold(area_threshold)
+    , m_window_size(window_size)
+    , m_workspace(workspace)
+    , m_options(options)
+    , m_window()
+    , m_kept()
+{
+    assert(window_size >= 3);
+    assert(workspace);
+    m_window.reserve(window_size);
+}
+
+void StreamingSimplifier::push(const Point& point, Linestring* res)
+{
+    assert(res);
+    m_window.push_back(point);
+    if (m_window.size() == 1)
+    {
+        // the first point is always kept
+        res->push_back(point);
+        return;
+    }
+    if (m_window.size() < m_window_size)
+    {
+        return;
+    }
+
+    // the window's last point is always kept: there is one past the middle
+    const size_t kept_count = simplify_window();
+    const VertexIndex middle = m_window_size / 2;
+    size_t last = 1;
+    while (m_kept[last] < middle)
+    {
+        ++last;
+    }
+    assert(last < kept_count);
+    (void)kept_count;
+    for (size_t i = 1; i <= last; ++i)
+    {
+        res->push_back(m_window[m_kept[i]]);
+    }
+    m_window.erase(m_window.begin(), m_window.begin() + m_kept[last]);
+}
+
+void StreamingSimplifier::finish(Linestring* res)
+{
+    assert(res);
+    if (m_window.size() > 1)
+    {
+        const size_t kept_count = simplify_window();
+        for (size_t i = 1; i < kept_count; ++i)
+        {
+            res->push_back(m_window[m_kept[i]]);
+        }
+    }
+    m_window.clear();
+}
+
+size_t StreamingSimplifier::simplify_window()
+{
+    m_kept.resize(m_window.size());
+    const size_t kept_count = Visvalingam_Algorithm::simplify_indices(
+            m_window, m_area_threshold, &m_kept[0], m_workspace, m_options);
+    assert(kept_count >= 2 && m_kept[0] == 0);
+    return kept_count;
+}
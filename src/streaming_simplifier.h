@@ -0,0 +1,76 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef STREAMING_SIMPLIFIER_H
+#define STREAMING_SIMPLIFIER_H
+
+#include <vector>
+#include "geo_types.h"
+#include "visvalingam_algorithm.h"
+
+// Simplifies an unbounded line point by point, e.g.: a GPS track as it is
+// received, holding at most 'window_size' points.
+//
+// The points not final yet make up a window that starts at the last vertex
+// emitted. Once it is full, it is simplified at the area threshold like a
+// whole line, both of its ends kept; the vertices it keeps up to the first
+// one at or past its middle are emitted, that last one starting the next
+// window. Every point is thus emitted or dropped after at most
+// window_size - 1 more points, and memory does not depend on the length of
+// the line.
+//
+// The vertices emitted from a window are exactly those
+// Visvalingam_Algorithm::simplify_indices() keeps of its points, up to the
+// first one at or past its middle: every vertex dropped has an effective
+// area of at most the threshold within its window, and every vertex
+// emitted but the window's first one an area above it. A line of fewer
+// than window_size points comes out as simplify_indices() keeps it.
+//
+// There is no bound against simplifying the whole line at once: pinning
+// both ends of each window changes the elimination order near both of
+// them, so vertices the whole line keeps can be dropped, and others kept.
+// On a 4000-point random walk of unit steps with a 64-point window, at a
+// threshold of 10 the stream keeps 124 vertices, only 53 of them among the
+// 94 the whole line keeps.
+class StreamingSimplifier
+{
+public:
+    // 'workspace' (not owned) may be shared by simplifiers used from the
+    // same thread. window_size is at least 3.
+    StreamingSimplifier(double area_threshold, size_t window_size,
+                        SimplifyWorkspace* workspace,
+                        const SimplifyOptions& options = SimplifyOptions());
+
+    // Adds the line's next point. Appends to 'res' the vertices that became
+    // final, in line order.
+    void push(const Point& point, Linestring* res);
+
+    // Ends the line: appends the vertices kept among those not emitted yet,
+    // the last point included. The simplifier then starts a new line.
+    void finish(Linestring* res);
+
+    // Points held, less than window_size between calls.
+    size_t pending_count() const
+    {
+        return m_window.size();
+    }
+
+private:
+    StreamingSimplifier(const StreamingSimplifier& other);
+    StreamingSimplifier& operator=(const StreamingSimplifier& other);
+
+    // Simplifies the window and returns how many of its vertices it keeps,
+    // their indices in m_kept.
+    size_t simplify_window();
+
+    double m_area_threshold;
+    size_t m_window_size;
+    SimplifyWorkspace* m_workspace;
+    SimplifyOptions m_options;
+    // m_window[0] is the last vertex emitted
+    Linestring m_window;
+    std::vector<VertexIndex> m_kept;
+};
+
+#endif // STREAMING_SIMPLIFIER_H
@@ -0,0 +1,140 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "thread_pool.h"
+#include <cassert>
+
+ThreadPool::ThreadPool(size_t thread_count)
+    : m_threads()
+    , m_queues()
+    , m_next_queue(0)
+    , m_mutex()
+    , m_work_available()
+    , m_work_done()
+    , m_queued(0)
+    , m_pending(0)
+    , m_stop(false)
+{
+    if (thread_count <= 1)
+    {
+        return;
+    }
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        m_queues.push_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        m_threads.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_work_available.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i].join();
+    }
+    for (size_t i = 0; i < m_queues.size(); ++i)
+    {
+        delete m_queues[i];
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return m_threads.empty() ? 1 : m_threads.size();
+}
+
+void ThreadPool::submit(const Task& task)
+{
+    if (m_threads.empty())
+    {
+        task(0);
+        return;
+    }
+
+    {
+        // the counters are updated together with the push so a worker never
+        // pops a task that is not accounted for yet.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        WorkerQueue* queue = m_queues[m_next_queue];
+        m_next_queue = (m_next_queue + 1) % m_queues.size();
+        {
+            std::lock_guard<std::mutex> queue_lock(queue->mutex);
+            queue->tasks.push_back(task);
+        }
+        ++m_queued;
+        ++m_pending;
+    }
+    m_work_available.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_pending != 0)
+    {
+        m_work_done.wait(lock);
+    }
+}
+
+bool ThreadPool::pop_task(size_t worker_index, Task* task)
+{
+    // Own queue first, then steal. Both take from the front: tasks are
+    // expected to be submitted largest first and the largest remaining task
+    // is the one worth starting.
+    const size_t queue_count = m_queues.size();
+    for (size_t i = 0; i < queue_count; ++i)
+    {
+        WorkerQueue* queue = m_queues[(worker_index + i) % queue_count];
+        std::lock_guard<std::mutex> queue_lock(queue->mutex);
+        if (!queue->tasks.empty())
+        {
+            task->swap(queue->tasks.front());
+            queue->tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t worker_index)
+{
+    while (true)
+    {
+        Task task;
+        if (pop_task(worker_index, &task))
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                assert(m_queued > 0);
+                --m_queued;
+            }
+            task(worker_index);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            assert(m_pending > 0);
+            if (--m_pending == 0)
+            {
+                m_work_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop && m_queued == 0)
+        {
+            m_work_available.wait(lock);
+        }
+        if (m_stop && m_queued == 0)
+        {
+            return;
+        }
+    }
+}
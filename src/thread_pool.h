@@ -0,0 +1,64 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed size work-stealing pool. Each worker owns a task queue; submit()
+// deals tasks round-robin and an idle worker steals from the others, so a
+// batch submitted largest-first is also started largest-first.
+//
+// Tasks receive the index of the worker running them, in [0, size()), so
+// callers can keep per-worker state (e.g. one SimplifyWorkspace each).
+// A pool of 0 or 1 thread runs every task inline from submit().
+class ThreadPool
+{
+public:
+    typedef std::function<void(size_t worker_index)> Task;
+
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    // number of distinct worker indices handed out to tasks
+    size_t size() const;
+
+    void submit(const Task& task);
+
+    // blocks until every submitted task has run
+    void wait();
+
+private:
+    ThreadPool(const ThreadPool& other);
+    ThreadPool& operator=(const ThreadPool& other);
+
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(size_t worker_index);
+    bool pop_task(size_t worker_index, Task* task);
+
+    std::vector<std::thread> m_threads;
+    std::vector<WorkerQueue*> m_queues;
+    size_t m_next_queue;
+
+    // guards the counters below
+    std::mutex m_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_work_done;
+    size_t m_queued;
+    size_t m_pending;
+    bool m_stop;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,200 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "triangle_areas.h"
+#include <cassert>
+#include <cmath>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TRIANGLE_AREAS_X86
+#include <immintrin.h>
+#endif
+
+// Vertices [begin, end) of the line, 0 < begin and end < vertex_count.
+static void triangle_areas_scalar(const double* xy, size_t begin, size_t end,
+                                  double* areas)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        const double* c = xy + 2*i;
+        const double c_n_x = c[2] - c[0];
+        const double c_n_y = c[3] - c[1];
+        const double c_p_x = c[-2] - c[0];
+        const double c_p_y = c[-1] - c[1];
+        areas[i] = 0.5 * fabs((c_n_x * c_p_y) - (c_n_y * c_p_x));
+    }
+}
+
+#ifdef TRIANGLE_AREAS_X86
+
+// Each register holds whole points: the vectors to the next and previous
+// vertices are differences of the same registers shifted by one point, and
+// swapping X and Y in the latter lines up both products of the cross
+// product side by side.
+
+// SSE2 is part of x86-64: no dispatch needed.
+static size_t triangle_areas_sse2(const double* xy, size_t vertex_count,
+                                  double* areas)
+{
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    size_t i = 1;
+    for (; i + 2 < vertex_count; i += 2)
+    {
+        const double* c = xy + 2*i;
+        const __m128d p0 = _mm_loadu_pd(c - 2);
+        const __m128d c0 = _mm_loadu_pd(c);
+        const __m128d c1 = _mm_loadu_pd(c + 2);
+        const __m128d n1 = _mm_loadu_pd(c + 4);
+        const __m128d c_p0 = _mm_sub_pd(p0, c0);
+        const __m128d c_p1 = _mm_sub_pd(c0, c1);
+        const __m128d prod0 = _mm_mul_pd(_mm_sub_pd(c1, c0),
+                                         _mm_shuffle_pd(c_p0, c_p0, 1));
+        const __m128d prod1 = _mm_mul_pd(_mm_sub_pd(n1, c1),
+                                         _mm_shuffle_pd(c_p1, c_p1, 1));
+        const __m128d det = _mm_sub_pd(_mm_unpacklo_pd(prod0, prod1),
+                                       _mm_unpackhi_pd(prod0, prod1));
+        _mm_storeu_pd(areas + i, _mm_mul_pd(half, _mm_andnot_pd(sign, det)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t triangle_areas_avx2(const double* xy, size_t vertex_count,
+                                  double* areas)
+{
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t i = 1;
+    for (; i + 4 < vertex_count; i += 4)
+    {
+        // points i-1 to i+4, two per register
+        const double* c = xy + 2*i;
+        const __m256d p0 = _mm256_loadu_pd(c - 2);
+        const __m256d c0 = _mm256_loadu_pd(c);
+        const __m256d c1 = _mm256_loadu_pd(c + 2);
+        const __m256d c2 = _mm256_loadu_pd(c + 4);
+        const __m256d n2 = _mm256_loadu_pd(c + 6);
+        const __m256d c_p0 = _mm256_sub_pd(p0, c0);
+        const __m256d c_p2 = _mm256_sub_pd(c1, c2);
+        const __m256d prod0 = _mm256_mul_pd(_mm256_sub_pd(c1, c0),
+                                            _mm256_permute_pd(c_p0, 0x5));
+        const __m256d prod2 = _mm256_mul_pd(_mm256_sub_pd(n2, c2),
+                                            _mm256_permute_pd(c_p2, 0x5));
+        // vertices i, i+2, i+1, i+3
+        const __m256d det = _mm256_hsub_pd(prod0, prod2);
+        const __m256d res = _mm256_mul_pd(half, _mm256_andnot_pd(sign, det));
+        _mm256_storeu_pd(areas + i,
+                         _mm256_permute4x64_pd(res, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    return i;
+}
+
+// GCC 12's own AVX-512 intrinsics trip -Wmaybe-uninitialized when inlined.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f")))
+static size_t triangle_areas_avx512(const double* xy, size_t vertex_count,
+                                    double* areas)
+{
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512i order = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+    size_t i = 1;
+    for (; i + 8 < vertex_count; i += 8)
+    {
+        // points i-1 to i+8, four per register
+        const double* c = xy + 2*i;
+        const __m512d p0 = _mm512_loadu_pd(c - 2);
+        const __m512d c0 = _mm512_loadu_pd(c);
+        const __m512d p4 = _mm512_loadu_pd(c + 6);
+        const __m512d c4 = _mm512_loadu_pd(c + 8);
+        const __m512d n4 = _mm512_loadu_pd(c + 10);
+        const __m512d c_p0 = _mm512_sub_pd(p0, c0);
+        const __m512d c_p4 = _mm512_sub_pd(p4, c4);
+        const __m512d prod0 = _mm512_mul_pd(
+                _mm512_sub_pd(_mm512_loadu_pd(c + 2), c0),
+                _mm512_permute_pd(c_p0, 0x55));
+        const __m512d prod4 = _mm512_mul_pd(_mm512_sub_pd(n4, c4),
+                                            _mm512_permute_pd(c_p4, 0x55));
+        // vertices i, i+4, i+1, i+5, i+2, i+6, i+3, i+7
+        const __m512d det = _mm512_sub_pd(_mm512_unpacklo_pd(prod0, prod4),
+                                          _mm512_unpackhi_pd(prod0, prod4));
+        const __m512d res = _mm512_mul_pd(half, _mm512_abs_pd(det));
+        _mm512_storeu_pd(areas + i, _mm512_permutexvar_pd(order, res));
+    }
+    return i;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // TRIANGLE_AREAS_X86
+
+bool triangle_area_kernel_supported(TriangleAreaKernel kernel)
+{
+    switch (kernel)
+    {
+    case TRIANGLE_AREA_SCALAR:
+        return true;
+#ifdef TRIANGLE_AREAS_X86
+    case TRIANGLE_AREA_SSE2:
+        return true;
+    case TRIANGLE_AREA_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case TRIANGLE_AREA_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+TriangleAreaKernel best_triangle_area_kernel()
+{
+    static const TriangleAreaKernel best =
+        triangle_area_kernel_supported(TRIANGLE_AREA_AVX512)
+            ? TRIANGLE_AREA_AVX512
+        : triangle_area_kernel_supported(TRIANGLE_AREA_AVX2)
+            ? TRIANGLE_AREA_AVX2
+        : triangle_area_kernel_supported(TRIANGLE_AREA_SSE2)
+            ? TRIANGLE_AREA_SSE2
+        : TRIANGLE_AREA_SCALAR;
+    return best;
+}
+
+void triangle_areas(const double* xy, size_t vertex_count, double* areas)
+{
+    triangle_areas(xy, vertex_count, areas, best_triangle_area_kernel());
+}
+
+void triangle_areas(const double* xy, size_t vertex_count, double* areas,
+                    TriangleAreaKernel kernel)
+{
+    assert(triangle_area_kernel_supported(kernel));
+    if (vertex_count < 3)
+    {
+        return;
+    }
+    // the kernels stop short of a full register; the scalar loop finishes
+    size_t done = 1;
+#ifdef TRIANGLE_AREAS_X86
+    switch (kernel)
+    {
+    case TRIANGLE_AREA_AVX512:
+        done = triangle_areas_avx512(xy, vertex_count, areas);
+        break;
+    case TRIANGLE_AREA_AVX2:
+        done = triangle_areas_avx2(xy, vertex_count, areas);
+        break;
+    case TRIANGLE_AREA_SSE2:
+        done = triangle_areas_sse2(xy, vertex_count, areas);
+        break;
+    default:
+        break;
+    }
+#endif
+    triangle_areas_scalar(xy, done, vertex_count - 1, areas);
+}
@@ -0,0 +1,35 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef TRIANGLE_AREAS_H
+#define TRIANGLE_AREAS_H
+
+#include <cstddef>
+
+// Batch computation of the triangle area each interior vertex of a line
+// forms with its two neighbours, over packed XY doubles: x0 y0 x1 y1 ...
+// The SIMD kernels do the same operations in the same order as
+// effective_area(), so their results are bit for bit identical to it.
+
+enum TriangleAreaKernel
+{
+    TRIANGLE_AREA_SCALAR,
+    TRIANGLE_AREA_SSE2,     // 2 vertices per iteration
+    TRIANGLE_AREA_AVX2,     // 4
+    TRIANGLE_AREA_AVX512    // 8
+};
+
+// Whether this build and the CPU it runs on support 'kernel'.
+bool triangle_area_kernel_supported(TriangleAreaKernel kernel);
+
+// Widest kernel supported, detected on the first call.
+TriangleAreaKernel best_triangle_area_kernel();
+
+// Writes areas[1] to areas[vertex_count - 2]; areas[0] and the last one are
+// left untouched.
+void triangle_areas(const double* xy, size_t vertex_count, double* areas);
+void triangle_areas(const double* xy, size_t vertex_count, double* areas,
+                    TriangleAreaKernel kernel);
+
+#endif // TRIANGLE_AREAS_H
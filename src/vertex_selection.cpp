@@ -0,0 +1,33 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#include "vertex_selection.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+AreaCutoff select_area_cutoff(std::vector<double>* candidate_areas,
+                              size_t keep_count)
+{
+    std::vector<double>& areas = *candidate_areas;
+    if (keep_count >= areas.size())
+    {
+        return AreaCutoff(-std::numeric_limits<double>::infinity(), 0);
+    }
+    if (keep_count == 0)
+    {
+        return AreaCutoff(std::numeric_limits<double>::infinity(), 0);
+    }
+
+    // the keep_count-th largest area is the cutoff; of the vertices sharing
+    // it, only as many as needed to reach keep_count are kept.
+    std::vector<double>::iterator nth = areas.begin() + (keep_count - 1);
+    std::nth_element(areas.begin(), nth, areas.end(), std::greater<double>());
+    const double cutoff = *nth;
+    // nth_element leaves only areas >= cutoff before nth
+    const size_t larger_count = std::count_if(
+            areas.begin(), nth,
+            [cutoff](double area) { return area > cutoff; });
+    return AreaCutoff(cutoff, keep_count - larger_count);
+}
@@ -0,0 +1,30 @@
+//
+//
+// 2013 (c) Mathieu Courtemanche
+
+#ifndef VERTEX_SELECTION_H
+#define VERTEX_SELECTION_H
+
+#include <vector>
+#include <cstddef>
+
+// Describes which vertices survive when only a given number of them may be
+// kept: every vertex whose effective area is above 'area', plus the first
+// 'tie_count' vertices (in input order) whose area is exactly 'area'.
+struct AreaCutoff
+{
+    AreaCutoff() : area(0.0), tie_count(0) {}
+    AreaCutoff(double area_, size_t tie_count_)
+        : area(area_), tie_count(tie_count_) {}
+
+    double area;
+    size_t tie_count;
+};
+
+// Finds the cutoff keeping exactly 'keep_count' of 'candidate_areas' (or all
+// of them if there are fewer). Linear time selection rather than a sort;
+// the candidates are reordered in the process.
+AreaCutoff select_area_cutoff(std::vector<double>* candidate_areas,
+                              size_t keep_count);
+
+#endif // VERTEX_SELECTION_H
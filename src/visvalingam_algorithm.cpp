@@ -3,137 +3,151 @@
 // 2013 (c) Mathieu Courtemanche
 
 #include "visvalingam_algorithm.h"
+#include "chunked_areas.h"
 #include <cstdlib>
-#include <cmath>
-#include <limits>
 #include <vector>
+#include <algorithm>
 #include <iostream>
-#include "heap.hpp"
 
-static const double NEARLY_ZERO = 1e-7;
+SimplifyStats::SimplifyStats()
+    : line_count(0)
+    , heap_pushes(0)
+    , heap_pops(0)
+    , heap_reheaps(0)
+    , max_heap_size(0)
+    , elimination_ns(0)
+{
+}
 
-// Represents 3 vertices from the input line and its associated effective area.
-struct VertexNode
+void SimplifyStats::add(const SimplifyStats& other)
 {
-    VertexNode(VertexIndex vertex_, VertexIndex prev_vertex_,
-               VertexIndex next_vertex_, double area_)
-        : vertex(vertex_)
-        , prev_vertex(prev_vertex_)
-        , next_vertex(next_vertex_)
-        , area(area_)
-    {
-    }
+    line_count += other.line_count;
+    heap_pushes += other.heap_pushes;
+    heap_pops += other.heap_pops;
+    heap_reheaps += other.heap_reheaps;
+    max_heap_size = std::max(max_heap_size, other.max_heap_size);
+    elimination_ns += other.elimination_ns;
+}
 
-    // ie: a triangle
-    VertexIndex vertex;
-    VertexIndex prev_vertex;
-    VertexIndex next_vertex;
-    // effective area
-    double area;
-};
+SimplifyWorkspace::SimplifyWorkspace()
+    : m_effective_areas()
+    , m_prev_vertex()
+    , m_next_vertex()
+    , m_min_heap(0)
+    , m_radix_heap(0)
+    , m_candidate_areas()
+    , m_segment_grid()
+    , m_joined_line()
+    , m_line_firsts()
+    , m_stats(NULL)
+{
+}
 
-struct VertexNodeCompare
+void SimplifyWorkspace::reset(size_t vertex_count)
 {
-    bool operator()(const VertexNode* lhs, const VertexNode* rhs) const
-    {
-        return lhs->area < rhs->area;
-    }
-};
+    // assign() and resize() keep the existing capacity
+    m_effective_areas.areas.assign(vertex_count, 0.0);
+    m_prev_vertex.resize(vertex_count);
+    m_next_vertex.resize(vertex_count);
+}
 
-static double effective_area(VertexIndex current, VertexIndex previous,
-                            VertexIndex next, const Linestring& input_line)
+void SimplifyWorkspace::add_stats(size_t push_count, size_t skipped_count,
+                                  size_t reheap_count)
 {
-    const Point& c = input_line[current];
-    const Point& p = input_line[previous];
-    const Point& n = input_line[next];
-    const Point c_n = vector_sub(n, c);
-    const Point c_p = vector_sub(p, c);
-    const double det = cross_product(c_n, c_p);
-    return 0.5 * fabs(det);
+    ++m_stats->line_count;
+    m_stats->heap_pushes += push_count;
+    m_stats->heap_pops += push_count - skipped_count;
+    m_stats->heap_reheaps += reheap_count;
+    m_stats->max_heap_size = std::max(m_stats->max_heap_size, push_count);
 }
 
-static double effective_area(const VertexNode& node,
-                            const Linestring& input_line)
+Visvalingam_Algorithm::Visvalingam_Algorithm(const Linestring& input,
+                                             const SimplifyOptions& options)
+    : m_effective_areas()
+    , m_input_line(input)
 {
-    return effective_area(node.vertex, node.prev_vertex,
-                            node.next_vertex, input_line);
+    SimplifyWorkspace workspace;
+    workspace.compute_effective_areas(input, options);
+    m_effective_areas.areas.swap(workspace.m_effective_areas.areas);
+    m_effective_areas.source_indices.swap(
+            workspace.m_effective_areas.source_indices);
 }
 
-Visvalingam_Algorithm::Visvalingam_Algorithm(const Linestring& input)
-    : m_effective_areas(input.size(), 0.0)
+Visvalingam_Algorithm::Visvalingam_Algorithm(const Linestring& input,
+                                             SimplifyWorkspace* workspace,
+                                             const SimplifyOptions& options)
+    : m_effective_areas()
     , m_input_line(input)
 {
-    // Compute effective area for each point in the input (except endpoints)
-    std::vector<VertexNode*> node_list(input.size(), NULL);
-    Heap<VertexNode*, VertexNodeCompare> min_heap(input.size());
-    for (VertexIndex i=1; i < input.size()-1; ++i)
-    {
-        double area = effective_area(i, i-1, i+1, input);
-        if (area > NEARLY_ZERO)
-        {
-            node_list[i] = new VertexNode(i, i-1, i+1, area);
-            min_heap.insert(node_list[i]);
-        }
-    }
+    assert(workspace);
+    workspace->compute_effective_areas(input, options);
+    m_effective_areas = workspace->effective_areas();
+}
 
-    double min_area = -std::numeric_limits<double>::max();
-    while (!min_heap.empty())
-    {
-        VertexNode* curr_node = min_heap.pop();
-        assert (curr_node == node_list[curr_node->vertex]);
-
-        // If the current point's calculated area is less than that of the last
-        // point to be eliminated, use the latter's area instead. (This ensures
-        // that the current point cannot be eliminated without eliminating
-        // previously eliminated points.)
-        min_area = std::max(min_area, curr_node->area);
-
-        VertexNode* prev_node = node_list[curr_node->prev_vertex];
-        if (prev_node != NULL)
-        {
-            prev_node->next_vertex = curr_node->next_vertex;
-            prev_node->area = effective_area(*prev_node, input);
-            min_heap.reheap(prev_node);
-        }
-        
-        VertexNode* next_node = node_list[curr_node->next_vertex];
-        if (next_node != NULL)
-        {
-            next_node->prev_vertex = curr_node->prev_vertex;
-            next_node->area = effective_area(*next_node, input);
-            min_heap.reheap(next_node);
-        }
-
-        // store the final value for this vertex and delete the node.
-        m_effective_areas[curr_node->vertex] = min_area;
-        node_list[curr_node->vertex] = NULL;
-        delete curr_node;
-    }
-    node_list.clear();
+Visvalingam_Algorithm::Visvalingam_Algorithm(
+        const Linestring& input, ThreadPool* pool,
+        std::vector<SimplifyWorkspace>* workspaces,
+        const SimplifyOptions& options)
+    : m_effective_areas()
+    , m_input_line(input)
+{
+    assert(pool);
+    assert(workspaces);
+    compute_chunked_effective_areas(input, pool, workspaces, options,
+                                    &m_effective_areas);
 }
 
 void Visvalingam_Algorithm::simplify(double area_threshold,
                                     Linestring* res) const
 {
-    assert(res);
-    for (VertexIndex i=0; i < m_input_line.size(); ++i)
-    {
-        if (contains_vertex(i, area_threshold))
-        {
-            res->push_back(m_input_line[i]);
-        }
-    }
-    if (res->size() < 4)
+    filter_vertices(m_input_line, m_effective_areas, area_threshold, res);
+}
+
+void Visvalingam_Algorithm::simplify(
+        const std::vector<double>& area_thresholds,
+        std::vector<Linestring>* res) const
+{
+    filter_vertices(m_input_line, m_effective_areas, area_thresholds, res);
+}
+
+void Visvalingam_Algorithm::simplify_to_count(size_t vertex_count,
+                                              Linestring* res) const
+{
+    std::vector<double> candidate_areas;
+    append_candidate_areas(m_effective_areas, &candidate_areas);
+    // endpoints take two of the vertices
+    const size_t interior_count = vertex_count > 2 ? vertex_count - 2 : 0;
+    const AreaCutoff cutoff = select_area_cutoff(&candidate_areas,
+                                                 interior_count);
+    size_t ties_left = cutoff.tie_count;
+    simplify(m_input_line, m_effective_areas, cutoff, &ties_left, res);
+}
+
+void Visvalingam_Algorithm::append_candidate_areas(
+        const EffectiveAreas& effective_areas, std::vector<double>* res)
+{
+    const std::vector<double>& areas = effective_areas.areas;
+    if (areas.size() > 2)
     {
-        res->clear();
+        res->insert(res->end(), areas.begin() + 1, areas.end() - 1);
     }
 }
 
+SimplifyOptions Visvalingam_Algorithm::bounded_options(
+        const SimplifyOptions& options, double area_threshold)
+{
+    SimplifyOptions res = options;
+    res.max_area_threshold = std::min(options.max_area_threshold,
+                                      area_threshold);
+    return res;
+}
+
 void Visvalingam_Algorithm::print_areas() const
 {
     for (VertexIndex i=0; i < m_effective_areas.size(); ++i)
     {
-        std::cout << i << ": " << m_effective_areas[i] << std::endl;
+        std::cout << m_effective_areas.source_index(i) << ": "
+                  << m_effective_areas.areas[i] << std::endl;
     }
 }
 
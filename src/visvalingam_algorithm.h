@@ -7,36 +7,1133 @@
 
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
 #include "geo_types.h"
+#include "coordinate_view.hpp"
+#include "heap.hpp"
+#include "radix_heap.hpp"
+#include "vertex_selection.h"
+#include "triangle_areas.h"
+#include "segment_grid.h"
+
+class ThreadPool;
+
+// Vertices are identified by their 32-bit index in the input line while the
+// elimination loop runs; this keeps the per-vertex working set at 36 bytes:
+// prev/next links, the area, the heap entry (area and index, padded to 16
+// bytes) and the heap position.
+typedef uint32_t NodeIndex;
+
+// Children per heap node, measured with the heap-* stages of `make bench`:
+// 4 is fastest or within a few percent from 10^3 vertices per ring up, and
+// up to 25% faster than 2 on rings of 10^6 and more. 2 only wins on rings
+// of about 100 vertices, by a few ns per vertex; 8 pays for its extra
+// comparisons per level.
+static const size_t VERTEX_HEAP_ARITY = 4;
+
+// Vertices ordered by their current area, ties broken on the vertex index so
+// the elimination order does not depend on the heap layout.
+typedef KeyedHeap<double, NodeIndex, VERTEX_HEAP_ARITY> VertexHeap;
+
+// Lines of at most this many vertices skip the queue: the elimination loop
+// runs on stack arrays and finds the smallest area by a linear scan, see
+// SimplifyWorkspace::eliminate_small(). On jittered rings this halves the
+// time per vertex up to 16 vertices and still saves 15% at 64; the heap
+// catches up at about 100.
+static const size_t SMALL_RING_SIZE = 64;
+
+// Priority queue used by the elimination loop; both give the same results.
+enum VertexQueue
+{
+    VERTEX_QUEUE_HEAP,      // VertexHeap, O(log n) per operation
+    VERTEX_QUEUE_RADIX      // RadixHeap, O(1) amortized, see radix_heap.hpp
+};
+
+// Settings for the effective area computation.
+struct SimplifyOptions
+{
+    SimplifyOptions()
+        : max_area_threshold(std::numeric_limits<double>::infinity())
+        , collinear_tolerance(-1.0)
+        , queue(VERTEX_QUEUE_HEAP)
+        , prevent_intersections(false)
+    {
+    }
+
+    // Largest area threshold the results will be filtered with. Elimination
+    // stops as soon as effective areas exceed it and the remaining vertices
+    // get the area reached at that point, a lower bound of their true one:
+    // results stay exact for any threshold up to max_area_threshold.
+    double max_area_threshold;
+
+    // When >= 0, a linear pre-pass drops runs of vertices that each form a
+    // triangle of at most this area with the vertices kept on either side
+    // of the run: duplicates, zero-length segments and (nearly) collinear
+    // runs, up to COLLINEAR_RUN_LIMIT vertices long. The
+    // elimination loop and the effective areas then only cover the vertices
+    // left, see EffectiveAreas::source_indices. Disabled by default.
+    double collinear_tolerance;
+
+    // The radix queue is faster from about 10^3 vertices per line, see the
+    // heap-* stages of `make bench`; on rings of about 100 vertices,
+    // resetting its buckets costs more than the heap operations it saves.
+    // Lines of up to SMALL_RING_SIZE vertices use neither.
+    VertexQueue queue;
+
+    // When set, a vertex is only eliminated if the segment joining its
+    // neighbours crosses no other segment left, found through a
+    // SegmentGrid; otherwise it leaves the queue, with an effective area of
+    // +infinity, until one of its neighbours goes. Lines that do not cross
+    // themselves then never do at any threshold, without a repair pass.
+    // Lines run through one loop, see the compute_effective_areas() taking
+    // several, e.g.: the rings of a polygon, share the grid and do not
+    // cross each other either at any threshold, though they may when each
+    // is cut at its own area, see select_area_cutoff(). Lines of separate
+    // loops are not checked against each other. The loop takes 4 to 6
+    // times as long on wavy rings of 10^5 to 10^6 vertices, mostly cache
+    // misses in the grid; small lines and degenerate vertices, see
+    // NEARLY_ZERO, go through the queue too.
+    bool prevent_intersections;
+};
+
+// Effective areas of the vertices that went through the elimination loop.
+// With a pre-filter these are a subset of the input: source_indices maps
+// each of them back to its index in the input line. Without one,
+// source_indices is left empty and the mapping is the identity.
+struct EffectiveAreas
+{
+    VertexIndex source_index(size_t i) const
+    {
+        return source_indices.empty() ? i : source_indices[i];
+    }
+
+    size_t size() const
+    {
+        return areas.size();
+    }
+
+    std::vector<double> areas;
+    std::vector<NodeIndex> source_indices;
+};
+
+// Point sequence restricted to some of its vertices.
+template <typename PointSequence>
+class IndexedView
+{
+public:
+    IndexedView(const PointSequence& input,
+                const std::vector<NodeIndex>& indices)
+        : m_input(input)
+        , m_indices(indices)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_indices.size();
+    }
+
+    Point operator[](size_t i) const
+    {
+        return m_input[m_indices[i]];
+    }
+
+private:
+    const PointSequence& m_input;
+    const std::vector<NodeIndex>& m_indices;
+};
+
+// Counters of the elimination loop, summed over every line run through a
+// workspace they are attached to, see SimplifyWorkspace::set_stats().
+struct SimplifyStats
+{
+    SimplifyStats();
+
+    void add(const SimplifyStats& other);
+
+    size_t line_count;
+    size_t heap_pushes;
+    size_t heap_pops;
+    size_t heap_reheaps;
+    size_t max_heap_size;
+    // wall time spent in compute_effective_areas()
+    uint64_t elimination_ns;
+};
+
+// Scratch buffers for the elimination loop. They grow to the largest line
+// seen and are then reused, so simplifying many lines through one workspace
+// stops allocating once warmed up. Not thread safe: use one per thread.
+class SimplifyWorkspace
+{
+public:
+    SimplifyWorkspace();
+
+    // Runs the elimination loop over 'input', any sequence of points with
+    // size() and operator[] (Linestring, InterleavedView, SeparateView).
+    template <typename PointSequence>
+    void compute_effective_areas(
+            const PointSequence& input,
+            const SimplifyOptions& options = SimplifyOptions());
+
+    // Runs one elimination loop over all of 'lines', e.g.: the rings of a
+    // polygon, into (*res)[i] for lines[i]. Their vertices share one queue
+    // and the running area that clamps effective areas; with
+    // prevent_intersections, their segments also share one grid, so that
+    // no line crosses another at any threshold either. The areas of a
+    // line then depend on the others: without that option, run the lines
+    // one at a time instead.
+    template <typename PointSequence>
+    void compute_effective_areas(
+            const std::vector<const PointSequence*>& lines,
+            const SimplifyOptions& options,
+            std::vector<EffectiveAreas>* res);
+
+    // Result of the last compute_effective_areas() over a single line.
+    const EffectiveAreas& effective_areas() const
+    {
+        return m_effective_areas;
+    }
+
+    // Neighbours each vertex had when eliminated, by the last
+    // compute_effective_areas() run through the heap: without a pre-filter
+    // or max_area_threshold, over more than SMALL_RING_SIZE vertices.
+    // Vertices never eliminated keep their initial ones.
+    const std::vector<NodeIndex>& prev_vertices() const
+    {
+        return m_prev_vertex;
+    }
+
+    const std::vector<NodeIndex>& next_vertices() const
+    {
+        return m_next_vertex;
+    }
+
+    // Accumulates counters into 'stats' (not owned) from now on. NULL, the
+    // default, disables them: the loop then only tests that pointer.
+    void set_stats(SimplifyStats* stats)
+    {
+        m_stats = stats;
+    }
+
+private:
+    friend class Visvalingam_Algorithm;
+
+    SimplifyWorkspace(const SimplifyWorkspace& other);
+    SimplifyWorkspace& operator=(const SimplifyWorkspace& other);
+
+    void reset(size_t vertex_count);
+
+    template <typename PointSequence>
+    void filter_collinear(const PointSequence& input, double tolerance);
+
+    template <typename PointSequence>
+    void eliminate(const PointSequence& input, const SimplifyOptions& options);
+
+    template <typename PointSequence, typename Queue>
+    void eliminate(const PointSequence& input, const SimplifyOptions& options,
+                   Queue* queue,
+                   const std::vector<NodeIndex>* line_firsts = NULL);
+
+    // Whether the elimination loop left 'vertex' in place because removing
+    // it would have made the line cross itself, see prevent_intersections.
+    bool is_blocked(NodeIndex vertex) const
+    {
+        return m_effective_areas.areas[vertex]
+               == std::numeric_limits<double>::infinity();
+    }
+
+    template <size_t MaxSize, typename PointSequence>
+    void eliminate_small(const PointSequence& input,
+                         const SimplifyOptions& options);
+
+    void add_stats(size_t push_count, size_t skipped_count,
+                   size_t reheap_count);
+
+    // While a vertex is in the heap, its area is the one of its current
+    // triangle; once popped, its final effective area.
+    EffectiveAreas m_effective_areas;
+    std::vector<NodeIndex> m_prev_vertex;
+    std::vector<NodeIndex> m_next_vertex;
+    VertexHeap m_min_heap;
+    RadixHeap<NodeIndex> m_radix_heap;
+    // scratch for the vertex count selection
+    std::vector<double> m_candidate_areas;
+    // segments left, with SimplifyOptions::prevent_intersections
+    SegmentGrid m_segment_grid;
+    // several lines run through one loop, one after the other
+    Linestring m_joined_line;
+    std::vector<NodeIndex> m_line_firsts;
+    SimplifyStats* m_stats;
+};
 
 class Visvalingam_Algorithm
 {
 public:
-    Visvalingam_Algorithm(const Linestring& input);
+    Visvalingam_Algorithm(const Linestring& input,
+                          const SimplifyOptions& options = SimplifyOptions());
+    Visvalingam_Algorithm(const Linestring& input,
+                          SimplifyWorkspace* workspace,
+                          const SimplifyOptions& options = SimplifyOptions());
+    // Splits 'input' over every thread of 'pool', with one workspace per
+    // worker: see compute_chunked_effective_areas(), a few of whose areas
+    // differ from those of the constructor above.
+    Visvalingam_Algorithm(const Linestring& input, ThreadPool* pool,
+                          std::vector<SimplifyWorkspace>* workspaces,
+                          const SimplifyOptions& options = SimplifyOptions());
 
     void simplify(double area_threshold, Linestring* res) const;
 
+    // Levels of detail: (*res)[i] receives the line simplified with
+    // area_thresholds[i], all levels produced by one pass over the
+    // effective areas. Thresholds may come in any order.
+    void simplify(const std::vector<double>& area_thresholds,
+                  std::vector<Linestring>* res) const;
+
+    // Keeps the 'vertex_count' most important vertices, endpoints included,
+    // instead of going by an area threshold.
+    void simplify_to_count(size_t vertex_count, Linestring* res) const;
+
+    // One-shot simplification that keeps all intermediate state in
+    // 'workspace'; meant for batch runs over many lines. The elimination
+    // loop stops once past the (largest) threshold.
+    // Like compute_effective_areas(), these accept any point sequence:
+    // Linestring or a view over caller-owned coordinates.
+    template <typename PointSequence>
+    static void simplify(const PointSequence& input, double area_threshold,
+                         Linestring* res, SimplifyWorkspace* workspace,
+                         const SimplifyOptions& options = SimplifyOptions());
+    template <typename PointSequence>
+    static void simplify(const PointSequence& input,
+                         const std::vector<double>& area_thresholds,
+                         std::vector<Linestring>* res,
+                         SimplifyWorkspace* workspace,
+                         const SimplifyOptions& options = SimplifyOptions());
+    template <typename PointSequence>
+    static void simplify_to_count(
+            const PointSequence& input, size_t vertex_count, Linestring* res,
+            SimplifyWorkspace* workspace,
+            const SimplifyOptions& options = SimplifyOptions());
+
+    // Filters 'input' given effective areas computed earlier and a cutoff
+    // from select_area_cutoff(). '*ties_left' starts at cutoff.tie_count and
+    // is decremented for each tie kept, so a single cutoff can be shared by
+    // many lines, e.g.: to spread a vertex budget over a feature's rings.
+    template <typename PointSequence>
+    static void simplify(const PointSequence& input,
+                         const EffectiveAreas& effective_areas,
+                         const AreaCutoff& cutoff, size_t* ties_left,
+                         Linestring* res);
+
+    // Levels of detail of 'input' given effective areas computed earlier,
+    // e.g.: by the compute_effective_areas() taking several lines.
+    template <typename PointSequence>
+    static void simplify(const PointSequence& input,
+                         const EffectiveAreas& effective_areas,
+                         const std::vector<double>& area_thresholds,
+                         std::vector<Linestring>* res);
+
+    // Appends the interior vertices' effective areas (endpoints are always
+    // kept, so never candidates) to 'res', as input to select_area_cutoff().
+    static void append_candidate_areas(const EffectiveAreas& effective_areas,
+                                       std::vector<double>* res);
+
+    // One-shot simplification of coordinates in caller-owned buffers, see
+    // coordinate_view.hpp. Writes the index of every kept vertex to
+    // 'kept_indices', which must have room for input.size() entries, and
+    // returns how many were kept. Unlike simplify(), results shorter than a
+    // ring are returned as is rather than cleared.
+    template <typename PointSequence>
+    static size_t simplify_indices(
+            const PointSequence& input, double area_threshold,
+            VertexIndex* kept_indices, SimplifyWorkspace* workspace,
+            const SimplifyOptions& options = SimplifyOptions());
+
+    // As simplify_indices(), but writes the kept coordinates as interleaved
+    // XY to 'out', 'out_stride' elements apart.
+    template <typename PointSequence, typename T>
+    static size_t simplify_coordinates(
+            const PointSequence& input, double area_threshold,
+            T* out, size_t out_stride, SimplifyWorkspace* workspace,
+            const SimplifyOptions& options = SimplifyOptions());
+
+    const EffectiveAreas& effective_areas() const
+    {
+        return m_effective_areas;
+    }
+
     void print_areas() const;
 
 private:
-    bool contains_vertex(VertexIndex vertex_index, double area_threshold) const;
+    static SimplifyOptions bounded_options(const SimplifyOptions& options,
+                                           double area_threshold);
 
-    std::vector<double> m_effective_areas;
+    template <typename PointSequence>
+    static void filter_vertices(const PointSequence& input,
+                                const EffectiveAreas& effective_areas,
+                                double area_threshold, Linestring* res);
+
+    template <typename PointSequence>
+    static void filter_vertices(const PointSequence& input,
+                                const EffectiveAreas& effective_areas,
+                                const std::vector<double>& area_thresholds,
+                                std::vector<Linestring>* res);
+
+    static bool contains_vertex(const std::vector<double>& effective_areas,
+                                VertexIndex vertex_index,
+                                double area_threshold);
+
+    EffectiveAreas m_effective_areas;
     const Linestring& m_input_line;
 };
 
 inline bool
-Visvalingam_Algorithm::contains_vertex(VertexIndex vertex_index,
-                                        double area_threshold) const
+Visvalingam_Algorithm::contains_vertex(
+        const std::vector<double>& effective_areas,
+        VertexIndex vertex_index, double area_threshold)
 {
-    assert(vertex_index < m_effective_areas.size());
-    assert(m_effective_areas.size() != 0);
-    if (vertex_index == 0 || vertex_index == m_effective_areas.size()-1)
+    assert(vertex_index < effective_areas.size());
+    assert(effective_areas.size() != 0);
+    if (vertex_index == 0 || vertex_index == effective_areas.size()-1)
     {
         // end points always kept since we don't evaluate their effective areas
         return true;
     }
-    return m_effective_areas[vertex_index] > area_threshold;
+    return effective_areas[vertex_index] > area_threshold;
+}
+
+// Longest run of vertices the collinear pre-filter drops in a row. Every
+// vertex of a run is checked against the chord replacing it, so longer
+// runs would cost O(n^2) on long straight lines; the vertex closing a run
+// this long is kept, for the elimination loop to drop instead.
+static const size_t COLLINEAR_RUN_LIMIT = 64;
+
+// Triangles smaller than this are treated as degenerate: their middle vertex
+// never enters the heap and keeps an effective area of 0, unless
+// SimplifyOptions::prevent_intersections needs to check its removal too.
+static const double NEARLY_ZERO = 1e-7;
+
+template <typename PointSequence>
+inline double effective_area(VertexIndex current, VertexIndex previous,
+                             VertexIndex next, const PointSequence& input_line)
+{
+    const Point& c = input_line[current];
+    const Point& p = input_line[previous];
+    const Point& n = input_line[next];
+    const Point c_n = vector_sub(n, c);
+    const Point c_p = vector_sub(p, c);
+    const double det = cross_product(c_n, c_p);
+    return 0.5 * fabs(det);
+}
+
+// Writes the triangle area of every interior vertex of 'input' to 'areas'.
+// Packed XY doubles go through the SIMD kernels of triangle_areas.h, other
+// point sequences through effective_area(): the results are the same.
+template <typename PointSequence>
+inline void initial_areas(const PointSequence& input, double* areas)
+{
+    for (VertexIndex i=1; i+1 < input.size(); ++i)
+    {
+        areas[i] = effective_area(i, i-1, i+1, input);
+    }
+}
+
+inline void initial_areas(const Linestring& input, double* areas)
+{
+    static_assert(sizeof(Point) == 2 * sizeof(double),
+                  "a Linestring must be packed XY");
+    if (!input.empty())
+    {
+        triangle_areas(&input[0].X, input.size(), areas);
+    }
+}
+
+inline void initial_areas(const InterleavedView<double>& input, double* areas)
+{
+    if (input.stride() == 2)
+    {
+        triangle_areas(input.data(), input.size(), areas);
+    }
+    else
+    {
+        initial_areas<InterleavedView<double> >(input, areas);
+    }
+}
+
+template <typename PointSequence>
+void SimplifyWorkspace::compute_effective_areas(const PointSequence& input,
+                                                const SimplifyOptions& options)
+{
+    assert(input.size() < std::numeric_limits<NodeIndex>::max());
+    std::chrono::steady_clock::time_point start;
+    if (m_stats)
+    {
+        start = std::chrono::steady_clock::now();
+    }
+
+    if (options.collinear_tolerance >= 0)
+    {
+        filter_collinear(input, options.collinear_tolerance);
+        eliminate(IndexedView<PointSequence>(
+                        input, m_effective_areas.source_indices),
+                  options);
+    }
+    else
+    {
+        m_effective_areas.source_indices.clear();
+        eliminate(input, options);
+    }
+
+    if (m_stats)
+    {
+        m_stats->elimination_ns +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+template <typename PointSequence>
+void SimplifyWorkspace::compute_effective_areas(
+        const std::vector<const PointSequence*>& lines,
+        const SimplifyOptions& options, std::vector<EffectiveAreas>* res)
+{
+    res->resize(lines.size());
+    if (lines.empty())
+    {
+        return;
+    }
+    std::chrono::steady_clock::time_point start;
+    if (m_stats)
+    {
+        start = std::chrono::steady_clock::now();
+    }
+
+    // the vertices each line keeps through the pre-filter, line after line
+    m_joined_line.clear();
+    m_line_firsts.assign(1, 0);
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        const PointSequence& line = *lines[i];
+        std::vector<NodeIndex>& source_indices = (*res)[i].source_indices;
+        if (options.collinear_tolerance >= 0)
+        {
+            filter_collinear(line, options.collinear_tolerance);
+            source_indices.swap(m_effective_areas.source_indices);
+            for (size_t j = 0; j < source_indices.size(); ++j)
+            {
+                m_joined_line.push_back(line[source_indices[j]]);
+            }
+        }
+        else
+        {
+            source_indices.clear();
+            for (size_t j = 0; j < line.size(); ++j)
+            {
+                m_joined_line.push_back(line[j]);
+            }
+        }
+        m_line_firsts.push_back(static_cast<NodeIndex>(m_joined_line.size()));
+    }
+    assert(m_joined_line.size() < std::numeric_limits<NodeIndex>::max());
+
+    m_effective_areas.source_indices.clear();
+    if (options.queue == VERTEX_QUEUE_RADIX)
+    {
+        eliminate(m_joined_line, options, &m_radix_heap, &m_line_firsts);
+    }
+    else
+    {
+        eliminate(m_joined_line, options, &m_min_heap, &m_line_firsts);
+    }
+    const std::vector<double>& areas = m_effective_areas.areas;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        (*res)[i].areas.assign(areas.begin() + m_line_firsts[i],
+                               areas.begin() + m_line_firsts[i+1]);
+    }
+
+    if (m_stats)
+    {
+        // eliminate() counted one line
+        m_stats->line_count += lines.size() - 1;
+        m_stats->elimination_ns +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+template <typename PointSequence>
+void SimplifyWorkspace::filter_collinear(const PointSequence& input,
+                                         double tolerance)
+{
+    std::vector<NodeIndex>& kept = m_effective_areas.source_indices;
+    kept.clear();
+    const NodeIndex vertex_count = static_cast<NodeIndex>(input.size());
+    if (vertex_count == 0)
+    {
+        return;
+    }
+
+    // Dropping i joins the last vertex kept to i+1: every vertex skipped
+    // since, not only i, must stay within the tolerance of that chord, or
+    // a curve sampled densely enough drifts away one small triangle at a
+    // time.
+    kept.push_back(0);
+    for (NodeIndex i=1; i+1 < vertex_count; ++i)
+    {
+        const NodeIndex last = kept.back();
+        const Point last_kept = input[last];
+        const Point chord = vector_sub(input[i+1], last_kept);
+        bool drop = i - last <= COLLINEAR_RUN_LIMIT;
+        for (NodeIndex j = last + 1; j <= i && drop; ++j)
+        {
+            const Point offset = vector_sub(input[j], last_kept);
+            drop = 0.5 * fabs(cross_product(chord, offset)) <= tolerance;
+        }
+        if (!drop)
+        {
+            kept.push_back(i);
+        }
+    }
+    if (vertex_count > 1)
+    {
+        kept.push_back(vertex_count - 1);
+    }
+}
+
+template <typename PointSequence>
+void SimplifyWorkspace::eliminate(const PointSequence& input,
+                                  const SimplifyOptions& options)
+{
+    if (input.size() <= SMALL_RING_SIZE && !options.prevent_intersections)
+    {
+        eliminate_small<SMALL_RING_SIZE>(input, options);
+    }
+    else if (options.queue == VERTEX_QUEUE_RADIX)
+    {
+        eliminate(input, options, &m_radix_heap);
+    }
+    else
+    {
+        eliminate(input, options, &m_min_heap);
+    }
+}
+
+// 'Queue' is VertexHeap or RadixHeap<NodeIndex>. 'line_firsts', unless
+// NULL, splits 'input' into lines run one after the other, see the
+// compute_effective_areas() taking several lines.
+template <typename PointSequence, typename Queue>
+void SimplifyWorkspace::eliminate(const PointSequence& input,
+                                  const SimplifyOptions& options,
+                                  Queue* queue,
+                                  const std::vector<NodeIndex>* line_firsts)
+{
+    const NodeIndex vertex_count = static_cast<NodeIndex>(input.size());
+    const size_t line_count = line_firsts ? line_firsts->size() - 1 : 1;
+    reset(vertex_count);
+    queue->reset(vertex_count);
+
+    // The line as a doubly linked list over vertex indices.
+    std::vector<double>& effective_areas = m_effective_areas.areas;
+    std::vector<NodeIndex>& prev_vertex = m_prev_vertex;
+    std::vector<NodeIndex>& next_vertex = m_next_vertex;
+    Queue& min_heap = *queue;
+
+    // Compute effective area for each point in the input (except endpoints)
+    // in one pass, then build the heap bottom-up in O(n).
+    if (vertex_count > 2)
+    {
+        initial_areas(input, &effective_areas[0]);
+    }
+    // dropping a degenerate vertex, e.g.: a duplicate point, can still let
+    // the line cross itself once its neighbours go
+    const bool queue_degenerate = options.prevent_intersections;
+    for (size_t line = 0; line < line_count; ++line)
+    {
+        const NodeIndex first = line_firsts ? (*line_firsts)[line] : 0;
+        const NodeIndex end =
+            line_firsts ? (*line_firsts)[line+1] : vertex_count;
+        if (end > first)
+        {
+            // initial_areas() saw triangles across two lines here
+            effective_areas[first] = 0.0;
+            effective_areas[end-1] = 0.0;
+        }
+        for (NodeIndex i=first+1; i+1 < end; ++i)
+        {
+            prev_vertex[i] = i-1;
+            next_vertex[i] = i+1;
+            if (effective_areas[i] > NEARLY_ZERO || queue_degenerate)
+            {
+                min_heap.push_unordered(i, effective_areas[i]);
+            }
+            else
+            {
+                effective_areas[i] = 0.0;
+            }
+        }
+    }
+    min_heap.heapify();
+    size_t push_count = min_heap.size();
+    size_t reheap_count = 0;
+    size_t skipped_count = 0;
+
+    // segment i goes from vertex i to next_vertex[i]: with several lines,
+    // i also tells which line it belongs to
+    SegmentGrid* grid =
+        options.prevent_intersections ? &m_segment_grid : NULL;
+    if (grid && vertex_count > 1)
+    {
+        // cells about twice as large as the average segment
+        double length = 0.0;
+        size_t segment_count = 0;
+        for (size_t line = 0; line < line_count; ++line)
+        {
+            const NodeIndex first = line_firsts ? (*line_firsts)[line] : 0;
+            const NodeIndex end =
+                line_firsts ? (*line_firsts)[line+1] : vertex_count;
+            for (NodeIndex i=first; i+1 < end; ++i)
+            {
+                const Point d = vector_sub(input[i+1], input[i]);
+                length += fabs(d.X) + fabs(d.Y);
+                ++segment_count;
+            }
+        }
+        const double cell_size =
+            segment_count > 0 ? 2.0 * length / segment_count : 0.0;
+        grid->reset(input[0], cell_size > 0 ? cell_size : 1.0);
+        for (size_t line = 0; line < line_count; ++line)
+        {
+            const NodeIndex first = line_firsts ? (*line_firsts)[line] : 0;
+            const NodeIndex end =
+                line_firsts ? (*line_firsts)[line+1] : vertex_count;
+            for (NodeIndex i=first; i+1 < end; ++i)
+            {
+                grid->insert(i, input[i], input[i+1]);
+            }
+        }
+    }
+
+    double min_area = -std::numeric_limits<double>::max();
+    while (!min_heap.empty())
+    {
+        const NodeIndex curr = min_heap.pop();
+
+        // If the current point's calculated area is less than that of the last
+        // point to be eliminated, use the latter's area instead. (This ensures
+        // that the current point cannot be eliminated without eliminating
+        // previously eliminated points.)
+        const double area = std::max(min_area, effective_areas[curr]);
+
+        if (area > options.max_area_threshold)
+        {
+            // every vertex left will be kept: skip their elimination.
+            skipped_count = min_heap.size();
+            effective_areas[curr] = area;
+            min_heap.for_each_node([&effective_areas, area](NodeIndex i)
+            {
+                effective_areas[i] = area;
+            });
+            min_heap.clear();
+            break;
+        }
+
+        const NodeIndex prev = prev_vertex[curr];
+        const NodeIndex next = next_vertex[curr];
+        if (grid)
+        {
+            const Point p = input[prev];
+            const Point c = input[curr];
+            const Point n = input[next];
+            if (grid->crosses(p, n, prev, curr))
+            {
+                // kept, and out of the queue until a neighbour goes; it
+                // does not raise the areas of the vertices eliminated next
+                effective_areas[curr] = std::numeric_limits<double>::infinity();
+                continue;
+            }
+            grid->erase(prev, p, c);
+            grid->erase(curr, c, n);
+            grid->insert(prev, p, n);
+        }
+        min_area = area;
+        if (min_heap.contains(prev))
+        {
+            next_vertex[prev] = next;
+            effective_areas[prev] =
+                effective_area(prev, prev_vertex[prev], next, input);
+            min_heap.update(prev, effective_areas[prev]);
+            ++reheap_count;
+        }
+        else if (grid && is_blocked(prev))
+        {
+            next_vertex[prev] = next;
+            effective_areas[prev] =
+                effective_area(prev, prev_vertex[prev], next, input);
+            min_heap.insert(prev, effective_areas[prev]);
+            ++push_count;
+        }
+
+        if (min_heap.contains(next))
+        {
+            prev_vertex[next] = prev;
+            effective_areas[next] =
+                effective_area(next, prev, next_vertex[next], input);
+            min_heap.update(next, effective_areas[next]);
+            ++reheap_count;
+        }
+        else if (grid && is_blocked(next))
+        {
+            prev_vertex[next] = prev;
+            effective_areas[next] =
+                effective_area(next, prev, next_vertex[next], input);
+            min_heap.insert(next, effective_areas[next]);
+            ++push_count;
+        }
+
+        // store the final value for this vertex.
+        effective_areas[curr] = min_area;
+    }
+
+    if (m_stats)
+    {
+        add_stats(push_count, skipped_count, reheap_count);
+    }
+}
+
+// Same loop as eliminate() over at most MaxSize vertices. The queued
+// vertices are kept unordered in 'keys' and 'nodes', each pop scanning them
+// for the smallest area, ties broken on the vertex index as in VertexHeap:
+// O(n^2), but without resetting any queue or touching the workspace's
+// per-vertex arrays, which dominates on rings this small.
+template <size_t MaxSize, typename PointSequence>
+void SimplifyWorkspace::eliminate_small(const PointSequence& input,
+                                        const SimplifyOptions& options)
+{
+    static_assert(MaxSize < 255, "small line indices must fit in a byte");
+    static const uint8_t NOT_QUEUED = 255;
+    const uint8_t vertex_count = static_cast<uint8_t>(input.size());
+    assert(input.size() <= MaxSize);
+    m_effective_areas.areas.assign(vertex_count, 0.0);
+    std::vector<double>& effective_areas = m_effective_areas.areas;
+
+    uint8_t prev_vertex[MaxSize];
+    uint8_t next_vertex[MaxSize];
+    // where each vertex is in 'keys' and 'nodes', NOT_QUEUED once popped
+    uint8_t positions[MaxSize];
+    double keys[MaxSize];
+    uint8_t nodes[MaxSize];
+    uint8_t queued_count = 0;
+
+    if (vertex_count > 0)
+    {
+        positions[0] = NOT_QUEUED;
+        positions[vertex_count - 1] = NOT_QUEUED;
+    }
+    if (vertex_count > 2)
+    {
+        initial_areas(input, &effective_areas[0]);
+    }
+    for (uint8_t i=1; i+1 < vertex_count; ++i)
+    {
+        prev_vertex[i] = i-1;
+        next_vertex[i] = i+1;
+        positions[i] = NOT_QUEUED;
+        const double area = effective_areas[i];
+        if (area > NEARLY_ZERO)
+        {
+            positions[i] = queued_count;
+            keys[queued_count] = area;
+            nodes[queued_count] = i;
+            ++queued_count;
+        }
+        else
+        {
+            effective_areas[i] = 0.0;
+        }
+    }
+    const size_t push_count = queued_count;
+    size_t reheap_count = 0;
+    size_t skipped_count = 0;
+
+    double min_area = -std::numeric_limits<double>::max();
+    while (queued_count > 0)
+    {
+        uint8_t best = 0;
+        for (uint8_t j = 1; j < queued_count; ++j)
+        {
+            if (keys[j] < keys[best]
+                || (keys[j] == keys[best] && nodes[j] < nodes[best]))
+            {
+                best = j;
+            }
+        }
+        const uint8_t curr = nodes[best];
+        // the last entry fills the hole
+        --queued_count;
+        keys[best] = keys[queued_count];
+        nodes[best] = nodes[queued_count];
+        positions[nodes[best]] = best;
+        positions[curr] = NOT_QUEUED;
+
+        min_area = std::max(min_area, effective_areas[curr]);
+
+        if (min_area > options.max_area_threshold)
+        {
+            // every vertex left will be kept: skip their elimination.
+            skipped_count = queued_count;
+            effective_areas[curr] = min_area;
+            for (uint8_t j = 0; j < queued_count; ++j)
+            {
+                effective_areas[nodes[j]] = min_area;
+            }
+            break;
+        }
+
+        const uint8_t prev = prev_vertex[curr];
+        const uint8_t next = next_vertex[curr];
+        if (positions[prev] != NOT_QUEUED)
+        {
+            next_vertex[prev] = next;
+            effective_areas[prev] =
+                effective_area(prev, prev_vertex[prev], next, input);
+            keys[positions[prev]] = effective_areas[prev];
+            ++reheap_count;
+        }
+
+        if (positions[next] != NOT_QUEUED)
+        {
+            prev_vertex[next] = prev;
+            effective_areas[next] =
+                effective_area(next, prev, next_vertex[next], input);
+            keys[positions[next]] = effective_areas[next];
+            ++reheap_count;
+        }
+
+        // store the final value for this vertex.
+        effective_areas[curr] = min_area;
+    }
+
+    if (m_stats)
+    {
+        add_stats(push_count, skipped_count, reheap_count);
+    }
+}
+
+template <typename PointSequence>
+size_t Visvalingam_Algorithm::simplify_indices(const PointSequence& input,
+                                               double area_threshold,
+                                               VertexIndex* kept_indices,
+                                               SimplifyWorkspace* workspace,
+                                               const SimplifyOptions& options)
+{
+    assert(kept_indices);
+    assert(workspace);
+    workspace->compute_effective_areas(
+            input, bounded_options(options, area_threshold));
+    const EffectiveAreas& effective_areas = workspace->effective_areas();
+    size_t kept_count = 0;
+    for (VertexIndex i=0; i < effective_areas.size(); ++i)
+    {
+        if (contains_vertex(effective_areas.areas, i, area_threshold))
+        {
+            kept_indices[kept_count++] = effective_areas.source_index(i);
+        }
+    }
+    return kept_count;
+}
+
+template <typename PointSequence, typename T>
+size_t Visvalingam_Algorithm::simplify_coordinates(const PointSequence& input,
+                                                   double area_threshold,
+                                                   T* out, size_t out_stride,
+                                                   SimplifyWorkspace* workspace,
+                                                   const SimplifyOptions& options)
+{
+    assert(out);
+    assert(workspace);
+    workspace->compute_effective_areas(
+            input, bounded_options(options, area_threshold));
+    const EffectiveAreas& effective_areas = workspace->effective_areas();
+    size_t kept_count = 0;
+    for (VertexIndex i=0; i < effective_areas.size(); ++i)
+    {
+        if (contains_vertex(effective_areas.areas, i, area_threshold))
+        {
+            const Point p = input[effective_areas.source_index(i)];
+            T* dest = out + kept_count * out_stride;
+            dest[0] = static_cast<T>(p.X);
+            dest[1] = static_cast<T>(p.Y);
+            ++kept_count;
+        }
+    }
+    return kept_count;
+}
+
+template <typename PointSequence>
+void Visvalingam_Algorithm::simplify(const PointSequence& input,
+                                     double area_threshold, Linestring* res,
+                                     SimplifyWorkspace* workspace,
+                                     const SimplifyOptions& options)
+{
+    assert(workspace);
+    workspace->compute_effective_areas(
+            input, bounded_options(options, area_threshold));
+    filter_vertices(input, workspace->effective_areas(), area_threshold, res);
+}
+
+template <typename PointSequence>
+void Visvalingam_Algorithm::simplify(
+        const PointSequence& input, const std::vector<double>& area_thresholds,
+        std::vector<Linestring>* res, SimplifyWorkspace* workspace,
+        const SimplifyOptions& options)
+{
+    assert(workspace);
+    if (area_thresholds.empty())
+    {
+        workspace->compute_effective_areas(input, options);
+    }
+    else
+    {
+        workspace->compute_effective_areas(
+                input, bounded_options(options,
+                                       *std::max_element(area_thresholds.begin(),
+                                                         area_thresholds.end())));
+    }
+    filter_vertices(input, workspace->effective_areas(), area_thresholds, res);
+}
+
+template <typename PointSequence>
+void Visvalingam_Algorithm::simplify_to_count(const PointSequence& input,
+                                              size_t vertex_count,
+                                              Linestring* res,
+                                              SimplifyWorkspace* workspace,
+                                              const SimplifyOptions& options)
+{
+    assert(workspace);
+    workspace->compute_effective_areas(input, options);
+    std::vector<double>& candidate_areas = workspace->m_candidate_areas;
+    candidate_areas.clear();
+    append_candidate_areas(workspace->effective_areas(), &candidate_areas);
+    const size_t interior_count = vertex_count > 2 ? vertex_count - 2 : 0;
+    const AreaCutoff cutoff = select_area_cutoff(&candidate_areas,
+                                                 interior_count);
+    size_t ties_left = cutoff.tie_count;
+    simplify(input, workspace->effective_areas(), cutoff, &ties_left, res);
+}
+
+template <typename PointSequence>
+void Visvalingam_Algorithm::simplify(
+        const PointSequence& input, const EffectiveAreas& effective_areas,
+        const std::vector<double>& area_thresholds,
+        std::vector<Linestring>* res)
+{
+    filter_vertices(input, effective_areas, area_thresholds, res);
+}
+
+template <typename PointSequence>
+void Visvalingam_Algorithm::simplify(
+        const PointSequence& input, const EffectiveAreas& effective_areas,
+        const AreaCutoff& cutoff, size_t* ties_left, Linestring* res)
+{
+    assert(res);
+    assert(ties_left);
+    assert(!effective_areas.source_indices.empty() ||
+           input.size() == effective_areas.size());
+    const std::vector<double>& areas = effective_areas.areas;
+    const VertexIndex last = effective_areas.size() - 1;
+    for (VertexIndex i=0; i < effective_areas.size(); ++i)
+    {
+        bool keep = (i == 0 || i == last || areas[i] > cutoff.area);
+        if (!keep && areas[i] == cutoff.area && *ties_left > 0)
+        {
+            --*ties_left;
+            keep = true;
+        }
+        if (keep)
+        {
+            res->push_back(input[effective_areas.source_index(i)]);
+        }
+    }
+    if (res->size() < 4)
+    {
+        res->clear();
+    }
+}
+
+template <typename PointSequence>
+void Visvalingam_Algorithm::filter_vertices(
+        const PointSequence& input, const EffectiveAreas& effective_areas,
+        double area_threshold, Linestring* res)
+{
+    assert(res);
+    for (VertexIndex i=0; i < effective_areas.size(); ++i)
+    {
+        if (contains_vertex(effective_areas.areas, i, area_threshold))
+        {
+            res->push_back(input[effective_areas.source_index(i)]);
+        }
+    }
+    if (res->size() < 4)
+    {
+        res->clear();
+    }
+}
+
+template <typename PointSequence>
+void Visvalingam_Algorithm::filter_vertices(
+        const PointSequence& input, const EffectiveAreas& effective_areas,
+        const std::vector<double>& area_thresholds,
+        std::vector<Linestring>* res)
+{
+    assert(res);
+    const size_t level_count = area_thresholds.size();
+    res->resize(level_count);
+
+    // Visit levels from the lowest threshold up: a vertex belongs to every
+    // level whose threshold is below its area, i.e.: to a prefix of them.
+    std::vector<size_t> levels(level_count);
+    std::vector<double> sorted_thresholds(level_count);
+    for (size_t i = 0; i < level_count; ++i)
+    {
+        levels[i] = i;
+    }
+    std::stable_sort(levels.begin(), levels.end(),
+                     [&area_thresholds](size_t lhs, size_t rhs)
+                     { return area_thresholds[lhs] < area_thresholds[rhs]; });
+    for (size_t i = 0; i < level_count; ++i)
+    {
+        sorted_thresholds[i] = area_thresholds[levels[i]];
+    }
+
+    const VertexIndex last = effective_areas.size() - 1;
+    for (VertexIndex i=0; i < effective_areas.size(); ++i)
+    {
+        // end points always kept since we don't evaluate their effective areas
+        size_t kept_levels = level_count;
+        if (i != 0 && i != last)
+        {
+            kept_levels = std::lower_bound(sorted_thresholds.begin(),
+                                           sorted_thresholds.end(),
+                                           effective_areas.areas[i])
+                          - sorted_thresholds.begin();
+        }
+        const Point& p = input[effective_areas.source_index(i)];
+        for (size_t j = 0; j < kept_levels; ++j)
+        {
+            (*res)[levels[j]].push_back(p);
+        }
+    }
+    for (size_t i = 0; i < level_count; ++i)
+    {
+        if ((*res)[i].size() < 4)
+        {
+            (*res)[i].clear();
+        }
+    }
 }
 
 #endif // VISVALINGAM_ALGORITHM_H